@@ -0,0 +1,140 @@
+/**
+ * @file Analyzer.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Turns text into index terms: tokenization, stopword removal and stemming
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * The articles and the searched words go through the same analyzer, so that they always agree
+ * on the terms. Analyzers:
+ *      spanish     tokens without stopwords, stemmed with the Snowball Spanish stemmer
+ *      simple      tokens as they are
+ *
+ * Stopwords ("de", "la", "que"...) appear in nearly every article, so they say nothing about
+ * a document and their postings would be the longest in the index. They are left out of the
+ * index and of the searches. Stemming makes the inflected forms of a word ("canción",
+ * "canciones") the same term, so a search finds all of them.
+ *
+ * The analyzer is configured once at startup, before any index is loaded.
+ *
+ */
+
+#include <unordered_set>
+
+#include "Analyzer.h"
+#include "SpanishStemmer.h"
+#include "Tokenizer.h"
+
+using namespace std;
+
+bool Analyzer::removeStopwords = true;
+bool Analyzer::stem = true;
+
+/**
+ *@brief Selects the analyzer used by the indexes loaded from now on and by the searches
+ *
+ *@param analyzerName   "spanish" or "simple"
+ *
+ *@return bool          false if there is no analyzer with that name
+ **/
+bool Analyzer::configure(const string &analyzerName)
+{
+    if (analyzerName == "spanish")
+        removeStopwords = stem = true;
+    else if (analyzerName == "simple")
+        removeStopwords = stem = false;
+    else
+        return false;
+
+    return true;
+}
+
+string Analyzer::getName()
+{
+    return stem ? "spanish" : "simple";
+}
+
+/**
+ *@brief Splits a text into index terms
+ *
+ *@param text           article text or searched words
+ *@param terms          terms, in order of appearance, are appended here
+ *
+ *@return size_t        number of tokens found, including the stopwords that were left out
+ **/
+size_t Analyzer::analyze(string_view text, vector<string> &terms)
+{
+    size_t firstTerm = terms.size();
+    Tokenizer::tokenize(text, terms);
+    size_t tokenCount = terms.size() - firstTerm;
+
+    size_t termCount = firstTerm;
+    for (size_t i = firstTerm; i < terms.size(); i++)
+    {
+        if (removeStopwords && isStopword(terms[i]))
+            continue;
+
+        if (stem)
+            SpanishStemmer::stem(terms[i]);
+
+        if (termCount != i)
+            terms[termCount] = move(terms[i]);
+        termCount++;
+    }
+    terms.resize(termCount);
+
+    return tokenCount;
+}
+
+/**
+ *@brief Checks whether a token is a Spanish stopword
+ *
+ *@param token          lowercase token, as returned by Tokenizer
+ **/
+bool Analyzer::isStopword(const string &token)
+{
+    // Based on the Snowball Spanish stopword list, without the forms of "estar" that are also
+    // common nouns (estado, estados)
+    static const unordered_set<string> stopwords = {
+        "de", "la", "que", "el", "en", "y", "a", "los", "del", "se", "las", "por", "un", "para",
+        "con", "no", "una", "su", "al", "lo", "como", "más", "pero", "sus", "le", "ya", "o",
+        "este", "sí", "porque", "esta", "entre", "cuando", "muy", "sin", "sobre", "también",
+        "me", "hasta", "hay", "donde", "quien", "desde", "todo", "nos", "durante", "todos",
+        "uno", "les", "ni", "contra", "otros", "ese", "eso", "ante", "ellos", "e", "esto", "mí",
+        "antes", "algunos", "qué", "unos", "yo", "otro", "otras", "otra", "él", "tanto", "esa",
+        "estos", "mucho", "quienes", "nada", "muchos", "cual", "poco", "ella", "estar", "estas",
+        "algunas", "algo", "nosotros", "mi", "mis", "tú", "te", "ti", "tu", "tus", "ellas",
+        "nosotras", "vosotros", "vosotras", "os", "mío", "mía", "míos", "mías", "tuyo", "tuya",
+        "tuyos", "tuyas", "suyo", "suya", "suyos", "suyas", "nuestro", "nuestra", "nuestros",
+        "nuestras", "vuestro", "vuestra", "vuestros", "vuestras", "esos", "esas",
+        "estoy", "estás", "está", "estamos", "estáis", "están", "esté", "estés", "estemos",
+        "estéis", "estén", "estaré", "estarás", "estará", "estaremos", "estaréis", "estarán",
+        "estaría", "estarías", "estaríamos", "estaríais", "estarían", "estaba", "estabas",
+        "estábamos", "estabais", "estaban", "estuve", "estuviste", "estuvo", "estuvimos",
+        "estuvisteis", "estuvieron", "estuviera", "estuvieras", "estuviéramos", "estuvierais",
+        "estuvieran", "estuviese", "estuvieses", "estuviésemos", "estuvieseis", "estuviesen",
+        "estando",
+        "he", "has", "ha", "hemos", "habéis", "han", "haya", "hayas", "hayamos", "hayáis",
+        "hayan", "habré", "habrás", "habrá", "habremos", "habréis", "habrán", "habría",
+        "habrías", "habríamos", "habríais", "habrían", "había", "habías", "habíamos",
+        "habíais", "habían", "hube", "hubiste", "hubo", "hubimos", "hubisteis", "hubieron",
+        "hubiera", "hubieras", "hubiéramos", "hubierais", "hubieran", "hubiese", "hubieses",
+        "hubiésemos", "hubieseis", "hubiesen", "habiendo", "habido", "habida", "habidos",
+        "habidas",
+        "soy", "eres", "es", "somos", "sois", "son", "sea", "seas", "seamos", "seáis", "sean",
+        "seré", "serás", "será", "seremos", "seréis", "serán", "sería", "serías", "seríamos",
+        "seríais", "serían", "era", "eras", "éramos", "erais", "eran", "fui", "fuiste", "fue",
+        "fuimos", "fuisteis", "fueron", "fuera", "fueras", "fuéramos", "fuerais", "fueran",
+        "fuese", "fueses", "fuésemos", "fueseis", "fuesen", "siendo", "sido",
+        "tengo", "tienes", "tiene", "tenemos", "tenéis", "tienen", "tenga", "tengas",
+        "tengamos", "tengáis", "tengan", "tendré", "tendrás", "tendrá", "tendremos",
+        "tendréis", "tendrán", "tendría", "tendrías", "tendríamos", "tendríais", "tendrían",
+        "tenía", "tenías", "teníamos", "teníais", "tenían", "tuve", "tuviste", "tuvo",
+        "tuvimos", "tuvisteis", "tuvieron", "tuviera", "tuvieras", "tuviéramos", "tuvierais",
+        "tuvieran", "tuviese", "tuvieses", "tuviésemos", "tuvieseis", "tuviesen", "teniendo",
+        "tenido", "tenida", "tenidos", "tenidas", "tened",
+    };
+
+    return stopwords.count(token) > 0;
+}
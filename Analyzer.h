@@ -0,0 +1,34 @@
+/**
+ * @file Analyzer.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Turns text into index terms: tokenization, stopword removal and stemming
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define DEFAULT_ANALYZER "spanish"
+
+class Analyzer
+{
+public:
+    static bool configure(const std::string &analyzerName);
+    static std::string getName();
+
+    static size_t analyze(std::string_view text, std::vector<std::string> &terms);
+    static bool isStopword(const std::string &token);
+
+private:
+    static bool removeStopwords;
+    static bool stem;
+};
+
+#endif
@@ -0,0 +1,371 @@
+/**
+ * @file CoordinatorHttpRequestHandler.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief EDAoogle coordinator: scatters searches to shard servers and gathers their results
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * A coordinator holds no index. Every /search is sent to all the shard servers in parallel
+ * through their /shard/search endpoint (see EDAoogleHttpRequestHandler::serveShardSearch) and
+ * the returned top-k lists are merged. A shard server that does not answer within the timeout
+ * is left out, so the user still gets the results of the others.
+ *
+ * Shard servers return urls and titles, which the coordinator numbers in a document table of
+ * the search, so the merged results carry document numbers like those of a local search.
+ *
+ * Example on a single box:
+ *      edahttpd --role shard -p 8001 --slice 0/2
+ *      edahttpd --role shard -p 8002 --slice 1/2
+ *      edahttpd --role coordinator -p 8000 --shards 127.0.0.1:8001,127.0.0.1:8002
+ *
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+#include <httplib.h>
+
+#include "CoordinatorHttpRequestHandler.h"
+
+using namespace std;
+
+/**
+ *@brief class constructor
+ *
+ *@param homePath       path to the folder with the static html files
+ *@param shardAddresses "host:port" of every shard server
+ *@param shardTimeout   time in milliseconds a shard server has to connect and to answer
+ **/
+CoordinatorHttpRequestHandler::CoordinatorHttpRequestHandler(string homePath,
+                                                             vector<string> shardAddresses,
+                                                             int shardTimeout) :
+EDAoogleHttpRequestHandler(homePath, 0)
+{
+    this->shardAddresses = shardAddresses;
+    this->shardTimeout = shardTimeout;
+}
+
+/**
+ *@brief Splits a comma separated list of shard server addresses
+ *
+ *@param addressList    e.g. "127.0.0.1:8001,127.0.0.1:8002"
+ *@param addresses      one "host:port" per shard server
+ *
+ *@return bool          true if there is at least one address and every address is valid
+ **/
+bool CoordinatorHttpRequestHandler::parseShardAddresses(const string &addressList,
+                                                        vector<string> &addresses)
+{
+    stringstream ss(addressList);
+    string address;
+    string host;
+    int port;
+
+    addresses.clear();
+    while (getline(ss, address, ','))
+    {
+        if (address.empty())
+            continue;
+        if (!splitShardAddress(address, host, port))
+            return false;
+        addresses.push_back(address);
+    }
+
+    return !addresses.empty();
+}
+
+/**
+ *@brief Splits a shard server address into its host and its port
+ *
+ *@param address        "host:port"
+ *@param host           host of the shard server
+ *@param port           port of the shard server
+ *
+ *@return bool          true if the address has a host and a port from 1 to 65535
+ **/
+bool CoordinatorHttpRequestHandler::splitShardAddress(const string &address, string &host,
+                                                      int &port)
+{
+    size_t separator = address.rfind(':');
+    if (separator == string::npos || separator == 0)
+        return false;
+
+    unsigned long value;
+    if (!parseNumber(address.c_str() + separator + 1, value) || value < 1 || value > 65535)
+        return false;
+
+    host = address.substr(0, separator);
+    port = (int)value;
+
+    return true;
+}
+
+/**
+ *@brief Parses a whole decimal number, such as a match count sent by a shard server
+ *
+ *@param text           the number, with nothing after it
+ *@param value          parsed number
+ *
+ *@return bool          true if text is a number that fits in value
+ **/
+bool CoordinatorHttpRequestHandler::parseNumber(const char *text, unsigned long &value)
+{
+    if (!isdigit((unsigned char)*text))
+        return false;
+
+    char *end;
+    errno = 0;
+    value = strtoul(text, &end, 10);
+
+    return errno == 0 && *end == '\0';
+}
+
+/**
+ *@brief Parses a score or a static rank sent by a shard server
+ *
+ *@param text           the number, followed by a tab or nothing
+ *@param value          parsed number
+ *
+ *@return bool          true if text starts with a finite number
+ **/
+bool CoordinatorHttpRequestHandler::parseScore(const char *text, float &value)
+{
+    char *end;
+    errno = 0;
+    value = strtof(text, &end);
+
+    return end != text && errno == 0 && isfinite(value) && (*end == '\t' || *end == '\0');
+}
+
+/**
+ *@brief Builds the /shard/search request of a search. Shard servers split q at '+' after
+ *       decoding it, and a literal '+' in a query string decodes to a space, so the words are
+ *       joined with an encoded '+'.
+ *
+ *@param words          searched words, as typed by the user
+ *@param options        how the words are combined and filtered
+ *
+ *@return string        path and query string of the request
+ **/
+string CoordinatorHttpRequestHandler::getShardQuery(const SearchTerms &words,
+                                                    const SearchOptions &options)
+{
+    string query = "/shard/search?q=";
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        if (i > 0)
+            query += "%2B";
+        query += encodeQueryWord(words[i]);
+    }
+    if (options.matchAll)
+        query += "&match=all";
+    for (const auto &filterKey : options.filters)
+    {
+        // Keys are "attribute:value" and a normalized value reads back as itself
+        size_t separator = filterKey.find(':');
+        query += "&" + filterKey.substr(0, separator) + "=" +
+                 encodeQueryWord(string_view(filterKey).substr(separator + 1));
+    }
+
+    return query;
+}
+
+/**
+ *@brief Scatters the search to every shard server and merges whatever arrived in time
+ *
+ *@param words                  searched words, as typed by the user
+ *@param options                how the words are combined
+ *@param results                best MAX_SEARCH_RESULTS results: document vs term frequency,
+ *                              sorted
+ *@param documents              table the document numbers of the results refer to
+ *@param matchCount             number of articles that matched
+ *@param unavailableShards      number of shard servers that failed or timed out
+ *@param trace                  trace of the request, if it is being traced
+ *
+ **/
+void CoordinatorHttpRequestHandler::search(const SearchTerms &words,
+                                           const SearchOptions &options, SearchResults &results,
+                                           shared_ptr<const DocumentStore> &documents,
+                                           size_t &matchCount, int &unavailableShards,
+                                           QueryTrace *trace)
+{
+    if (trace)
+        trace->setTerms(words);
+
+    string query = getShardQuery(words, options);
+
+    // Shard servers answer in parallel, so each one is parsed into its own arena
+    size_t shardCount = shardAddresses.size();
+    unique_ptr<RequestArena[]> shardArenas(new RequestArena[shardCount]);
+    vector<DocumentStore> shardDocuments(shardCount);
+    vector<SearchResults> shardResults;
+    shardResults.reserve(shardCount);
+    for (size_t i = 0; i < shardCount; i++)
+        shardResults.emplace_back(shardArenas[i].getResource());
+    vector<size_t> shardMatchCounts(shardCount, 0);
+    vector<char> shardAnswered(shardCount, false);
+    vector<function<void()>> searchTasks;
+
+    for (size_t i = 0; i < shardCount; i++)
+    {
+        searchTasks.push_back([&, i]() {
+            shardAnswered[i] = searchShardServer(shardAddresses[i], query, shardDocuments[i],
+                                                 shardResults[i], shardMatchCounts[i]);
+        });
+    }
+
+    {
+        // The shard servers do the lookup, so their whole round trip is the lookup stage
+        StageTimer lookupTimer(STAGE_INDEX_LOOKUP, trace);
+        searchPool.run(searchTasks);
+    }
+
+    documents = gatherDocuments(shardDocuments, shardResults);
+    mergeResults(shardResults, *documents, results, trace);
+
+    matchCount = 0;
+    unavailableShards = 0;
+    for (size_t i = 0; i < shardCount; i++)
+    {
+        matchCount += shardMatchCounts[i];
+        if (!shardAnswered[i])
+            unavailableShards++;
+    }
+
+    if (trace)
+        trace->candidatesScored += matchCount;
+}
+
+/**
+ *@brief Puts the documents returned by every shard server in a table of their own, for this
+ *       search only, and renumbers the results into it
+ *
+ *@param shardDocuments         documents returned by every shard server
+ *@param shardResults           results of every shard server, numbered in its shardDocuments
+ *
+ *@return shared_ptr            table the renumbered results refer to
+ **/
+shared_ptr<const DocumentStore> CoordinatorHttpRequestHandler::gatherDocuments(
+    const vector<DocumentStore> &shardDocuments, vector<SearchResults> &shardResults)
+{
+    auto documents = make_shared<DocumentStore>();
+
+    // Slices are disjoint, so the documents of a shard server follow those of the previous one
+    for (size_t i = 0; i < shardResults.size(); i++)
+    {
+        uint32_t firstDocument = (uint32_t)documents->getDocumentCount();
+        documents->append(shardDocuments[i]);
+        for (auto &result : shardResults[i])
+            result.first += firstDocument;
+    }
+
+    return documents;
+}
+
+/**
+ *@brief Asks one shard server for its best results
+ *
+ *@param address        "host:port" of the shard server
+ *@param query          URL of the internal search, already encoded
+ *@param documents      documents returned by the shard server
+ *@param results        results returned by the shard server, numbered in documents
+ *@param matchCount     number of matches reported by the shard server
+ *
+ *@return bool          true if the shard server answered in time with a valid list
+ **/
+bool CoordinatorHttpRequestHandler::searchShardServer(const string &address, const string &query,
+                                                      DocumentStore &documents,
+                                                      SearchResults &results,
+                                                      size_t &matchCount)
+{
+    // Addresses were validated by parseShardAddresses()
+    string host;
+    int port;
+    if (!splitShardAddress(address, host, port))
+        return false;
+
+    time_t seconds = shardTimeout / 1000;
+    time_t microseconds = (shardTimeout % 1000) * 1000;
+
+    httplib::Client client(host, port);
+    client.set_connection_timeout(seconds, microseconds);
+    client.set_read_timeout(seconds, microseconds);
+    client.set_write_timeout(seconds, microseconds);
+
+    auto response = client.Get(query);
+    if (!response || response->status != 200)
+    {
+        cerr << "Shard server " << address << " did not answer" << endl;
+        return false;
+    }
+
+    stringstream ss(response->body);
+    string line;
+    unsigned long shardMatchCount;
+
+    // An answer that cannot be parsed is left out, like one that did not arrive
+    if (!getline(ss, line) || !parseNumber(line.c_str(), shardMatchCount))
+    {
+        cerr << "Shard server " << address << " sent an invalid answer" << endl;
+        return false;
+    }
+
+    while (getline(ss, line))
+    {
+        size_t tab = line.find('\t');
+        size_t titleTab = line.find('\t', tab + 1);
+        if (tab == string::npos || titleTab == string::npos)
+            continue;
+
+        // Shard servers older than the static ranks send three columns
+        size_t rankTab = line.find('\t', titleTab + 1);
+        float score;
+        float staticRank = 0;
+        if (!parseScore(line.c_str(), score) ||
+            (rankTab != string::npos && !parseScore(line.c_str() + rankTab + 1, staticRank)))
+        {
+            cerr << "Shard server " << address << " sent an invalid answer" << endl;
+            results.clear();
+            return false;
+        }
+
+        string_view url = string_view(line).substr(tab + 1, titleTab - tab - 1);
+        string_view title = string_view(line).substr(titleTab + 1, rankTab - titleTab - 1);
+        results.emplace_back(documents.addDocument(url, title, 0, staticRank), score);
+    }
+
+    matchCount = shardMatchCount;
+
+    return true;
+}
+
+/**
+ *@brief Percent-encodes a searched word so that it survives as a single query argument
+ *
+ *@param word           word to encode
+ *
+ *@return string        encoded word
+ **/
+string CoordinatorHttpRequestHandler::encodeQueryWord(string_view word)
+{
+    const char *hexDigits = "0123456789ABCDEF";
+    string encodedWord;
+
+    for (unsigned char c : word)
+    {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+            encodedWord += (char)c;
+        else
+        {
+            encodedWord += '%';
+            encodedWord += hexDigits[c >> 4];
+            encodedWord += hexDigits[c & 0xf];
+        }
+    }
+
+    return encodedWord;
+}
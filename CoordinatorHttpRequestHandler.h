@@ -0,0 +1,55 @@
+/**
+ * @file CoordinatorHttpRequestHandler.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief EDAoogle coordinator: scatters searches to shard servers and gathers their results
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef COORDINATORHTTPREQUESTHANDLER_H
+#define COORDINATORHTTPREQUESTHANDLER_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "EDAoogleHttpRequestHandler.h"
+
+#define DEFAULT_SHARD_TIMEOUT_MS 500
+
+class CoordinatorHttpRequestHandler : public EDAoogleHttpRequestHandler
+{
+public:
+    CoordinatorHttpRequestHandler(std::string homePath, std::vector<std::string> shardAddresses,
+                                  int shardTimeout = DEFAULT_SHARD_TIMEOUT_MS);
+
+    static bool parseShardAddresses(const std::string &addressList,
+                                    std::vector<std::string> &addresses);
+    static std::string getShardQuery(const SearchTerms &words, const SearchOptions &options);
+
+protected:
+    void search(const SearchTerms &words, const SearchOptions &options, SearchResults &results,
+                std::shared_ptr<const DocumentStore> &documents, size_t &matchCount,
+                int &unavailableShards, QueryTrace *trace) override;
+
+private:
+    static bool splitShardAddress(const std::string &address, std::string &host, int &port);
+    static bool parseNumber(const char *text, unsigned long &value);
+    static bool parseScore(const char *text, float &value);
+
+    bool searchShardServer(const std::string &address, const std::string &query,
+                           DocumentStore &documents, SearchResults &results, size_t &matchCount);
+    std::shared_ptr<const DocumentStore> gatherDocuments(
+        const std::vector<DocumentStore> &shardDocuments,
+        std::vector<SearchResults> &shardResults);
+    static std::string encodeQueryWord(std::string_view word);
+
+    std::vector<std::string> shardAddresses;
+    int shardTimeout;
+};
+
+#endif
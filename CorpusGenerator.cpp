@@ -0,0 +1,492 @@
+/**
+ * @file CorpusGenerator.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Generates Wikipedia-like corpora of any size, modeled on the articles of a wiki
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * The wiki in www has about 1.3k articles, too few to show how indexing and searching scale.
+ * The generator first reads every article of a sample wiki and keeps:
+ *      - the frequency of every term, so generated text has the same term distribution
+ *      - the shape of every article: words, sections, paragraphs, links and html size
+ *      - the links between the articles, so that popular articles stay popular
+ *
+ * Every generated article is modeled on a random sample article: it takes its title (plus
+ * the article number, so names are unique) and its shape. Its words are drawn from the term
+ * frequencies of the whole sample, and its links point to other generated articles, chosen in
+ * proportion to the number of links the sample article they are modeled on receives, so the
+ * in-degrees are as skewed as the wiki's.
+ *
+ * Real articles are mostly markup (about 180 KB of html for 8k words in www), so a corpus of 1M
+ * articles as big as the real ones would take about 180 GB. Articles only carry the markup
+ * around their text unless markup padding is asked for, which fills every article up to the
+ * html size of its sample article with markup that has no text, for measuring parsing.
+ *
+ * A corpus larger than the sample has more distinct terms than the sample. Past the size of the
+ * sample, new terms are made up at the rate given by Heaps' law, V(n) = K * n^beta. Its slope at
+ * the size of the sample is estimated as the share of tokens that are terms seen only once
+ * (Good-Turing), which also gives beta = hapaxes / vocabulary.
+ *
+ * Articles only depend on the seed and their number, so a corpus is reproduced exactly
+ * whatever the number of threads.
+ *
+ * @cite Heaps - Information Retrieval: Computational and Theoretical Aspects (1978)
+ * @cite Good - The population frequencies of species and the estimation of population
+ *       parameters (Biometrika, 1953)
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <unordered_map>
+
+#include "CorpusGenerator.h"
+#include "HTMLParser.h"
+#include "Tokenizer.h"
+
+using namespace std;
+
+// Articles written by each generation task
+#define CORPUS_TASK_DOCUMENTS 1024
+// Mean words per sentence
+#define CORPUS_SENTENCE_WORDS 20
+
+static size_t countOccurrences(const string &text, const string &pattern)
+{
+    size_t count = 0;
+    for (size_t pos = text.find(pattern); pos != string::npos;
+         pos = text.find(pattern, pos + pattern.size()))
+        count++;
+
+    return count;
+}
+
+/**
+ *@brief Appends text to html, escaping the characters that have a meaning in html
+ **/
+static void appendEscaped(string &html, const string &text)
+{
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '&':
+            html += "&amp;";
+            break;
+        case '<':
+            html += "&lt;";
+            break;
+        case '>':
+            html += "&gt;";
+            break;
+        case '"':
+            html += "&quot;";
+            break;
+        default:
+            html += c;
+        }
+    }
+}
+
+/**
+ *@brief Appends a page name to a link, percent-encoding it as Wikipedia does
+ **/
+static void appendPercentEncoded(string &html, const string &pageName)
+{
+    const char *hexDigits = "0123456789ABCDEF";
+
+    for (unsigned char c : pageName)
+    {
+        if (isalnum(c) || c == '_' || c == '-' || c == '.' || c == '(' || c == ')' || c == ',')
+            html += (char)c;
+        else
+        {
+            html += '%';
+            html += hexDigits[c >> 4];
+            html += hexDigits[c & 0xf];
+        }
+    }
+}
+
+/**
+ *@brief class constructor
+ *
+ *@param seed           seed of the generated corpus
+ *@param padMarkup      if true, articles are padded up to the html size of their sample article
+ **/
+CorpusGenerator::CorpusGenerator(uint64_t seed, bool padMarkup)
+{
+    this->seed = seed;
+    this->padMarkup = padMarkup;
+    tokenCount = 0;
+    hapaxCount = 0;
+}
+
+/**
+ *@brief Reads the articles of a wiki and keeps their term frequencies, shapes and links
+ *
+ *@param homePath       folder with the wiki folder of the sample
+ *@param pool           threads the articles are read with
+ *
+ *@return bool          false if there are no articles to model the corpus on
+ **/
+bool CorpusGenerator::loadSample(const string &homePath, WorkStealingPool &pool)
+{
+    vector<filesystem::path> files;
+    error_code error;
+    for (const auto &file : filesystem::directory_iterator(filesystem::u8path(homePath + "/wiki"),
+                                                           error))
+    {
+        if (file.is_regular_file() && file.path().extension() == ".html")
+            files.push_back(file.path());
+    }
+
+    if (files.empty())
+        return false;
+
+    // Sorted, so that the same sample and seed always give the same corpus
+    sort(files.begin(), files.end());
+    unordered_map<string, uint32_t> pageNumbers;
+    for (uint32_t page = 0; page < files.size(); page++)
+        pageNumbers.emplace(files[page].filename().u8string(), page);
+
+    samplePages.assign(files.size(), SamplePage());
+
+    int taskCount = pool.getThreadCount();
+    vector<unordered_map<string, uint64_t>> taskWordCounts(taskCount);
+    vector<vector<uint32_t>> taskInLinkCounts(taskCount, vector<uint32_t>(files.size(), 0));
+    vector<function<void()>> sampleTasks;
+    for (int task = 0; task < taskCount; task++)
+    {
+        sampleTasks.push_back([&, task]() {
+            vector<string> tokens;
+            vector<string> pageNames;
+            vector<uint32_t> targets;
+
+            for (size_t page = task; page < files.size(); page += taskCount)
+            {
+                string htmlContent = HTMLParser::readHTMLFile(files[page].u8string());
+
+                tokens.clear();
+                Tokenizer::tokenize(HTMLParser::parseHTMLContent(htmlContent), tokens);
+                for (const auto &token : tokens)
+                    taskWordCounts[task][token]++;
+
+                // Only the links to other pages of the sample are part of its link structure;
+                // the rest point to articles the sample does not have. Like in LinkGraph, a
+                // page linked several times counts once.
+                HTMLParser::extractWikiLinks(htmlContent, pageNames);
+                targets.clear();
+                for (const auto &pageName : pageNames)
+                {
+                    auto target = pageNumbers.find(pageName);
+                    if (target != pageNumbers.end() && target->second != page)
+                        targets.push_back(target->second);
+                }
+                sort(targets.begin(), targets.end());
+                targets.erase(unique(targets.begin(), targets.end()), targets.end());
+                for (uint32_t target : targets)
+                    taskInLinkCounts[task][target]++;
+
+                SamplePage &samplePage = samplePages[page];
+                samplePage.name = files[page].stem().u8string();
+                samplePage.title = samplePage.name;
+                replace(samplePage.title.begin(), samplePage.title.end(), '_', ' ');
+                samplePage.wordCount = (uint32_t)tokens.size();
+                samplePage.sectionCount = (uint32_t)countOccurrences(htmlContent, "<h2");
+                samplePage.paragraphCount = (uint32_t)(countOccurrences(htmlContent, "<p>") +
+                                                       countOccurrences(htmlContent, "<p "));
+                samplePage.linkCount = (uint32_t)targets.size();
+                samplePage.htmlSize = htmlContent.size();
+            }
+        });
+    }
+
+    pool.run(sampleTasks);
+
+    unordered_map<string, uint64_t> wordCounts = move(taskWordCounts[0]);
+    for (int task = 1; task < taskCount; task++)
+    {
+        for (const auto &wordCount : taskWordCounts[task])
+            wordCounts[wordCount.first] += wordCount.second;
+        taskWordCounts[task] = unordered_map<string, uint64_t>();
+    }
+
+    for (uint32_t page = 0; page < files.size(); page++)
+    {
+        samplePages[page].inLinkCount = 0;
+        for (int task = 0; task < taskCount; task++)
+            samplePages[page].inLinkCount += taskInLinkCounts[task][page];
+    }
+
+    // Most frequent words first, so the search for a sampled word usually ends early
+    vector<pair<uint64_t, string>> sortedWords;
+    sortedWords.reserve(wordCounts.size());
+    for (auto &wordCount : wordCounts)
+        sortedWords.emplace_back(wordCount.second, wordCount.first);
+    wordCounts.clear();
+    sort(sortedWords.begin(), sortedWords.end(), [](const auto &a, const auto &b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    words.clear();
+    wordWeights.clear();
+    tokenCount = 0;
+    hapaxCount = 0;
+    for (auto &sortedWord : sortedWords)
+    {
+        tokenCount += sortedWord.first;
+        if (sortedWord.first == 1)
+            hapaxCount++;
+
+        words.push_back(move(sortedWord.second));
+        wordWeights.push_back(tokenCount);
+    }
+
+    if (tokenCount == 0)
+        return false;
+
+    fprintf(stdout, "Sample loaded (%zu articles, %zu words, %llu tokens)\n",
+            samplePages.size(), words.size(), (unsigned long long)tokenCount);
+
+    return true;
+}
+
+/**
+ *@brief Writes a corpus to outputPath/wiki, which must be empty or not exist
+ *
+ *@param outputPath     folder the wiki folder of the corpus is written to
+ *@param documentCount  number of articles
+ *@param pool           threads the articles are generated with
+ *
+ *@return int           number of articles written, -1 if the corpus was not generated
+ **/
+int CorpusGenerator::generate(const string &outputPath, uint32_t documentCount,
+                              WorkStealingPool &pool)
+{
+    if (samplePages.empty() || documentCount == 0)
+        return -1;
+
+    // Articles of an older corpus would be indexed along with the new ones
+    error_code error;
+    filesystem::path wikiPath = filesystem::u8path(outputPath + "/wiki");
+    if (filesystem::exists(wikiPath, error) && !filesystem::is_empty(wikiPath, error))
+    {
+        fprintf(stderr, "%s is not empty\n", wikiPath.u8string().c_str());
+        return -1;
+    }
+
+    filesystem::create_directories(wikiPath, error);
+    if (error)
+    {
+        fprintf(stderr, "Cannot create %s\n", wikiPath.u8string().c_str());
+        return -1;
+    }
+
+    // The sample article every article is modeled on, and how likely it is to be linked to
+    mt19937_64 random(seed);
+    uniform_int_distribution<uint32_t> pageDistribution(0, (uint32_t)samplePages.size() - 1);
+    vector<uint32_t> pages(documentCount);
+    vector<uint64_t> linkWeights(documentCount);
+    uint64_t linkWeight = 0;
+    for (uint32_t document = 0; document < documentCount; document++)
+    {
+        pages[document] = pageDistribution(random);
+        linkWeight += samplePages[pages[document]].inLinkCount + 1;
+        linkWeights[document] = linkWeight;
+    }
+
+    atomic<int> writtenCount(0);
+    vector<function<void()>> generateTasks;
+    for (uint32_t firstDocument = 0; firstDocument < documentCount;
+         firstDocument += CORPUS_TASK_DOCUMENTS)
+    {
+        generateTasks.push_back([&, firstDocument]() {
+            uint32_t lastDocument = min(documentCount, firstDocument + CORPUS_TASK_DOCUMENTS);
+            for (uint32_t document = firstDocument; document < lastDocument; document++)
+            {
+                string fileName = getPageName(document, pages) + ".html";
+                ofstream file(wikiPath / filesystem::u8path(fileName), ios::binary);
+                file << generatePage(document, pages, linkWeights);
+                if (file.good())
+                    writtenCount++;
+            }
+        });
+    }
+
+    pool.run(generateTasks);
+
+    return writtenCount;
+}
+
+size_t CorpusGenerator::getSampleSize()
+{
+    return samplePages.size();
+}
+
+size_t CorpusGenerator::getVocabularySize()
+{
+    return words.size();
+}
+
+uint64_t CorpusGenerator::getSampleTokenCount()
+{
+    return tokenCount;
+}
+
+/**
+ *@brief Generates the html of an article
+ *
+ *@param document       number of the article
+ *@param pages          sample article every article is modeled on
+ *@param linkWeights    cumulative weights of the articles as link targets
+ *
+ *@return string        html of the article
+ **/
+string CorpusGenerator::generatePage(uint32_t document, const vector<uint32_t> &pages,
+                                     const vector<uint64_t> &linkWeights)
+{
+    seed_seq pageSeed{(uint32_t)seed, (uint32_t)(seed >> 32), document};
+    mt19937_64 random(pageSeed);
+    uniform_int_distribution<uint64_t> wordDistribution(0, tokenCount - 1);
+    uniform_int_distribution<uint64_t> linkDistribution(0, linkWeights.back() - 1);
+    uniform_real_distribution<double> chance(0, 1);
+
+    const SamplePage &samplePage = samplePages[pages[document]];
+    double linkRate = samplePage.wordCount ?
+                          min(1.0, (double)samplePage.linkCount / samplePage.wordCount) : 0;
+    uint64_t meanWordCount = tokenCount / samplePages.size();
+    double newWordRate = getNewWordRate((uint64_t)document * meanWordCount);
+    uint32_t newWordCount = 0;
+
+    string html;
+    html.reserve(padMarkup ? samplePage.htmlSize + 1024 : (size_t)samplePage.wordCount * 12);
+
+    auto appendWord = [&]() {
+        html += sampleWord(wordDistribution(random));
+
+        // A made-up word: a sampled word followed by a suffix unique to this article
+        if (newWordRate > 0 && chance(random) < newWordRate)
+        {
+            for (uint64_t suffix = ((uint64_t)document << 32) | newWordCount++; suffix;
+                 suffix /= 26)
+                html += (char)('a' + suffix % 26);
+        }
+    };
+
+    html += "<!DOCTYPE html>\n<html>\n<head>\n    <meta charset=\"utf-8\" />\n    <title>";
+    appendEscaped(html, samplePage.title);
+    html += " - Wikipedia, la enciclopedia libre</title>\n"
+            "    <link rel=\"stylesheet\" href=\"../css/style.css\" />\n</head>\n\n<body>\n"
+            "<article>\n<div id=\"content\" class=\"mw-body\" role=\"main\">\n"
+            "\t<h1 id=\"firstHeading\" class=\"firstHeading mw-first-heading\">";
+    appendEscaped(html, samplePage.title);
+    html += "</h1>\n\t<div id=\"bodyContent\" class=\"vector-body\">\n";
+
+    // The lead section has no heading; paragraphs and words are spread evenly over sections
+    uint32_t paragraphCount = max(1u, samplePage.paragraphCount);
+    uint32_t sectionCount = samplePage.sectionCount + 1;
+    uint32_t section = 0;
+    for (uint32_t paragraph = 0; paragraph < paragraphCount; paragraph++)
+    {
+        for (; section < (uint64_t)paragraph * sectionCount / paragraphCount; section++)
+        {
+            html += "\t\t<h2><span class=\"mw-headline\">";
+            for (int word = 1 + random() % 3; word > 0; word--)
+            {
+                appendWord();
+                if (word > 1)
+                    html += ' ';
+            }
+            html += "</span></h2>\n";
+        }
+
+        html += "\t\t<p>";
+        uint32_t wordCount = (uint32_t)(((uint64_t)paragraph + 1) * samplePage.wordCount /
+                                            paragraphCount -
+                                        (uint64_t)paragraph * samplePage.wordCount /
+                                            paragraphCount);
+        for (uint32_t word = 0; word < wordCount; word++)
+        {
+            if (word > 0)
+                html += ' ';
+
+            uint32_t target = document;
+            if (chance(random) < linkRate)
+                target = (uint32_t)(upper_bound(linkWeights.begin(), linkWeights.end(),
+                                                linkDistribution(random)) -
+                                    linkWeights.begin());
+
+            if (target != document)
+            {
+                const string &title = samplePages[pages[target]].title;
+                html += "<a href=\"https://es.wikipedia.org/wiki/";
+                appendPercentEncoded(html, getPageName(target, pages));
+                html += "\" title=\"";
+                appendEscaped(html, title);
+                html += "\">";
+                appendEscaped(html, title);
+                html += "</a>";
+            }
+            else
+                appendWord();
+
+            if (chance(random) * CORPUS_SENTENCE_WORDS < 1)
+                html += '.';
+        }
+        html += ".</p>\n";
+    }
+
+    html += "\t</div>\n</div>\n</article>\n";
+
+    // Real articles are mostly markup (navigation, references), which parsing still has to skip
+    const string filler = "<div class=\"mw-references-wrap\"><span class=\"mw-cite-backlink\">"
+                          "</span></div>\n";
+    const string ending = "</body>\n</html>\n";
+    while (padMarkup && html.size() + filler.size() + ending.size() <= samplePage.htmlSize)
+        html += filler;
+    html += ending;
+
+    return html;
+}
+
+/**
+ *@brief Gets a word of the sample with the probability it has in the sample
+ *
+ *@param randomValue    uniform in [0, tokens of the sample)
+ **/
+const string &CorpusGenerator::sampleWord(uint64_t randomValue)
+{
+    return words[upper_bound(wordWeights.begin(), wordWeights.end(), randomValue) -
+                 wordWeights.begin()];
+}
+
+/**
+ *@brief Gets the page name of an article: the name of its sample article and its number
+ **/
+string CorpusGenerator::getPageName(uint32_t document, const vector<uint32_t> &pages)
+{
+    return samplePages[pages[document]].name + "_" + to_string(document);
+}
+
+/**
+ *@brief Gets the probability that a token is a term never seen before, following Heaps' law
+ *
+ *@param tokenPosition  number of tokens in the corpus before the token
+ **/
+double CorpusGenerator::getNewWordRate(uint64_t tokenPosition)
+{
+    // Up to the size of the sample, its own vocabulary is enough
+    if (hapaxCount == 0 || tokenPosition < tokenCount)
+        return 0;
+
+    double beta = (double)hapaxCount / words.size();
+    return (double)hapaxCount / tokenCount * pow((double)tokenPosition / tokenCount, beta - 1);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file CorpusGenerator.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Generates Wikipedia-like corpora of any size, modeled on the articles of a wiki
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef CORPUSGENERATOR_H
+#define CORPUSGENERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "WorkStealingPool.h"
+
+#define DEFAULT_CORPUS_SEED 1
+#define DEFAULT_CORPUS_SIZE 10000
+
+class CorpusGenerator
+{
+public:
+    CorpusGenerator(uint64_t seed = DEFAULT_CORPUS_SEED, bool padMarkup = false);
+
+    bool loadSample(const std::string &homePath, WorkStealingPool &pool);
+    int generate(const std::string &outputPath, uint32_t documentCount, WorkStealingPool &pool);
+
+    size_t getSampleSize();
+    size_t getVocabularySize();
+    uint64_t getSampleTokenCount();
+
+private:
+    // What a generated article takes from the sample article it is modeled on
+    struct SamplePage
+    {
+        std::string name;
+        std::string title;
+        uint32_t wordCount;
+        uint32_t sectionCount;
+        uint32_t paragraphCount;
+        uint32_t linkCount;
+        uint32_t inLinkCount;
+        size_t htmlSize;
+    };
+
+    std::string generatePage(uint32_t document, const std::vector<uint32_t> &samplePages,
+                             const std::vector<uint64_t> &linkWeights);
+    const std::string &sampleWord(uint64_t randomValue);
+    std::string getPageName(uint32_t document, const std::vector<uint32_t> &samplePages);
+    double getNewWordRate(uint64_t tokenPosition);
+
+    uint64_t seed;
+    bool padMarkup;
+
+    std::vector<SamplePage> samplePages;
+
+    // Vocabulary of the sample and its cumulative token counts, to sample words by frequency
+    std::vector<std::string> words;
+    std::vector<uint64_t> wordWeights;
+    uint64_t tokenCount;
+    uint64_t hapaxCount;
+};
+
+#endif
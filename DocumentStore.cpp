@@ -0,0 +1,120 @@
+/**
+ * @file DocumentStore.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Columnar table with what the results page shows of every document
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Searching only moves document numbers around; the table is read when the final page is
+ * rendered. Every column is a flat array indexed by document number, and the strings of a
+ * column are packed back to back in a single buffer.
+ *
+ */
+
+#include <filesystem>
+
+#include "DocumentStore.h"
+
+using namespace std;
+
+/**
+ *@brief class constructor. The table starts empty.
+ **/
+DocumentStore::DocumentStore()
+{
+    urlOffsets.push_back(0);
+    titleOffsets.push_back(0);
+}
+
+/**
+ *@brief Adds a document at the end of the table
+ *
+ *@param url            link to the document, as served by the http server
+ *@param title          text of the link
+ *@param length         number of terms in the document
+ *@param staticRank     query-independent importance of the document
+ *
+ *@return uint32_t      document number
+ **/
+uint32_t DocumentStore::addDocument(string_view url, string_view title, uint32_t length,
+                                    float staticRank)
+{
+    urls += url;
+    urlOffsets.push_back((uint32_t)urls.size());
+    titles += title;
+    titleOffsets.push_back((uint32_t)titles.size());
+    lengths.push_back(length);
+    staticRanks.push_back(staticRank);
+
+    return (uint32_t)lengths.size() - 1;
+}
+
+/**
+ *@brief Adds every document of another table; document d of it becomes getDocumentCount() + d
+ **/
+void DocumentStore::append(const DocumentStore &other)
+{
+    for (uint32_t document = 0; document < other.getDocumentCount(); document++)
+        addDocument(other.getUrl(document), other.getTitle(document), other.getLength(document),
+                    other.getStaticRank(document));
+}
+
+size_t DocumentStore::getDocumentCount() const
+{
+    return lengths.size();
+}
+
+/**
+ *@brief Gets the memory taken by the table, in bytes
+ **/
+size_t DocumentStore::getMemoryUsage() const
+{
+    return urls.capacity() + titles.capacity() +
+           (urlOffsets.capacity() + titleOffsets.capacity() + lengths.capacity()) *
+               sizeof(uint32_t) +
+           staticRanks.capacity() * sizeof(float);
+}
+
+string_view DocumentStore::getUrl(uint32_t document) const
+{
+    return string_view(urls).substr(urlOffsets[document],
+                                    urlOffsets[document + 1] - urlOffsets[document]);
+}
+
+string_view DocumentStore::getTitle(uint32_t document) const
+{
+    return string_view(titles).substr(titleOffsets[document],
+                                      titleOffsets[document + 1] - titleOffsets[document]);
+}
+
+uint32_t DocumentStore::getLength(uint32_t document) const
+{
+    return lengths[document];
+}
+
+float DocumentStore::getStaticRank(uint32_t document) const
+{
+    return staticRanks[document];
+}
+
+void DocumentStore::setStaticRank(uint32_t document, float staticRank)
+{
+    staticRanks[document] = staticRank;
+}
+
+/**
+ *@brief Gets the link and the title of an article from the path of its html file, e.g.
+ *       "../www/wiki/Agua.html" is served as "/wiki/Agua.html" and titled "Agua"
+ *
+ *@param filePath       path to the html file, on any platform
+ *@param url            link to the article
+ *@param title          title of the article
+ **/
+void DocumentStore::getUrlAndTitle(const string &filePath, string &url, string &title)
+{
+    filesystem::path path = filesystem::u8path(filePath);
+
+    url = "/wiki/" + path.filename().u8string();
+    title = path.stem().u8string();
+}
@@ -0,0 +1,48 @@
+/**
+ * @file DocumentStore.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Columnar table with what the results page shows of every document
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef DOCUMENTSTORE_H
+#define DOCUMENTSTORE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class DocumentStore
+{
+public:
+    DocumentStore();
+
+    uint32_t addDocument(std::string_view url, std::string_view title, uint32_t length,
+                         float staticRank = 0);
+    void append(const DocumentStore &other);
+
+    size_t getDocumentCount() const;
+    size_t getMemoryUsage() const;
+    std::string_view getUrl(uint32_t document) const;
+    std::string_view getTitle(uint32_t document) const;
+    uint32_t getLength(uint32_t document) const;
+    float getStaticRank(uint32_t document) const;
+    void setStaticRank(uint32_t document, float staticRank);
+
+    static void getUrlAndTitle(const std::string &filePath, std::string &url, std::string &title);
+
+private:
+    // The url of document d is urls[urlOffsets[d], urlOffsets[d + 1]), titles likewise
+    std::string urls;
+    std::vector<uint32_t> urlOffsets;
+    std::string titles;
+    std::vector<uint32_t> titleOffsets;
+    std::vector<uint32_t> lengths;
+    std::vector<float> staticRanks;
+};
+
+#endif
@@ -15,6 +15,22 @@
  * you desire to search them separately. Example:
  *      "botella queso": will search for occurences of "botella queso" (not modifying the search string)
  *      "botella+queso": will search for occurences of both "botella" and "queso"
+ * An article matches if it contains any of the words. Adding &match=all to the URL only matches
+ * the articles that contain every word, which is also much cheaper (see QueryPlanner):
+ *      /search?q=botella+queso&match=all
+ * Results can also be restricted to the articles with some attributes (see IndexShard): their
+ * length, the initial of their title or a category:
+ *      /search?q=agua&len=long
+ *      /search?q=agua&initial=a&cat=Bebidas
+ *
+ * POST /admin/memory reports the memory taken by every component of the index. With a memory
+ * budget (--memory-budget) the SQLite page caches are capped first, and if the index alone
+ * still does not fit, the in-memory indexes of the least recently searched shards are shed:
+ * searches on those shards scan their articles like phrase searches, a few shards at a time
+ * (MAX_SHED_INDEX_SEARCHES). A new generation is loaded within the budget next to the one
+ * being served, which gives up its indexes first. The budget is checked again every
+ * MEMORY_CHECK_INTERVAL seconds, when the shed indexes that fit again are reloaded, the most
+ * recently searched first.
  * 
  * This module is in charge of handling the searches requested in the database created in its 
  * constructor. If the constructor existed already, then it will not create the database.
@@ -22,84 +38,312 @@
  */
 
 #include "EDAoogleHttpRequestHandler.h"
+#include "Analyzer.h"
+#include "HTMLTemplate.h"
+#include "Metrics.h"
 
-/*Callback Prototypes*/
+#ifdef __linux__
+#include <unistd.h>
+#endif
 
-int termFreqCallback(void *data, int argc, char **argv, char **columnNames);
-bool compareByTermFrequency(const pair<string, float> &a, const pair<string, float> &b);
+/* SEARCH PAGE TEMPLATES */
+
+static const HTMLTemplate searchPageHeader("<!DOCTYPE html>\
+<html>\
+\
+<head>\
+    <meta charset=\"utf-8\" />\
+    <title>EDAoogle</title>\
+    <link rel=\"preload\" href=\"https://fonts.googleapis.com\" />\
+    <link rel=\"preload\" href=\"https://fonts.gstatic.com\" crossorigin />\
+    <link href=\"https://fonts.googleapis.com/css2?family=Inter:wght@400;800&display=swap\"\
+    rel=\"stylesheet\" />\
+    <link rel=\"preload\" href=\"../css/style.css\" />\
+    <link rel=\"stylesheet\" href=\"../css/style.css\" />\
+</head>\
+\
+<body>\
+    <article class=\"edaoogle\">\
+        <div class=\"title\"><a href=\"/\">EDAoogle</a></div>\
+        <div class=\"search\">\
+            <form action=\"/search\" method=\"get\">\
+                <input type=\"text\" name=\"q\" value=\"{{query}}\" autofocus>\
+            </form>\
+        </div>\
+        ", {"query"});
+
+static const HTMLTemplate resultCountRow(
+    "<div class=\"results\">{{count}} results ({{time}} seconds):</div>", {"count", "time"});
+
+static const HTMLTemplate partialResultsRow(
+    "<div class=\"results\">Partial results: {{shards}} shard(s) did not answer in time</div>",
+    {"shards"});
+
+static const HTMLTemplate resultRow(
+    "<div class=\"result\"><a href=\"{{href}}\">{{title}}</a></div>", {"href", "title"});
+
+static const HTMLTemplate searchPageTrailer("    </article>\
+</body>\
+</html>");
 
 /**
- *@brief class constructor
+ *@brief class constructor. If the index folder holds a verified artifact (see IndexBuilder) it is
+ *       loaded as it is. Otherwise the shards that do not exist yet (or were written with an
+ *       older schema) are built in parallel and the rest are reused.
  *
- *@param homePath path to the folder with the html files
+ *@param homePath       path to the folder with the html files
+ *@param shardCount     number of document shards the index is split into (0 for a handler
+ *                      without a local index, such as a coordinator)
+ *@param sliceIndex     slice of the corpus served by this process in a distributed index
+ *@param sliceCount     number of slices the corpus is split into (1 to serve all of it)
+ *@param indexPath      folder the shard files are kept in
+ *@param memoryBudget   bytes the index and the SQLite caches may take, 0 for no limit
  **/
-EDAoogleHttpRequestHandler::EDAoogleHttpRequestHandler(string homePath) : 
-ServeHttpRequestHandler(homePath)
+EDAoogleHttpRequestHandler::EDAoogleHttpRequestHandler(string homePath, int shardCount,
+                                                       int sliceIndex, int sliceCount,
+                                                       string indexPath, size_t memoryBudget) :
+ServeHttpRequestHandler(homePath), searchPool(thread::hardware_concurrency()),
+indexBuilder(homePath, indexPath, (shardCount < 0) ? DEFAULT_SHARD_COUNT : shardCount, sliceIndex,
+             sliceCount),
+memoryBudget(memoryBudget), loadingMemory(0), isOverBudget(false), shedSearchCount(0),
+rebuilding(false), stopping(false)
 {
-    if (filesystem::exists(PATH_CORRECTION DB_NAME))
+    slowQueryLog = nullptr;
+
+    // A damaged artifact is not trusted: a new generation is built from the html files
+    uint64_t generation = indexBuilder.getLatestGeneration();
+    bool hasArtifact = indexBuilder.hasManifest();
+    bool rebuildAll = false;
+    if (hasArtifact && !indexBuilder.verifyManifest(generation))
     {
-        return;
+        cerr << "The index artifact failed verification, the index will be rebuilt" << endl;
+        generation = indexBuilder.getLatestGeneration() + 1;
+        hasArtifact = false;
+        rebuildAll = true;
     }
 
-    /* Create SQL statement and requirements */
-    char *zErrMsg = 0;
-    int rc;
-    char *sql;
+    shared_ptr<IndexSnapshot> newSnapshot;
+    if (buildSnapshot(generation, rebuildAll, searchPool, newSnapshot) && !hasArtifact &&
+        indexBuilder.getShardCount() > 0)
+        indexBuilder.writeManifest(generation);
+    snapshot = newSnapshot;
+    loadingMemory = 0;
 
-    sqlite3 *db;
-    sqlite3_open(PATH_CORRECTION DB_NAME, &db);
+    // Leftovers of other generations, e.g. from a rebuild that was interrupted
+    for (auto &shardFile : indexBuilder.getShardFiles())
+    {
+        if (shardFile.first != generation)
+        {
+            error_code error;
+            filesystem::remove(shardFile.second, error);
+        }
+    }
 
-    sql = "CREATE TABLE ARTICLES("
-          "BODY            TEXT     NOT NULL,"
-          "PATH        CHAR(50),"
-          "WORDC          INT);";
+    Metrics::setGauge("edaoogle_search_pool_queue_depth", "Search tasks waiting for a thread",
+                      [this]() { return (double)searchPool.getQueueDepth(); });
+    Metrics::setGauge("edaoogle_index_generation", "Generation of the index being served",
+                      [this]() { return (double)atomic_load(&snapshot)->getGeneration(); });
+    Metrics::setGauge("edaoogle_index_rebuilding", "1 while a background rebuild is running",
+                      [this]() { return rebuilding ? 1.0 : 0.0; });
+    Metrics::setGauge("edaoogle_memory_index_bytes", "Memory taken by the in-memory index",
+                      [this]() {
+                          return (double)getMemoryUsage(*atomic_load(&snapshot)).getIndexTotal();
+                      });
+    Metrics::setGauge("edaoogle_memory_sqlite_bytes", "Heap taken by SQLite",
+                      []() { return (double)sqlite3_memory_used(); });
+    Metrics::setGauge("edaoogle_memory_budget_bytes", "Memory budget, 0 if there is none",
+                      [this]() { return (double)this->memoryBudget; });
+
+    if (memoryBudget && indexBuilder.getShardCount() > 0)
+    {
+        enforceMemoryBudget();
+        memoryThread = thread(&EDAoogleHttpRequestHandler::watchMemory, this);
+    }
+}
 
-    /* Execute SQL statement */
-    rc = sqlite3_exec(db, sql, nullptr, 0, &zErrMsg);
+EDAoogleHttpRequestHandler::~EDAoogleHttpRequestHandler()
+{
+    Metrics::setGauge("edaoogle_search_pool_queue_depth", "Search tasks waiting for a thread",
+                      []() { return 0.0; });
+    Metrics::setGauge("edaoogle_index_generation", "Generation of the index being served",
+                      []() { return 0.0; });
+    Metrics::setGauge("edaoogle_index_rebuilding", "1 while a background rebuild is running",
+                      []() { return 0.0; });
+    Metrics::setGauge("edaoogle_memory_index_bytes", "Memory taken by the in-memory index",
+                      []() { return 0.0; });
+    Metrics::setGauge("edaoogle_memory_sqlite_bytes", "Heap taken by SQLite",
+                      []() { return 0.0; });
+    Metrics::setGauge("edaoogle_memory_budget_bytes", "Memory budget, 0 if there is none",
+                      []() { return 0.0; });
+
+    // A rebuild in progress gives up at the next file
+    stopping = true;
+    if (rebuildThread.joinable())
+        rebuildThread.join();
 
-    if (rc != SQLITE_OK)
     {
-        fprintf(stderr, "SQL error: %s\n", zErrMsg);
-        sqlite3_free(zErrMsg);
+        // The watcher is either waiting, and wakes up, or sees stopping before it waits again
+        lock_guard<mutex> lock(memoryMutex);
     }
-    else
+    memoryCondition.notify_all();
+    if (memoryThread.joinable())
+        memoryThread.join();
+}
+
+/**
+ *@brief Enables the slow query log
+ *
+ *@param slowQueryLog   log the slow searches are written to, nullptr to disable it
+ **/
+void EDAoogleHttpRequestHandler::setSlowQueryLog(SlowQueryLog *slowQueryLog)
+{
+    this->slowQueryLog = slowQueryLog;
+}
+
+/**
+ *@brief Publishes a new generation of the index: the artifact in the index folder if it is
+ *       newer than the one being served (e.g. copied there from edaindex), otherwise one built
+ *       here from the html files. Searches keep using the current generation until the new one
+ *       is complete; the current one is deleted when the searches that hold it end.
+ *
+ *@return bool          true if the new generation is being served
+ **/
+bool EDAoogleHttpRequestHandler::rebuildIndex()
+{
+    if (indexBuilder.getShardCount() == 0)
+        return false;
+
+    // One rebuild at a time, whether it was started by a signal, the admin page or a caller
+    lock_guard<mutex> lock(rebuildMutex);
+
+    shared_ptr<const IndexSnapshot> currentSnapshot = atomic_load(&snapshot);
+    uint64_t generation = 0;
+    bool isArtifactNewer = indexBuilder.hasManifest() && indexBuilder.verifyManifest(generation) &&
+                           generation > currentSnapshot->getGeneration();
+    if (!isArtifactNewer)
+        generation = max(currentSnapshot->getGeneration(), indexBuilder.getLatestGeneration()) + 1;
+
+    // The search workers are left alone, so the build only uses half of the cores
+    WorkStealingPool buildPool(max(1, (int)thread::hardware_concurrency() / 2));
+    shared_ptr<IndexSnapshot> newSnapshot;
+    if (!buildSnapshot(generation, !isArtifactNewer, buildPool, newSnapshot) ||
+        (!isArtifactNewer && !indexBuilder.writeManifest(generation)))
     {
-        fprintf(stdout, "Table created successfully\n");
+        cerr << "Index generation " << generation << " was not built, generation "
+             << currentSnapshot->getGeneration() << " is still served" << endl;
+        if (!isArtifactNewer)
+            newSnapshot->retire();
+
+        lock_guard<mutex> lock(memoryMutex);
+        loadingMemory = 0;
+        return false;
     }
 
-    /* Iterate through all files in /wiki folder */
-    filesystem::path folderPath = homePath + "/wiki";
-    filesystem::directory_iterator fileIterator(folderPath);
-    for (const auto &file : fileIterator)
     {
-        if (file.is_regular_file())
-        {
-            wstring_convert<codecvt_utf8_utf16<wchar_t>> converter;
-            wstring wfilePath = converter.from_bytes(file.path().u8string());
-            string htmlContent = readHTMLFile(wfilePath);
-            string htmlCleanedContent = parseHTMLContent(htmlContent);
-            string correctedPath; // character ' in file names was conflictive with SQL
-
-            string sqlstring = "INSERT INTO ARTICLES (BODY, PATH, WORDC)";
-            sqlstring += " VALUES ('";
-            sqlstring += htmlCleanedContent;
-            sqlstring += "', '";
-            correctedPath = addCharacterNextTo(file.path().u8string(), '\'', '\'');
-            sqlstring += correctedPath;
-            sqlstring += "', '";
-            sqlstring += to_string(countSpaceCharacters(htmlCleanedContent));
-            sqlstring += "');";
-
-            sql = sqlstring.data();
-            rc = sqlite3_exec(db, sql, nullptr, 0, &zErrMsg);
-
-            if (rc != SQLITE_OK)
-            {
-                fprintf(stderr, "SQL error: %s\n", zErrMsg);
-                sqlite3_free(zErrMsg);
-            }
-        }
+        // The new generation was loaded within the budget, next to the current one
+        lock_guard<mutex> lock(memoryMutex);
+        atomic_store(&snapshot, shared_ptr<const IndexSnapshot>(newSnapshot));
+        loadingMemory = 0;
+    }
+    currentSnapshot->retire();
+    // Indexes the current generation gave up while the new one loaded can be reloaded now
+    enforceMemoryBudget();
+
+    fprintf(stdout, "Index generation %llu published (%zu articles)\n",
+            (unsigned long long)generation, newSnapshot->getDocuments().getDocumentCount());
+
+    return true;
+}
+
+/**
+ *@brief Starts rebuildIndex() in the background. Never blocks.
+ *
+ *@return bool          false if there is no local index or a rebuild is already running
+ **/
+bool EDAoogleHttpRequestHandler::requestRebuild()
+{
+    bool wasRebuilding = false;
+    if (indexBuilder.getShardCount() == 0 ||
+        !rebuilding.compare_exchange_strong(wasRebuilding, true))
+        return false;
+
+    // The previous rebuild has finished, since rebuilding was false
+    if (rebuildThread.joinable())
+        rebuildThread.join();
+
+    rebuildThread = thread([this]() {
+        rebuildIndex();
+        rebuilding = false;
+    });
+
+    return true;
+}
+
+/**
+ *@brief Builds or loads every shard of a generation in parallel
+ *
+ *@param generation     generation to build
+ *@param rebuildAll     true to build every shard, false to load the shards already built
+ *@param pool           threads the shards are built with
+ *@param newSnapshot    snapshot of the generation, even if some shards failed
+ *
+ *@return bool          true if every shard was built or loaded
+ **/
+bool EDAoogleHttpRequestHandler::buildSnapshot(uint64_t generation, bool rebuildAll,
+                                               WorkStealingPool &pool,
+                                               shared_ptr<IndexSnapshot> &newSnapshot)
+{
+    int shardCount = indexBuilder.getShardCount();
+    vector<unique_ptr<IndexShard>> newShards;
+    for (int i = 0; i < shardCount; i++)
+        newShards.push_back(make_unique<IndexShard>(indexBuilder.getShardPath(i, generation)));
+
+    // The shards of a new generation are as hot as the ones they replace, and their indexes
+    // about as large
+    shared_ptr<const IndexSnapshot> currentSnapshot = atomic_load(&snapshot);
+    bool isSameLayout = currentSnapshot && currentSnapshot->getShardCount() == (size_t)shardCount;
+    for (int i = 0; i < shardCount && isSameLayout; i++)
+        newShards[i]->setLastSearchTime(currentSnapshot->getShard(i).getLastSearchTime());
+
+    bool isBuildNeeded = rebuildAll;
+    for (int i = 0; i < shardCount && !isBuildNeeded; i++)
+        isBuildNeeded = !newShards[i]->isBuilt();
+
+    // Shards built without static ranks would still work, but rank ties arbitrarily
+    if (isBuildNeeded && !indexBuilder.computeStaticRanks(pool, &stopping))
+        cerr << "Static ranks were not computed" << endl;
+    if (isBuildNeeded && !indexBuilder.findDuplicates(pool, &stopping))
+        cerr << "Near-duplicates were not collapsed" << endl;
+
+    vector<char> isReady(shardCount, false);
+    vector<function<void()>> loadTasks;
+    for (int i = 0; i < shardCount; i++)
+    {
+        loadTasks.push_back([&, i]() {
+            bool isBuilt = !rebuildAll && newShards[i]->isBuilt();
+            if (!isBuilt && indexBuilder.buildShard(*newShards[i], i, &stopping) < 0)
+                return;
+
+            // The index is only loaded if it fits the memory budget next to what is loaded
+            size_t indexMemory = isSameLayout ? currentSnapshot->getShard(i).getIndexMemory()
+                                              : newShards[i]->getIndexMemory();
+            bool withIndex = reserveIndexMemory(indexMemory);
+            isReady[i] = newShards[i]->loadIndex(withIndex);
+            releaseIndexMemory(withIndex ? indexMemory : 0, *newShards[i]);
+
+            if (!isReady[i] && isBuilt)
+                cerr << "Shard " << i << " will be searched without its index" << endl;
+            else if (isReady[i] && !withIndex)
+                fprintf(stdout, "Shard %d loaded without its index to stay within the memory "
+                                "budget\n", i);
+        });
     }
+
+    pool.run(loadTasks);
+
+    newSnapshot = make_shared<IndexSnapshot>(generation, move(newShards));
+
+    return find(isReady.begin(), isReady.end(), false) == isReady.end();
 }
 
 /**
@@ -116,81 +360,57 @@ bool EDAoogleHttpRequestHandler::handleRequest(string url,
                                                vector<char> &response)
 {
     string searchPage = "/search";
-    if (url.substr(0, searchPage.size()) == searchPage)
+    string shardSearchPage = "/shard/search";
+    if (url == shardSearchPage)
     {
+        serveShardSearch(arguments, response);
+        return true;
+    }
+    else if (url.substr(0, searchPage.size()) == searchPage)
+    {
+        Metrics::addToCounter(COUNTER_SEARCH_REQUESTS);
+
         string searchString;
         if (arguments.find("q") != arguments.end())
             searchString = arguments["q"];
 
-        // Header
-        string responseString = string("<!DOCTYPE html>\
-<html>\
-\
-<head>\
-    <meta charset=\"utf-8\" />\
-    <title>EDAoogle</title>\
-    <link rel=\"preload\" href=\"https://fonts.googleapis.com\" />\
-    <link rel=\"preload\" href=\"https://fonts.gstatic.com\" crossorigin />\
-    <link href=\"https://fonts.googleapis.com/css2?family=Inter:wght@400;800&display=swap\"\
-    rel=\"stylesheet\" />\
-    <link rel=\"preload\" href=\"../css/style.css\" />\
-    <link rel=\"stylesheet\" href=\"../css/style.css\" />\
-</head>\
-\
-<body>\
-    <article class=\"edaoogle\">\
-        <div class=\"title\"><a href=\"/\">EDAoogle</a></div>\
-        <div class=\"search\">\
-            <form action=\"/search\" method=\"get\">\
-                <input type=\"text\" name=\"q\" value=\"" +
-                                       searchString + "\" autofocus>\
-            </form>\
-        </div>\
-        ");
-        chrono::time_point<chrono::system_clock> start, end; // time point y system clocks
-        start = chrono::system_clock::now();
+        chrono::time_point<chrono::steady_clock> start, end; // monotonic time points
+        start = chrono::steady_clock::now();
 
         float searchTime;
-        vector<string> separatedStringSearch = splitStringByAddSymbol(searchString);
-        vector<pair<string, float>> termFrequencies;
-        vector<string> results;
-
-        for (const auto &word : separatedStringSearch)
-        {
-            string rectifiedWord = addCharacterNextTo(word, '\'', '\'');
-            calculateTermFrequency(rectifiedWord, termFrequencies);
-        }
-
-        sort(termFrequencies.begin(), termFrequencies.end(), compareByTermFrequency);
-
-        for (const auto &pair : termFrequencies)
-        {
-            string path = pair.first.substr(EXTRA_CHARACTERS_IN_PATH); // Corrected path
-            results.push_back(path);
-        }
-
-        end = chrono::system_clock::now();
+        QueryTrace trace;
+        // Everything the search allocates is released at once when the request ends
+        RequestArena arena;
+        StageTimer normalizationTimer(STAGE_QUERY_NORMALIZATION, &trace);
+        SearchTerms separatedStringSearch = splitStringByAddSymbol(searchString,
+                                                                   arena.getResource());
+        normalizationTimer.stop();
+        SearchOptions options = getSearchOptions(arguments);
+        SearchResults termFrequencies(arena.getResource());
+        shared_ptr<const DocumentStore> documents;
+        size_t matchCount = 0;
+        int unavailableShards = 0;
+
+        coalescedSearch(separatedStringSearch, options, termFrequencies, documents, matchCount,
+                        unavailableShards, &trace);
+
+        end = chrono::steady_clock::now();
 
         chrono::duration<double> duration = end - start;
         searchTime = (float)duration.count();
 
-        // Print search results
-        responseString += "<div class=\"results\">" + to_string(results.size()) +
-                          " results (" + to_string(searchTime) + " seconds):</div>";
-        for (auto &result : results)
-        {
-            string cleanedString = result.substr(5, result.length() - 10);
-            responseString += "<div class=\"result\"><a href=\"" +
-                              result + "\">" + cleanedString + "</a></div>";
-        }
+        ArenaString responseString(arena.getResource());
+        renderSearchPage(searchString, termFrequencies, *documents, matchCount, searchTime,
+                         unavailableShards, responseString, &trace);
 
+        response.assign(responseString.begin(), responseString.end());
 
-        // Trailer
-        responseString += "    </article>\
-</body>\
-</html>";
+        trace.resultCount = termFrequencies.size();
+        trace.totalTime = chrono::duration_cast<chrono::nanoseconds>(
+                              chrono::steady_clock::now() - start).count();
+        if (slowQueryLog && slowQueryLog->isSlow(trace.totalTime))
+            slowQueryLog->log(trace);
 
-        response.assign(responseString.begin(), responseString.end());
         return true;
     }
     else
@@ -199,215 +419,655 @@ bool EDAoogleHttpRequestHandler::handleRequest(string url,
     return false;
 }
 
+/**
+ *@brief Searches are answered by the search workers, static files by the server thread
+ *
+ *@param url            Cleaned url
+ *
+ *@return bool          true for the search pages
+ **/
+bool EDAoogleHttpRequestHandler::isAsynchronous(const string &url)
+{
+    return url.compare(0, 7, "/search") == 0 || url == "/shard/search";
+}
 
+/**
+ *@brief Admin actions, which the server only takes as POST requests from the loopback
+ *       interface: POST /admin/rebuild starts a background rebuild of the index and
+ *       POST /admin/memory reports the memory the index takes
+ *
+ *@param url            Cleaned url
+ *@param response       status of the action
+ *
+ *@return bool          true if the action exists
+ **/
+bool EDAoogleHttpRequestHandler::handleAdminRequest(const string &url, vector<char> &response)
+{
+    if (url == "/admin/memory")
+    {
+        serveMemoryStatus(response);
+        return true;
+    }
 
-/*________________________________________________________________________________________________
-
-                                AUXILIAR FUNCTIONS AND METHODS
-__________________________________________________________________________________________________*/
+    if (url != "/admin/rebuild")
+        return false;
 
+    string status = requestRebuild() ? "Rebuild started\n" : "Rebuild not started: no local "
+                                                              "index or already running\n";
+    response.assign(status.begin(), status.end());
 
-/* FREQUENCY CALCULATOR */
+    return true;
+}
 
 /**
- *@brief Calculate the term frequency of a given word
+ *@brief Renders the results page of a search
  *
- *@param word                   searched word
- *@param termFrequencies        vector of pairs: path vs term frequency for that register
+ *@param searchString           search string as typed by the user
+ *@param results                sorted results: document vs term frequency
+ *@param documents              table the document numbers of the results refer to
+ *@param matchCount             number of articles that matched the search
+ *@param searchTime             time spent searching, in seconds
+ *@param unavailableShards      number of shards whose results are missing
+ *@param responseString         rendered html page
+ *@param trace                  trace of the request, if it is being traced
  *
  **/
-void EDAoogleHttpRequestHandler::calculateTermFrequency(const string &word, vector<pair<string, 
-                                                        float>> &termFrequencies)
+void EDAoogleHttpRequestHandler::renderSearchPage(const string &searchString,
+                                                  const SearchResults &results,
+                                                  const DocumentStore &documents,
+                                                  size_t matchCount, float searchTime,
+                                                  int unavailableShards,
+                                                  ArenaString &responseString, QueryTrace *trace)
 {
-    sqlite3 *database;
-    int result = sqlite3_open(PATH_CORRECTION DB_NAME, &database);
+    StageTimer renderingTimer(STAGE_RENDERING, trace);
+
+    // The escaped text is almost always as long as the raw text, so the page fits in one buffer
+    size_t pageSize = searchPageHeader.getStaticSize() + searchString.size() +
+                      resultCountRow.getStaticSize() + partialResultsRow.getStaticSize() + 64 +
+                      searchPageTrailer.getStaticSize();
+    for (const auto &result : results)
+        pageSize += resultRow.getStaticSize() + documents.getUrl(result.first).size() +
+                    documents.getTitle(result.first).size();
+    responseString.clear();
+    responseString.reserve(pageSize);
+
+    searchPageHeader.render(responseString, {searchString});
+
+    char count[32];
+    char time[32];
+    snprintf(count, sizeof(count), "%zu", matchCount);
+    snprintf(time, sizeof(time), "%f", searchTime);
+    resultCountRow.render(responseString, {count, time});
+
+    if (unavailableShards > 0)
+    {
+        snprintf(count, sizeof(count), "%d", unavailableShards);
+        partialResultsRow.render(responseString, {count});
+    }
+
+    for (const auto &result : results)
+        resultRow.render(responseString,
+                         {documents.getUrl(result.first), documents.getTitle(result.first)});
+
+    searchPageTrailer.render(responseString);
+}
 
-    if (result != SQLITE_OK)
+/**
+ *@brief Searches the local shards in parallel and merges their best results
+ *
+ *@param words                  searched words, as typed by the user
+ *@param options                how the words are combined
+ *@param results                best MAX_SEARCH_RESULTS results: document vs term frequency,
+ *                              sorted
+ *@param documents              table the document numbers of the results refer to. It stays
+ *                              valid while it is held, even if the index is rebuilt.
+ *@param matchCount             number of articles that matched
+ *@param unavailableShards      number of shards that could not be searched
+ *@param trace                  trace of the request, if it is being traced
+ *
+ **/
+void EDAoogleHttpRequestHandler::search(const SearchTerms &words, const SearchOptions &options,
+                                        SearchResults &results,
+                                        shared_ptr<const DocumentStore> &documents,
+                                        size_t &matchCount, int &unavailableShards,
+                                        QueryTrace *trace)
+{
+    // The whole search runs on one generation of the index
+    shared_ptr<const IndexSnapshot> currentSnapshot = atomic_load(&snapshot);
+
+    StageTimer normalizationTimer(STAGE_QUERY_NORMALIZATION, trace);
+    // Searches made of single terms use the inverted index, the rest scan the articles
+    vector<string> terms;
+    bool isIndexable = IndexShard::getQueryTerms(words, terms);
+    if (trace)
+        trace->setTerms(words);
+    normalizationTimer.stop();
+
+    // Every shard scores its own documents and keeps its best MAX_SEARCH_RESULTS. The shards
+    // run in parallel, so each one gets its own arena; only the merged results are copied into
+    // the arena of the request.
+    size_t shardCount = currentSnapshot->getShardCount();
+    unique_ptr<RequestArena[]> shardArenas(new RequestArena[shardCount]);
+    vector<SearchResults> shardResults;
+    shardResults.reserve(shardCount);
+    for (size_t i = 0; i < shardCount; i++)
+        shardResults.emplace_back(shardArenas[i].getResource());
+    vector<size_t> shardMatchCounts(shardCount, 0);
+    vector<function<void()>> searchTasks;
+
+    for (size_t i = 0; i < shardCount; i++)
     {
-        cerr << "Failed to open database: " << sqlite3_errmsg(database) << endl;
-        return;
+        searchTasks.push_back([&, i]() {
+            searchShard(currentSnapshot->getShard(i), words, isIndexable ? &terms : nullptr,
+                        options, shardResults[i], shardMatchCounts[i], trace);
+        });
     }
 
-    string query = "SELECT PATH, (LENGTH(BODY) - LENGTH(REPLACE(LOWER(BODY), \
-                LOWER('" + word + "'), ''))) \
-                / CAST(LENGTH('" + word + "') AS FLOAT) / WORDC \
-                AS TermFrequency FROM ARTICLES WHERE LOWER(BODY) LIKE \
-                '%" + word + "%';";
+    searchPool.run(searchTasks);
+
+    documents = shared_ptr<const DocumentStore>(currentSnapshot,
+                                                &currentSnapshot->getDocuments());
+    mergeResults(shardResults, *documents, results, trace);
+
+    matchCount = 0;
+    for (size_t i = 0; i < shardCount; i++)
+        matchCount += shardMatchCounts[i];
 
-    result = sqlite3_exec(database, query.c_str(), termFreqCallback, &termFrequencies, nullptr);
+    unavailableShards = 0;
+}
 
-    if (result != SQLITE_OK)
+/**
+ *@brief Searches like search(), but a request that arrives while an identical search is
+ *       running waits for it and shares its result instead of searching again
+ *
+ *@param words                  searched words, as typed by the user
+ *@param options                how the words are combined
+ *@param results                best MAX_SEARCH_RESULTS results: document vs term frequency,
+ *                              sorted
+ *@param documents              table the document numbers of the results refer to
+ *@param matchCount             number of articles that matched
+ *@param unavailableShards      number of shards that could not be searched
+ *@param trace                  trace of the request, if it is being traced. The stages are
+ *                              only recorded by the request that ran the search.
+ *
+ **/
+void EDAoogleHttpRequestHandler::coalescedSearch(const SearchTerms &words,
+                                                 const SearchOptions &options,
+                                                 SearchResults &results,
+                                                 shared_ptr<const DocumentStore> &documents,
+                                                 size_t &matchCount, int &unavailableShards,
+                                                 QueryTrace *trace)
+{
+    bool isShared;
+    shared_ptr<const CoalescedSearch> coalescedResult = searchCoalescer.run(
+        SearchCoalescer::getKey(words, options),
+        [&](CoalescedSearch &result) {
+            RequestArena arena;
+            SearchResults searchResults(arena.getResource());
+            search(words, options, searchResults, result.documents, result.matchCount,
+                   result.unavailableShards, trace);
+            result.results.assign(searchResults.begin(), searchResults.end());
+        },
+        isShared);
+
+    if (isShared)
     {
-        cerr << "Failed to execute query: " << sqlite3_errmsg(database) << endl;
+        Metrics::addToCounter(COUNTER_COALESCED_SEARCHES);
+        if (trace)
+            trace->setTerms(words);
     }
 
-    sqlite3_close(database);
+    results.assign(coalescedResult->results.begin(), coalescedResult->results.end());
+    documents = coalescedResult->documents;
+    matchCount = coalescedResult->matchCount;
+    unavailableShards = coalescedResult->unavailableShards;
 }
 
-/* HTML CONDITIONING */
+/**
+ *@brief Merges several top-k lists into a single top-k list. The lists must hold disjoint
+ *       documents, which is always the case for shards.
+ *
+ *@param partialResults         top-k lists to merge
+ *@param documents              table the document numbers of the lists refer to
+ *@param results                merged top-k list, sorted by term frequency and then by static
+ *                              rank
+ *@param trace                  trace of the request, if it is being traced
+ *
+ **/
+void EDAoogleHttpRequestHandler::mergeResults(vector<SearchResults> &partialResults,
+                                              const DocumentStore &documents,
+                                              SearchResults &results, QueryTrace *trace)
+{
+    StageTimer sortingTimer(STAGE_SORTING, trace);
+
+    vector<SearchResult *> candidates;
+    for (auto &partialResult : partialResults)
+        for (auto &result : partialResult)
+            candidates.push_back(&result);
+
+    size_t resultCount = min(candidates.size(), (size_t)MAX_SEARCH_RESULTS);
+    partial_sort(candidates.begin(), candidates.begin() + resultCount, candidates.end(),
+                 [&](const SearchResult *a, const SearchResult *b) {
+                     if (a->second != b->second)
+                         return compareByTermFrequency(*a, *b);
+                     return documents.getStaticRank(a->first) > documents.getStaticRank(b->first);
+                 });
+
+    results.clear();
+    results.reserve(resultCount);
+    for (size_t i = 0; i < resultCount; i++)
+        results.emplace_back(candidates[i]->first, candidates[i]->second);
+}
 
 /**
- *@brief Parses html into a string ignoring tags
+ *@brief Internal API used by a coordinator to search the slice of the index held by this
+ *       process. The response is plain text: the number of matches in the first line followed
+ *       by one "termFrequency<TAB>url<TAB>title<TAB>staticRank" line per result.
+ *
+ *@param arguments      q holds the searched words separated by '+', match=all requires
+ *                      every word
+ *@param response       compact list of results
  *
- *@param htmlContent            raw html string
- *@return string                cleaned string
- *@cite https://www.geeksforgeeks.org/html-parser-in-c-cpp/
  **/
-string EDAoogleHttpRequestHandler::parseHTMLContent(const string &htmlContent)
+void EDAoogleHttpRequestHandler::serveShardSearch(HttpArguments &arguments,
+                                                  vector<char> &response)
 {
-    string contentString = "";
+    string searchString;
+    if (arguments.find("q") != arguments.end())
+        searchString = arguments["q"];
+
+    RequestArena arena;
+    SearchResults results(arena.getResource());
+    shared_ptr<const DocumentStore> documents;
+    size_t matchCount = 0;
+    int unavailableShards = 0;
+
+    coalescedSearch(splitStringByAddSymbol(searchString, arena.getResource()),
+                    getSearchOptions(arguments), results, documents, matchCount,
+                    unavailableShards);
+
+    char number[32];
+    ArenaString responseString(arena.getResource());
+    responseString.reserve(32 + results.size() * 128);
+    snprintf(number, sizeof(number), "%zu\n", matchCount);
+    responseString += number;
+    for (const auto &result : results)
+    {
+        // Scores keep every digit of a float, so the coordinator merges them in the same order
+        snprintf(number, sizeof(number), "%.9g\t", result.second);
+        responseString += number;
+        responseString += documents->getUrl(result.first);
+        responseString += '\t';
+        responseString += documents->getTitle(result.first);
+        snprintf(number, sizeof(number), "\t%.9g\n", documents->getStaticRank(result.first));
+        responseString += number;
+    }
 
-    size_t pos = 0;
+    response.assign(responseString.begin(), responseString.end());
+}
 
-    int condition = 0;
 
-    while (pos != string::npos && pos < htmlContent.length())
-    {
-        // Find the start of the next HTML tag
-        size_t startTagPos = htmlContent.find('<', pos);
-        if (startTagPos == string::npos)
-            break;
+/**
+ *@brief Admin API with the memory taken by every component of the index, as plain text
+ *       "name value" lines in bytes. resident_bytes is what the operating system counts for
+ *       the whole process (0 where it is not known).
+ *
+ *@param response       the report
+ *
+ **/
+void EDAoogleHttpRequestHandler::serveMemoryStatus(vector<char> &response)
+{
+    shared_ptr<const IndexSnapshot> currentSnapshot = atomic_load(&snapshot);
+    MemoryUsage usage = getMemoryUsage(*currentSnapshot);
 
-        // Find the end of the current HTML tag
-        size_t endTagPos = htmlContent.find('>', startTagPos);
-        if (endTagPos == string::npos)
-            break;
+    size_t shardsWithIndex = 0;
+    for (size_t i = 0; i < currentSnapshot->getShardCount(); i++)
+    {
+        if (currentSnapshot->getShard(i).hasIndex())
+            shardsWithIndex++;
+    }
 
-        // Extract the current HTML tag
-        string tag = htmlContent.substr(startTagPos, endTagPos - startTagPos + 1);
+    size_t residentMemory = 0;
+#ifdef __linux__
+    // Second field of statm: resident pages
+    ifstream statm("/proc/self/statm");
+    size_t totalPages = 0;
+    size_t residentPages = 0;
+    if (statm >> totalPages >> residentPages)
+        residentMemory = residentPages * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+
+    stringstream status;
+    status << "budget_bytes " << memoryBudget << endl
+           << "total_bytes " << usage.getTotal() << endl
+           << "dictionary_bytes " << usage.dictionary << endl
+           << "postings_bytes " << usage.postings << endl
+           << "term_bitmaps_bytes " << usage.termBitmaps << endl
+           << "filter_bitmaps_bytes " << usage.filterBitmaps << endl
+           << "documents_bytes " << usage.documents << endl
+           << "sqlite_bytes " << usage.sqlite << endl
+           << "resident_bytes " << residentMemory << endl
+           << "shards_with_index " << shardsWithIndex << " of "
+           << currentSnapshot->getShardCount() << endl;
+
+    string statusString = status.str();
+    response.assign(statusString.begin(), statusString.end());
+}
 
-        startTagPos = endTagPos + 1;
-        endTagPos = htmlContent.find('<', startTagPos);
+/**
+ *@brief Gets the memory taken by a generation of the index and by SQLite
+ **/
+MemoryUsage EDAoogleHttpRequestHandler::getMemoryUsage(const IndexSnapshot &snapshot)
+{
+    MemoryUsage usage;
+    for (size_t i = 0; i < snapshot.getShardCount(); i++)
+        snapshot.getShard(i).getMemoryUsage(usage);
 
-        while (htmlContent[startTagPos] == '<')
-        {
-            string auxiliarTag = htmlContent.substr(startTagPos, 5);
-            startTagPos = htmlContent.find('>', startTagPos) + 1;
-            endTagPos = htmlContent.find('<', startTagPos);
-        }
+    // The documents of all the shards are also kept together for the results page
+    usage.documents += snapshot.getDocuments().getMemoryUsage();
+    usage.sqlite = (size_t)sqlite3_memory_used();
 
-        if (endTagPos == string::npos)
-        {
-            endTagPos = htmlContent.length();
-        }
-        string textToAdd = htmlContent.substr(startTagPos, endTagPos - startTagPos);
-        textToAdd = addCharacterNextTo(textToAdd, '\'', '\''); // char ' was problematic with SQL
+    return usage;
+}
 
-        contentString += textToAdd;
+/**
+ *@brief Gets the memory the index may take: the budget less what SQLite keeps at least
+ **/
+size_t EDAoogleHttpRequestHandler::getIndexMemoryLimit()
+{
+    return (memoryBudget > MIN_SQLITE_HEAP_LIMIT) ? memoryBudget - MIN_SQLITE_HEAP_LIMIT : 0;
+}
 
-        // Move the position to the last processed character
-        pos = endTagPos;
+/**
+ *@brief Gets the shards of a generation that have (or do not have) their index, the least
+ *       recently searched first and, on a tie, the one with the largest index first
+ **/
+vector<IndexShard *> EDAoogleHttpRequestHandler::getShardsByRecency(const IndexSnapshot &snapshot,
+                                                                   bool withIndex)
+{
+    // Searches keep updating the times, so they are read once before sorting
+    vector<tuple<uint64_t, size_t, IndexShard *>> recentShards;
+    for (size_t i = 0; i < snapshot.getShardCount(); i++)
+    {
+        IndexShard &shard = snapshot.getShard(i);
+        if (shard.hasIndex() == withIndex)
+            recentShards.emplace_back(shard.getLastSearchTime(), shard.getIndexMemory(), &shard);
     }
 
-    return contentString;
+    sort(recentShards.begin(), recentShards.end(),
+         [](const tuple<uint64_t, size_t, IndexShard *> &a,
+            const tuple<uint64_t, size_t, IndexShard *> &b) {
+             if (get<0>(a) != get<0>(b))
+                 return get<0>(a) < get<0>(b);
+             return get<1>(a) > get<1>(b);
+         });
+
+    vector<IndexShard *> shards;
+    for (auto &recentShard : recentShards)
+        shards.push_back(get<2>(recentShard));
+
+    return shards;
 }
 
+/**
+ *@brief Sheds indexes, in the order of the shards, until the index fits a limit
+ *
+ *@param shards         shards whose index can be shed, from getShardsByRecency()
+ *@param residentMemory memory taken by the index
+ *@param limit          memory the index may take
+ *@param searchedBefore only the shards last searched before this time are shed
+ *
+ *@return size_t        memory taken by the index afterwards
+ **/
+size_t EDAoogleHttpRequestHandler::shedIndexes(const vector<IndexShard *> &shards,
+                                               size_t residentMemory, size_t limit,
+                                               uint64_t searchedBefore)
+{
+    for (IndexShard *shard : shards)
+    {
+        if (residentMemory <= limit || shard->getLastSearchTime() >= searchedBefore)
+            break;
+        if (!shard->hasIndex())
+            continue;
+
+        size_t shedMemory = shard->shedIndex();
+        residentMemory -= min(residentMemory, shedMemory);
+        Metrics::addToCounter(COUNTER_SHED_INDEXES);
+        fprintf(stdout, "Shed the index of %s (%zu bytes) to stay within the memory budget\n",
+                shard->getDatabasePath().c_str(), shedMemory);
+    }
+
+    return residentMemory;
+}
 
 /**
- *@brief Separates header text from all other text
+ *@brief Makes room in the memory budget for the index of a shard that is about to be loaded.
+ *       The generation being served gives up its least recently searched indexes if needed,
+ *       since it is about to be replaced.
  *
- *@param htmlContent            raw html string
- *@return pair<string, string>  separated strings of headers and non-headers
- *@cite https://www.geeksforgeeks.org/html-parser-in-c-cpp/
+ *@param indexMemory    memory the index is expected to take
+ *
+ *@return bool          true if the index fits and was counted in the loading memory, false if
+ *                      the shard must be loaded without it
  **/
-pair<string, string> EDAoogleHttpRequestHandler::filterHTMLContent(const string &htmlContent)
+bool EDAoogleHttpRequestHandler::reserveIndexMemory(size_t indexMemory)
 {
-    string headersString = "";
-    string bodyString = "";
+    if (memoryBudget == 0)
+        return true;
 
-    size_t pos = 0;
+    lock_guard<mutex> lock(memoryMutex);
 
-    int condition = 0;
+    size_t limit = getIndexMemoryLimit();
+    if (indexMemory > limit)
+        return false;
 
-    while (pos != string::npos && pos < htmlContent.length())
+    size_t residentMemory = loadingMemory;
+    shared_ptr<const IndexSnapshot> currentSnapshot = atomic_load(&snapshot);
+    if (currentSnapshot)
     {
-        // Find the start of the next HTML tag
-        size_t startTagPos = htmlContent.find('<', pos);
-        if (startTagPos == string::npos)
-            break;
+        residentMemory += getMemoryUsage(*currentSnapshot).getIndexTotal();
+        residentMemory = shedIndexes(getShardsByRecency(*currentSnapshot, true), residentMemory,
+                                     limit - indexMemory, UINT64_MAX);
+    }
 
-        // Find the end of the current HTML tag
-        size_t endTagPos = htmlContent.find('>', startTagPos);
-        if (endTagPos == string::npos)
-            break;
+    if (residentMemory + indexMemory > limit)
+        return false;
 
-        // Extract the current HTML tag
-        string tag = htmlContent.substr(startTagPos, endTagPos - startTagPos + 1);
+    loadingMemory += indexMemory;
 
-        // Check if it is a header tag
-        if ((tag.substr(0, 3) == "<h1" || tag.substr(0, 3) == "<h2" || tag.substr(0, 3) == "<h3" 
-             || tag.substr(0, 6) == "<title") && tag.back() == '>')
-        {
-            condition = HEADER;
-        }
-        else
-        {
-            condition = NON_HEADER;
-        }
+    return true;
+}
 
-        startTagPos = endTagPos + 1;
-        endTagPos = htmlContent.find('<', startTagPos);
+/**
+ *@brief Replaces what was reserved for a shard that was loaded with what it takes
+ *
+ *@param reservedMemory memory reserved by reserveIndexMemory(), 0 if nothing was reserved
+ *@param shard          the loaded shard
+ **/
+void EDAoogleHttpRequestHandler::releaseIndexMemory(size_t reservedMemory, IndexShard &shard)
+{
+    if (memoryBudget == 0)
+        return;
 
-        while (htmlContent[startTagPos] == '<')
-        {
-            string auxiliarTag = htmlContent.substr(startTagPos, 5);
-            // Check for "hidden" header tags
-            if (auxiliarTag.substr(0, 3) == "<h1" || auxiliarTag.substr(0, 3) == "<h2" || 
-                auxiliarTag.substr(0, 3) == "<h3")
-            {
-                condition = HEADER;
-            }
-            startTagPos = htmlContent.find('>', startTagPos) + 1;
-            endTagPos = htmlContent.find('<', startTagPos);
-        }
+    MemoryUsage usage;
+    shard.getMemoryUsage(usage);
+
+    lock_guard<mutex> lock(memoryMutex);
+    loadingMemory = loadingMemory - min(loadingMemory, reservedMemory) + usage.getIndexTotal();
+}
+
+/**
+ *@brief Fits the generation being served in the memory budget. The indexes of the shards that
+ *       were searched the longest ago are shed until the index leaves SQLite
+ *       MIN_SQLITE_HEAP_LIMIT. Shed indexes are then reloaded, the most recently searched first,
+ *       if they fit, or if they were searched in the last MEMORY_CHECK_INTERVAL and fit in place
+ *       of indexes that were not. SQLite is limited to whatever the index leaves.
+ **/
+void EDAoogleHttpRequestHandler::enforceMemoryBudget()
+{
+    if (memoryBudget == 0)
+        return;
+
+    lock_guard<mutex> lock(memoryMutex);
+
+    shared_ptr<const IndexSnapshot> currentSnapshot = atomic_load(&snapshot);
+    size_t limit = getIndexMemoryLimit();
+    size_t residentMemory = getMemoryUsage(*currentSnapshot).getIndexTotal() + loadingMemory;
+
+    vector<IndexShard *> residentShards = getShardsByRecency(*currentSnapshot, true);
+    residentMemory = shedIndexes(residentShards, residentMemory, limit, UINT64_MAX);
+
+    // A rebuild takes the memory the generation being replaced gives up
+    vector<IndexShard *> shedShards;
+    if (!rebuilding)
+        shedShards = getShardsByRecency(*currentSnapshot, false);
 
-        if (endTagPos == string::npos)
+    uint64_t now = Metrics::getTime();
+    uint64_t idleSince = now - min(now, (uint64_t)MEMORY_CHECK_INTERVAL * 1000000000);
+    for (auto shard = shedShards.rbegin(); shard != shedShards.rend(); shard++)
+    {
+        size_t indexMemory = (*shard)->getIndexMemory();
+        if (indexMemory > limit || (*shard)->getDocuments().getDocumentCount() == 0)
+            continue;
+
+        // A shard searched in the last interval takes the place of indexes idle for all of it
+        size_t idleMemory = 0;
+        uint64_t searchedBefore = ((*shard)->getLastSearchTime() >= idleSince) ? idleSince : 0;
+        for (IndexShard *residentShard : residentShards)
         {
-            endTagPos = htmlContent.length();
+            if (residentShard->getLastSearchTime() < searchedBefore && residentShard->hasIndex())
+                idleMemory += residentShard->getIndexMemory();
         }
-        string textToAdd = htmlContent.substr(startTagPos, endTagPos - startTagPos);
-        textToAdd = addCharacterNextTo(textToAdd, '\'', '\''); // char ' was problematic with SQL
+        if (residentMemory - min(residentMemory, idleMemory) + indexMemory > limit)
+            continue;
+
+        residentMemory = shedIndexes(residentShards, residentMemory, limit - indexMemory,
+                                     searchedBefore);
+        if (!(*shard)->reloadIndex())
+            continue;
 
-        switch (condition)
+        // The file size estimate can fall short; the real size is then kept for the next check
+        if (residentMemory + (*shard)->getIndexMemory() > limit)
         {
-        case HEADER:
-            headersString += textToAdd + ' ';
-            break;
-        case NON_HEADER:
-            bodyString += textToAdd + ' ';
-            break;
-        default:
-            break;
+            (*shard)->shedIndex();
+            continue;
         }
 
-        // Move the position to the last processed character
-        pos = endTagPos;
+        residentMemory += (*shard)->getIndexMemory();
+        Metrics::addToCounter(COUNTER_RELOADED_INDEXES);
+        fprintf(stdout, "Reloaded the index of %s (%zu bytes)\n",
+                (*shard)->getDatabasePath().c_str(), (*shard)->getIndexMemory());
     }
 
-    return make_pair(headersString, bodyString);
+    if (residentMemory > limit && !isOverBudget)
+        cerr << "The documents and filters of the index take " << residentMemory
+             << " bytes, more than the memory budget allows" << endl;
+    isOverBudget = residentMemory > limit;
+
+    // SQLite caches pages up to the limit and then recycles them instead of growing
+    sqlite3_int64 sqliteLimit = max((sqlite3_int64)MIN_SQLITE_HEAP_LIMIT,
+                                    (sqlite3_int64)memoryBudget - (sqlite3_int64)residentMemory);
+    sqlite3_soft_heap_limit64(sqliteLimit);
+    if (sqlite3_memory_used() > sqliteLimit)
+        sqlite3_release_memory((int)min(sqlite3_memory_used() - sqliteLimit,
+                                        (sqlite3_int64)INT32_MAX));
 }
 
 /**
- *@brief Puts html file into a single string
+ *@brief Checks the memory budget every MEMORY_CHECK_INTERVAL seconds until the handler stops
+ **/
+void EDAoogleHttpRequestHandler::watchMemory()
+{
+    unique_lock<mutex> lock(memoryMutex);
+    while (!memoryCondition.wait_for(lock, chrono::seconds(MEMORY_CHECK_INTERVAL),
+                                     [this]() { return (bool)stopping; }))
+    {
+        lock.unlock();
+        enforceMemoryBudget();
+        lock.lock();
+    }
+}
+
+/*________________________________________________________________________________________________
+
+                                AUXILIAR FUNCTIONS AND METHODS
+__________________________________________________________________________________________________*/
+
+
+/* FREQUENCY CALCULATOR */
+
+/**
+ *@brief Scores the articles of one shard and keeps its best MAX_SEARCH_RESULTS
+ *
+ *@param shard                  shard to search
+ *@param words                  searched words, as typed by the user
+ *@param terms                  index terms of the words, nullptr if they are not all terms
+ *@param options                how the words are combined
+ *@param topResults             best results of the shard: document vs term frequency
+ *@param matchCount             number of articles of the shard that matched
+ *@param trace                  trace of the request, if it is being traced
  *
- *@param filePath       path to file
+ **/
+void EDAoogleHttpRequestHandler::searchShard(IndexShard &shard, const SearchTerms &words,
+                                             const vector<string> *terms,
+                                             const SearchOptions &options,
+                                             SearchResults &topResults, size_t &matchCount,
+                                             QueryTrace *trace)
+{
+    if (terms &&
+        shard.searchIndex(*terms, options, MAX_SEARCH_RESULTS, topResults, matchCount, trace))
+        return;
 
- *@return string        raw html text
+    if (terms)
+        searchShedShard(shard, words, options, topResults, matchCount, trace);
+    else
+        shard.searchText(words, options, MAX_SEARCH_RESULTS, topResults, matchCount, trace);
+    if (trace)
+        trace->candidatesScored += matchCount;
+}
 
+/**
+ *@brief Searches a shard whose index was shed by scanning its articles, like a phrase search,
+ *       for every word but the stopwords the index leaves out. A scan reads the whole shard, so
+ *       only MAX_SHED_INDEX_SEARCHES run at a time and the rest wait for them.
+ *
+ *@param shard                  shard to search
+ *@param words                  searched words, as typed by the user
+ *@param options                how the words are combined
+ *@param topResults             best results of the shard: document vs term frequency
+ *@param matchCount             number of articles of the shard that matched
+ *@param trace                  trace of the request, if it is being traced
+ *
  **/
-string EDAoogleHttpRequestHandler::readHTMLFile(const wstring &filePath)
+void EDAoogleHttpRequestHandler::searchShedShard(IndexShard &shard, const SearchTerms &words,
+                                                 const SearchOptions &options,
+                                                 SearchResults &topResults, size_t &matchCount,
+                                                 QueryTrace *trace)
 {
-    wifstream file(filePath);
-    if (!file.is_open())
+    SearchTerms scannedWords(topResults.get_allocator().resource());
+    vector<string> wordTerms;
+    for (const auto &word : words)
+    {
+        wordTerms.clear();
+        if (Analyzer::analyze(word, wordTerms) != 1 || !wordTerms.empty())
+            scannedWords.push_back(word);
+    }
+
+    Metrics::addToCounter(COUNTER_SHED_INDEX_SEARCHES);
     {
-        wcerr << L"Failed to open file: " << filePath << endl;
-        return "";
+        unique_lock<mutex> lock(shedSearchMutex);
+        shedSearchCondition.wait(lock,
+                                 [this]() { return shedSearchCount < MAX_SHED_INDEX_SEARCHES; });
+        shedSearchCount++;
     }
 
-    string htmlContent((istreambuf_iterator<wchar_t>(file)), istreambuf_iterator<wchar_t>());
-    file.close();
+    shard.searchText(scannedWords, options, MAX_SEARCH_RESULTS, topResults, matchCount, trace);
 
-    return htmlContent;
+    {
+        lock_guard<mutex> lock(shedSearchMutex);
+        shedSearchCount--;
+    }
+    shedSearchCondition.notify_one();
 }
 
 /* STRING MANAGEMENT */
@@ -438,107 +1098,61 @@ wstring EDAoogleHttpRequestHandler::stringToWstring(const string &str)
  *
  *
  *@param input            string to divide into substrings
+ *@param arena            memory the substrings are allocated from
  *
  *@return vector of separated strings
  **/
-vector<string> EDAoogleHttpRequestHandler::splitStringByAddSymbol(const string &input)
+SearchTerms EDAoogleHttpRequestHandler::splitStringByAddSymbol(const string &input,
+                                                               pmr::memory_resource *arena)
 {
-    vector<string> separatedWords;
-    stringstream ss(input);
-    string word;
+    SearchTerms separatedWords(arena);
+    size_t wordStart = 0;
 
-    while (getline(ss, word, '+'))
+    while (wordStart <= input.size())
     {
-        if (!word.empty())
-        {
-            separatedWords.push_back(word);
-        }
-    }
+        size_t wordEnd = input.find('+', wordStart);
+        if (wordEnd == string::npos)
+            wordEnd = input.size();
 
-    return separatedWords;
-}
-
-/**
- *@brief The character ' was problematic when working with SQL. Our solution was to add another ' next
- *       to the ' in the html text to "escape" in SQL. We could also have eliminated de ' character but
- *       this conflicted with finding path names when answering the user's search
- *
- *@param input                  string to rectify
- *@param targetChar             character to detect
- *@param charToAdd              character to add
-
- *@return string                rectified string
- **/
-string EDAoogleHttpRequestHandler::addCharacterNextTo(const string &input, char targetChar, 
-                                                      char charToAdd)
-{
-    string result;
-    for (size_t i = 0; i < input.length(); i++)
-    {
-        result += input[i];
-        if (input[i] == targetChar)
+        if (wordEnd > wordStart)
         {
-            result += charToAdd;
+            separatedWords.emplace_back(string_view(input).substr(wordStart, wordEnd - wordStart));
         }
-    }
-    return result;
-}
-
-/**
- *@brief Counts space characters in a string to approximate number of words in a file
-         This could have been implemented with a sql search as well.
- *
- *@param input                  string to count spaces in
- *
- *@return int                   count
- **/
-int EDAoogleHttpRequestHandler::countSpaceCharacters(const string& input) 
-{
-    int count = 0;
 
-    for (char c : input) {
-        if (c == ' ') {
-            count++;
-        }
+        wordStart = wordEnd + 1;
     }
 
-    return count;
+    return separatedWords;
 }
 
-/* CALLBACKS */
-
 /**
- *@brief Callback necessary to calculate the frequency of a word in a register. If the register
- *       was already added then it adds up the frequencies of the terms involved
+ *@brief Reads how the words of a search are combined and filtered from its arguments
  *
- *@param data            vector of pairs string vs float
- *@param argv            array containing the path in the 1st column and term frequency in the 2nd
+ *@param arguments      arguments of the search; match=all requires every word, and len,
+ *                      initial and cat restrict the articles
  *
- *@return 0 (successfull)
+ *@return SearchOptions options of the search
  **/
-int termFreqCallback(void *data, int argc, char **argv, char **columnNames)
+SearchOptions EDAoogleHttpRequestHandler::getSearchOptions(HttpArguments &arguments)
 {
-    vector<pair<string, float>> &termFrequencies = *static_cast<vector<pair<string, float>> *>(data);
+    SearchOptions options;
 
-    auto it = find_if(termFrequencies.begin(), termFrequencies.end(),
-    [&](const pair<string, float>& pair) {
-        return pair.first == argv[0];
-    });
+    auto match = arguments.find("match");
+    options.matchAll = match != arguments.end() && match->second == "all";
 
-    if (it == termFrequencies.end())
+    // Arguments are sorted by name, so the filters of equal searches come in the same order
+    string filterKey;
+    for (const auto &argument : arguments)
     {
-        string path = argv[0] ? argv[0] : "NULL";
-        float termFrequency = stof(argv[1] ? argv[1] : "0");
-        termFrequencies.emplace_back(path, termFrequency);
-    }
-    else 
-    {
-        (*it).second += stof(argv[1]);
+        if (IndexShard::getFilterKey(argument.first, argument.second, filterKey))
+            options.filters.push_back(filterKey);
     }
 
-    return 0;
+    return options;
 }
 
+/* CALLBACKS */
+
 /**
  *@brief Compare callback to sort the results with "sort"
  *
@@ -546,7 +1160,7 @@ int termFreqCallback(void *data, int argc, char **argv, char **columnNames)
  *
  *@returns bool indicating which of the parameters has a higher priority
  **/
-bool compareByTermFrequency(const pair<string, float> &a, const pair<string, float> &b)
+bool compareByTermFrequency(const SearchResult &a, const SearchResult &b)
 {
     // Sort in descending order based on the second element (term frequency)
     return a.second > b.second;
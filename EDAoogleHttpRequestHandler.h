@@ -23,57 +23,151 @@
 #include <algorithm>
 #include <sstream>
 #include <codecvt>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include <microhttpd.h>
 #include <sqlite3.h>
 
 #include "HttpServer.h"
-#include "EDAoogleHttpRequestHandler.h"
+#include "DocumentStore.h"
+#include "HTMLParser.h"
+#include "IndexBuilder.h"
+#include "IndexShard.h"
+#include "IndexSnapshot.h"
+#include "MemoryUsage.h"
+#include "RequestArena.h"
+#include "SearchCoalescer.h"
+#include "SlowQueryLog.h"
+#include "WorkStealingPool.h"
 
 using namespace std;
 
-#define HEADER 1
-#define NON_HEADER 2
-
 #ifdef WIN32
 #define PATH_CORRECTION "..\\..\\"
 #define PATH_CORRECTION_HTML "..\\..\\www\\wiki\\"
-#define EXTRA_CHARACTERS_IN_PATH 10
-#define DB_NAME "wiki.db"
 
 #else
 #define PATH_CORRECTION "../"
 #define PATH_CORRECTION_HTML "../www/wiki/"
-#define EXTRA_CHARACTERS_IN_PATH 7
 #endif
 
+#define DEFAULT_SHARD_COUNT 1
+#define MAX_SEARCH_RESULTS 100
+// SQLite keeps at least this much heap for its page caches however tight the memory budget is,
+// or every scan would read the shard file again
+#define MIN_SQLITE_HEAP_LIMIT (8 << 20)
+// Seconds between checks of the memory budget, which also reload the shed indexes that fit
+#define MEMORY_CHECK_INTERVAL 10
+// Shards without their index that are scanned at the same time; other searches of such shards
+// wait for one of them to end
+#define MAX_SHED_INDEX_SEARCHES 2
+
 class EDAoogleHttpRequestHandler : public ServeHttpRequestHandler
 {
 public:
-    EDAoogleHttpRequestHandler(string homePath);
+    EDAoogleHttpRequestHandler(string homePath, int shardCount = DEFAULT_SHARD_COUNT,
+                               int sliceIndex = 0, int sliceCount = 1,
+                               string indexPath = PATH_CORRECTION, size_t memoryBudget = 0);
+    virtual ~EDAoogleHttpRequestHandler();
+
     bool handleRequest(string url, HttpArguments arguments, vector<char> &response);
+    bool isAsynchronous(const string &url);
+    bool handleAdminRequest(const string &url, vector<char> &response);
+
+    bool rebuildIndex();
+    bool requestRebuild();
+    void setSlowQueryLog(SlowQueryLog *slowQueryLog);
+
+protected:
+    virtual void search(const SearchTerms &words, const SearchOptions &options,
+                        SearchResults &results, shared_ptr<const DocumentStore> &documents,
+                        size_t &matchCount, int &unavailableShards,
+                        QueryTrace *trace = nullptr);
+    void coalescedSearch(const SearchTerms &words, const SearchOptions &options,
+                         SearchResults &results, shared_ptr<const DocumentStore> &documents,
+                         size_t &matchCount, int &unavailableShards,
+                         QueryTrace *trace = nullptr);
+    void mergeResults(vector<SearchResults> &partialResults, const DocumentStore &documents,
+                      SearchResults &results, QueryTrace *trace = nullptr);
+    void renderSearchPage(const string &searchString, const SearchResults &results,
+                          const DocumentStore &documents, size_t matchCount, float searchTime,
+                          int unavailableShards, ArenaString &responseString,
+                          QueryTrace *trace = nullptr);
+    SearchTerms splitStringByAddSymbol(const string &input, pmr::memory_resource *arena);
+    SearchOptions getSearchOptions(HttpArguments &arguments);
+
+    WorkStealingPool searchPool;
 
 private:
+    void serveShardSearch(HttpArguments &arguments, vector<char> &response);
+    void serveMemoryStatus(vector<char> &response);
+
+    MemoryUsage getMemoryUsage(const IndexSnapshot &snapshot);
+    size_t getIndexMemoryLimit();
+    vector<IndexShard *> getShardsByRecency(const IndexSnapshot &snapshot, bool withIndex);
+    size_t shedIndexes(const vector<IndexShard *> &shards, size_t residentMemory, size_t limit,
+                       uint64_t searchedBefore);
+    bool reserveIndexMemory(size_t indexMemory);
+    void releaseIndexMemory(size_t reservedMemory, IndexShard &shard);
+    void enforceMemoryBudget();
+    void watchMemory();
+
+    bool buildSnapshot(uint64_t generation, bool rebuildAll, WorkStealingPool &pool,
+                       shared_ptr<IndexSnapshot> &newSnapshot);
+
     /*String Management*/
-    wstring EDAoogleHttpRequestHandler::stringToWstring(const string &str);
-    vector<string> EDAoogleHttpRequestHandler::splitStringByAddSymbol(const string &input);
-    string EDAoogleHttpRequestHandler::addCharacterNextTo(const string &input, char targetChar, 
-                                                          char charToAdd);
-    int EDAoogleHttpRequestHandler::countSpaceCharacters(const std::string& input);
+    wstring stringToWstring(const string &str);
 
     /*Frequency calculations*/
-    void EDAoogleHttpRequestHandler::calculateTermFrequency(const string& word, vector<pair<string,
-                                                            float>>& termFrequencies);
-    
-    /*HTML processing*/
-    pair<string, string> EDAoogleHttpRequestHandler::filterHTMLContent(const string &htmlContent);
-    string EDAoogleHttpRequestHandler::parseHTMLContent(const string &htmlContent);
-    string EDAoogleHttpRequestHandler::readHTMLFile(const wstring &filePath);
-
-    
-
+    void searchShard(IndexShard &shard, const SearchTerms &words, const vector<string> *terms,
+                     const SearchOptions &options, SearchResults &topResults,
+                     size_t &matchCount, QueryTrace *trace);
+    void searchShedShard(IndexShard &shard, const SearchTerms &words,
+                         const SearchOptions &options, SearchResults &topResults,
+                         size_t &matchCount, QueryTrace *trace);
+
+    IndexBuilder indexBuilder;
+    SlowQueryLog *slowQueryLog;
+
+    // Identical searches that run at the same time share one result
+    SearchCoalescer searchCoalescer;
+
+    // Generation of the index being served, read and replaced with atomic_load/atomic_store
+    shared_ptr<const IndexSnapshot> snapshot;
+
+    // Bytes the index and the SQLite caches may take, 0 for no limit
+    size_t memoryBudget;
+    // Memory reserved for or taken by the shards of a generation being loaded, which is not in
+    // the snapshot yet; guarded by memoryMutex
+    size_t loadingMemory;
+    // Whether the documents and filters alone did not fit the budget at the last check, so that
+    // it is only reported once; guarded by memoryMutex
+    bool isOverBudget;
+    mutex memoryMutex;
+    condition_variable memoryCondition;
+    thread memoryThread;
+
+    // Scans of shards without their index running now, at most MAX_SHED_INDEX_SEARCHES;
+    // guarded by shedSearchMutex
+    int shedSearchCount;
+    mutex shedSearchMutex;
+    condition_variable shedSearchCondition;
+
+    mutex rebuildMutex;
+    thread rebuildThread;
+    atomic<bool> rebuilding;
+    atomic<bool> stopping;
 };
 
+bool compareByTermFrequency(const SearchResult &a, const SearchResult &b);
+
 
 
 #endif
@@ -0,0 +1,354 @@
+/**
+ * @file HTMLParser.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief HTML conditioning shared by the search engine, the indexer and the benchmarks
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+#include "HTMLParser.h"
+
+using namespace std;
+
+/* HTML CONDITIONING */
+
+/**
+ *@brief Parses html into a string ignoring tags
+ *
+ *@param htmlContent            raw html string
+ *@return string                cleaned string
+ *@cite https://www.geeksforgeeks.org/html-parser-in-c-cpp/
+ **/
+string HTMLParser::parseHTMLContent(const string &htmlContent)
+{
+    string contentString = "";
+
+    size_t pos = 0;
+
+    int condition = 0;
+
+    while (pos != string::npos && pos < htmlContent.length())
+    {
+        // Find the start of the next HTML tag
+        size_t startTagPos = htmlContent.find('<', pos);
+        if (startTagPos == string::npos)
+            break;
+
+        // Find the end of the current HTML tag
+        size_t endTagPos = htmlContent.find('>', startTagPos);
+        if (endTagPos == string::npos)
+            break;
+
+        // Extract the current HTML tag
+        string tag = htmlContent.substr(startTagPos, endTagPos - startTagPos + 1);
+
+        startTagPos = endTagPos + 1;
+        endTagPos = htmlContent.find('<', startTagPos);
+
+        while (htmlContent[startTagPos] == '<')
+        {
+            string auxiliarTag = htmlContent.substr(startTagPos, 5);
+            startTagPos = htmlContent.find('>', startTagPos) + 1;
+            endTagPos = htmlContent.find('<', startTagPos);
+        }
+
+        if (endTagPos == string::npos)
+        {
+            endTagPos = htmlContent.length();
+        }
+        string textToAdd = htmlContent.substr(startTagPos, endTagPos - startTagPos);
+        textToAdd = addCharacterNextTo(textToAdd, '\'', '\''); // char ' was problematic with SQL
+
+        contentString += textToAdd;
+
+        // Move the position to the last processed character
+        pos = endTagPos;
+    }
+
+    return contentString;
+}
+
+
+/**
+ *@brief Separates header text from all other text
+ *
+ *@param htmlContent            raw html string
+ *@return pair<string, string>  separated strings of headers and non-headers
+ *@cite https://www.geeksforgeeks.org/html-parser-in-c-cpp/
+ **/
+pair<string, string> HTMLParser::filterHTMLContent(const string &htmlContent)
+{
+    string headersString = "";
+    string bodyString = "";
+
+    size_t pos = 0;
+
+    int condition = 0;
+
+    while (pos != string::npos && pos < htmlContent.length())
+    {
+        // Find the start of the next HTML tag
+        size_t startTagPos = htmlContent.find('<', pos);
+        if (startTagPos == string::npos)
+            break;
+
+        // Find the end of the current HTML tag
+        size_t endTagPos = htmlContent.find('>', startTagPos);
+        if (endTagPos == string::npos)
+            break;
+
+        // Extract the current HTML tag
+        string tag = htmlContent.substr(startTagPos, endTagPos - startTagPos + 1);
+
+        // Check if it is a header tag
+        if ((tag.substr(0, 3) == "<h1" || tag.substr(0, 3) == "<h2" || tag.substr(0, 3) == "<h3" 
+             || tag.substr(0, 6) == "<title") && tag.back() == '>')
+        {
+            condition = HEADER;
+        }
+        else
+        {
+            condition = NON_HEADER;
+        }
+
+        startTagPos = endTagPos + 1;
+        endTagPos = htmlContent.find('<', startTagPos);
+
+        while (htmlContent[startTagPos] == '<')
+        {
+            string auxiliarTag = htmlContent.substr(startTagPos, 5);
+            // Check for "hidden" header tags
+            if (auxiliarTag.substr(0, 3) == "<h1" || auxiliarTag.substr(0, 3) == "<h2" || 
+                auxiliarTag.substr(0, 3) == "<h3")
+            {
+                condition = HEADER;
+            }
+            startTagPos = htmlContent.find('>', startTagPos) + 1;
+            endTagPos = htmlContent.find('<', startTagPos);
+        }
+
+        if (endTagPos == string::npos)
+        {
+            endTagPos = htmlContent.length();
+        }
+        string textToAdd = htmlContent.substr(startTagPos, endTagPos - startTagPos);
+        textToAdd = addCharacterNextTo(textToAdd, '\'', '\''); // char ' was problematic with SQL
+
+        switch (condition)
+        {
+        case HEADER:
+            headersString += textToAdd + ' ';
+            break;
+        case NON_HEADER:
+            bodyString += textToAdd + ' ';
+            break;
+        default:
+            break;
+        }
+
+        // Move the position to the last processed character
+        pos = endTagPos;
+    }
+
+    return make_pair(headersString, bodyString);
+}
+
+/**
+ *@brief Decodes the percent-escapes of a link (%C3%AD is í)
+ **/
+static string decodePercentEscapes(string_view link)
+{
+    string decodedLink;
+    for (size_t i = 0; i < link.size(); i++)
+    {
+        if (link[i] == '%' && i + 2 < link.size() && isxdigit((unsigned char)link[i + 1]) &&
+            isxdigit((unsigned char)link[i + 2]))
+        {
+            decodedLink += (char)stoi(string(link.substr(i + 1, 2)), nullptr, 16);
+            i += 2;
+        }
+        else
+            decodedLink += link[i];
+    }
+
+    return decodedLink;
+}
+
+/**
+ *@brief Finds the wiki articles an html page links to. Links to other sites, to other
+ *       namespaces (such as "Archivo:") and to sections of the same page are left out.
+ *
+ *@param htmlContent            raw html string
+ *@param pageNames              file names of the linked articles (e.g. "Agua.html"), in the
+ *                              order they appear, repeated if they are linked more than once
+ **/
+void HTMLParser::extractWikiLinks(const string &htmlContent, vector<string> &pageNames)
+{
+    pageNames.clear();
+
+    const string hrefAttribute = "href=\"";
+    const string wikiFolder = "/wiki/";
+    size_t pos = 0;
+
+    while ((pos = htmlContent.find(hrefAttribute, pos)) != string::npos)
+    {
+        size_t linkStart = pos + hrefAttribute.size();
+        size_t linkEnd = htmlContent.find('"', linkStart);
+        if (linkEnd == string::npos)
+            break;
+        pos = linkEnd + 1;
+
+        // Articles are linked as https://es.wikipedia.org/wiki/Name or /wiki/Name.html
+        string_view link = string_view(htmlContent).substr(linkStart, linkEnd - linkStart);
+        size_t nameStart = link.find(wikiFolder);
+        if (nameStart == string_view::npos)
+            continue;
+        nameStart += wikiFolder.size();
+
+        size_t nameEnd = link.find_first_of("#?", nameStart);
+        if (nameEnd == string_view::npos)
+            nameEnd = link.size();
+
+        // Percent-escapes are decoded so that "Baha%27i" finds Baha'i.html
+        string pageName = decodePercentEscapes(link.substr(nameStart, nameEnd - nameStart));
+
+        if (pageName.empty() || pageName.find(':') != string::npos ||
+            pageName.find('/') != string::npos)
+            continue;
+
+        if (pageName.size() < 5 || pageName.compare(pageName.size() - 5, 5, ".html") != 0)
+            pageName += ".html";
+
+        pageNames.push_back(pageName);
+    }
+}
+
+/**
+ *@brief Finds the categories of an article in its category box. The hidden maintenance
+ *       categories are left out.
+ *
+ *@param htmlContent            raw html string
+ *@param categories             names of the categories (e.g. "Grupos de pop de Suecia")
+ **/
+void HTMLParser::extractCategories(const string &htmlContent, vector<string> &categories)
+{
+    categories.clear();
+
+    size_t boxStart = htmlContent.find("id=\"mw-normal-catlinks\"");
+    if (boxStart == string::npos)
+        return;
+    size_t boxEnd = htmlContent.find("</div>", boxStart);
+    if (boxEnd == string::npos)
+        boxEnd = htmlContent.size();
+
+    const string hrefAttribute = "href=\"";
+    // "Categoría:" spelled in UTF-8 whatever the encoding of the source file
+    const string categoryPrefix = "/wiki/Categor\xC3\xAD" "a:";
+    size_t pos = boxStart;
+
+    while ((pos = htmlContent.find(hrefAttribute, pos)) != string::npos && pos < boxEnd)
+    {
+        size_t linkStart = pos + hrefAttribute.size();
+        size_t linkEnd = htmlContent.find('"', linkStart);
+        if (linkEnd == string::npos)
+            break;
+        pos = linkEnd + 1;
+
+        string link = decodePercentEscapes(
+            string_view(htmlContent).substr(linkStart, linkEnd - linkStart));
+        size_t nameStart = link.find(categoryPrefix);
+        if (nameStart == string::npos)
+            continue;
+        nameStart += categoryPrefix.size();
+
+        string category = link.substr(nameStart, link.find_first_of("#?", nameStart) - nameStart);
+        if (category.size() >= 5 && category.compare(category.size() - 5, 5, ".html") == 0)
+            category.resize(category.size() - 5);
+        replace(category.begin(), category.end(), '_', ' ');
+
+        if (!category.empty())
+            categories.push_back(category);
+    }
+}
+
+/**
+ *@brief Puts html file into a single string. The file is read as bytes, so the UTF-8 text of
+ *       the articles is kept as is whatever the locale.
+ *
+ *@param filePath       path to file, in UTF-8
+
+ *@return string        raw html text
+
+ **/
+string HTMLParser::readHTMLFile(const string &filePath)
+{
+    ifstream file(filesystem::u8path(filePath), ios::binary);
+    if (!file.is_open())
+    {
+        cerr << "Failed to open file: " << filePath << endl;
+        return "";
+    }
+
+    string htmlContent((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    file.close();
+
+    return htmlContent;
+}
+
+/* STRING MANAGEMENT */
+
+/**
+ *@brief The character ' was problematic when working with SQL. Our solution was to add another ' next
+ *       to the ' in the html text to "escape" in SQL. We could also have eliminated de ' character but
+ *       this conflicted with finding path names when answering the user's search
+ *
+ *@param input                  string to rectify
+ *@param targetChar             character to detect
+ *@param charToAdd              character to add
+
+ *@return string                rectified string
+ **/
+string HTMLParser::addCharacterNextTo(const string &input, char targetChar,
+                                      char charToAdd)
+{
+    string result;
+    for (size_t i = 0; i < input.length(); i++)
+    {
+        result += input[i];
+        if (input[i] == targetChar)
+        {
+            result += charToAdd;
+        }
+    }
+    return result;
+}
+
+/**
+ *@brief Counts space characters in a string to approximate number of words in a file
+         This could have been implemented with a sql search as well.
+ *
+ *@param input                  string to count spaces in
+ *
+ *@return int                   count
+ **/
+int HTMLParser::countSpaceCharacters(const string& input) 
+{
+    int count = 0;
+
+    for (char c : input) {
+        if (c == ' ') {
+            count++;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file HTMLParser.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief HTML conditioning shared by the search engine, the indexer and the benchmarks
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef HTMLPARSER_H
+#define HTMLPARSER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#define HEADER 1
+#define NON_HEADER 2
+
+class HTMLParser
+{
+public:
+    /*HTML processing*/
+    static std::pair<std::string, std::string> filterHTMLContent(const std::string &htmlContent);
+    static std::string parseHTMLContent(const std::string &htmlContent);
+    static void extractWikiLinks(const std::string &htmlContent,
+                                 std::vector<std::string> &pageNames);
+    static void extractCategories(const std::string &htmlContent,
+                                  std::vector<std::string> &categories);
+    static std::string readHTMLFile(const std::string &filePath);
+
+    /*String Management*/
+    static std::string addCharacterNextTo(const std::string &input, char targetChar,
+                                          char charToAdd);
+    static int countSpaceCharacters(const std::string &input);
+};
+
+#endif
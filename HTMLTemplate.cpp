@@ -0,0 +1,182 @@
+/**
+ * @file HTMLTemplate.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Precompiled HTML templates with escaped slots
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * A template is plain HTML with named slots, e.g. "<a href=\"{{href}}\">{{title}}</a>". It is
+ * split once into static segments and slot numbers, so rendering is a sequence of appends into
+ * the caller's buffer. Every slot is HTML-escaped: user input and file names can never break
+ * out of the markup.
+ *
+ */
+
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HTML_ESCAPE_SSE2
+#endif
+
+#include "HTMLTemplate.h"
+
+using namespace std;
+
+/**
+ *@brief Gets the entity that replaces a character, nullptr if it needs no escaping
+ **/
+static inline const char *getEntity(char c)
+{
+    switch (c)
+    {
+    case '&': return "&amp;";
+    case '<': return "&lt;";
+    case '>': return "&gt;";
+    case '"': return "&quot;";
+    case '\'': return "&#39;";
+    default: return nullptr;
+    }
+}
+
+/**
+ *@brief class constructor. Compiles the template.
+ *
+ *@param source         template text, slots are written as {{name}}
+ *@param slotNames      names of the slots, in the order their values are passed to render()
+ **/
+HTMLTemplate::HTMLTemplate(string_view source, initializer_list<string_view> slotNames)
+{
+    staticSize = 0;
+    size_t position = 0;
+
+    while (true)
+    {
+        size_t slotStart = source.find("{{", position);
+        size_t slotEnd = (slotStart == string_view::npos) ? string_view::npos :
+                                                             source.find("}}", slotStart + 2);
+        if (slotEnd == string_view::npos)
+        {
+            segments.push_back({string(source.substr(position)), -1});
+            staticSize += source.size() - position;
+            break;
+        }
+
+        string_view slotName = source.substr(slotStart + 2, slotEnd - slotStart - 2);
+        int slot = -1;
+        int slotIndex = 0;
+        for (auto name : slotNames)
+        {
+            if (name == slotName)
+                slot = slotIndex;
+            slotIndex++;
+        }
+
+        if (slot < 0)
+        {
+            // Kept as text so that the mistake shows up in the page
+            cerr << "Unknown template slot: " << slotName << endl;
+            segments.push_back({string(source.substr(position, slotEnd + 2 - position)), -1});
+            staticSize += slotEnd + 2 - position;
+        }
+        else
+        {
+            segments.push_back({string(source.substr(position, slotStart - position)), slot});
+            staticSize += slotStart - position;
+        }
+
+        position = slotEnd + 2;
+    }
+}
+
+/**
+ *@brief Gets the size of the template without its slots, to pre-size the output buffer
+ **/
+size_t HTMLTemplate::getStaticSize() const
+{
+    return staticSize;
+}
+
+/**
+ *@brief Appends the template to a buffer
+ *
+ *@param output         buffer the page is being rendered into
+ *@param values         value of every slot, in the order of the constructor slot names
+ **/
+void HTMLTemplate::render(ArenaString &output, initializer_list<string_view> values) const
+{
+    const string_view *slotValues = values.begin();
+
+    for (const auto &segment : segments)
+    {
+        output += segment.text;
+        if (segment.slot >= 0 && segment.slot < (int)values.size())
+            escapeHTML(slotValues[segment.slot], output);
+    }
+}
+
+/**
+ *@brief Appends a text to a buffer replacing &, <, >, " and ' by their entities. Runs of
+ *       characters that need no escaping are copied with a single append; with SSE2 they are
+ *       found 16 bytes at a time.
+ *
+ *@param text           text to escape
+ *@param output         buffer the escaped text is appended to
+ **/
+void HTMLTemplate::escapeHTML(string_view text, ArenaString &output)
+{
+    const char *data = text.data();
+    size_t size = text.size();
+    size_t runStart = 0;
+    size_t i = 0;
+
+#ifdef HTML_ESCAPE_SSE2
+    const __m128i ampersand = _mm_set1_epi8('&');
+    const __m128i lessThan = _mm_set1_epi8('<');
+    const __m128i greaterThan = _mm_set1_epi8('>');
+    const __m128i doubleQuote = _mm_set1_epi8('"');
+    const __m128i singleQuote = _mm_set1_epi8('\'');
+
+    while (i + 16 <= size)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i matches = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, ampersand), _mm_cmpeq_epi8(chunk, lessThan)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, greaterThan),
+                         _mm_or_si128(_mm_cmpeq_epi8(chunk, doubleQuote),
+                                      _mm_cmpeq_epi8(chunk, singleQuote))));
+
+        if (_mm_movemask_epi8(matches) == 0)
+        {
+            i += 16;
+            continue;
+        }
+
+        // Only chunks that contain something to escape are looked at byte by byte
+        for (size_t end = i + 16; i < end; i++)
+        {
+            const char *entity = getEntity(data[i]);
+            if (!entity)
+                continue;
+
+            output.append(data + runStart, i - runStart);
+            output += entity;
+            runStart = i + 1;
+        }
+    }
+#endif
+
+    for (; i < size; i++)
+    {
+        const char *entity = getEntity(data[i]);
+        if (!entity)
+            continue;
+
+        output.append(data + runStart, i - runStart);
+        output += entity;
+        runStart = i + 1;
+    }
+
+    output.append(data + runStart, size - runStart);
+}
@@ -0,0 +1,42 @@
+/**
+ * @file HTMLTemplate.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Precompiled HTML templates with escaped slots
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef HTMLTEMPLATE_H
+#define HTMLTEMPLATE_H
+
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "RequestArena.h"
+
+class HTMLTemplate
+{
+public:
+    HTMLTemplate(std::string_view source, std::initializer_list<std::string_view> slotNames = {});
+
+    size_t getStaticSize() const;
+    void render(ArenaString &output, std::initializer_list<std::string_view> values = {}) const;
+
+    static void escapeHTML(std::string_view text, ArenaString &output);
+
+private:
+    struct Segment
+    {
+        std::string text;
+        int slot; // slot rendered after the text, -1 if none
+    };
+
+    std::vector<Segment> segments;
+    size_t staticSize;
+};
+
+#endif
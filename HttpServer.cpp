@@ -9,10 +9,38 @@
  *
  */
 
+#include <thread>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
 #include "HttpServer.h"
+#include "Metrics.h"
 
 using namespace std;
 
+/**
+ * @brief State of a request while it is being answered. A suspended request is answered by a
+ *        search worker and queued by the daemon thread once the connection is resumed.
+ */
+struct HttpRequest
+{
+    string url;
+    HttpArguments arguments;
+    bool isAdminRequest = false;
+
+    bool isSuspended = false;
+    uint64_t queueTime = 0;
+    unsigned int statusCode = MHD_HTTP_OK;
+    const char *contentType = NULL;
+    const char *retryAfter = NULL;
+    vector<char> response;
+};
+
 /**
  * @brief GetArgument callback for libmicrohttp
  *
@@ -38,6 +66,80 @@ static MHD_Result httpGetArgumentCallback(void *cls,
     return MHD_YES;
 }
 
+/**
+ * @brief Frees the state of a request once libmicrohttpd is done with the connection
+ */
+static void httpRequestCompletedCallback(void *cls,
+                                         struct MHD_Connection *connection,
+                                         void **con_cls,
+                                         enum MHD_RequestTerminationCode toe)
+{
+    delete (HttpRequest *)*con_cls;
+    *con_cls = NULL;
+}
+
+/**
+ * @brief Checks whether a request comes from the machine the server runs on
+ *
+ * @param connection The connection
+ * @return true for 127.0.0.0/8 and ::1, also as IPv4-mapped IPv6 addresses
+ */
+static bool isLoopbackClient(struct MHD_Connection *connection)
+{
+    const MHD_ConnectionInfo *info =
+        MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+    if (!info || !info->client_addr)
+        return false;
+
+    if (info->client_addr->sa_family == AF_INET)
+    {
+        const sockaddr_in *address = (const sockaddr_in *)info->client_addr;
+        return (ntohl(address->sin_addr.s_addr) >> 24) == 127;
+    }
+
+    if (info->client_addr->sa_family == AF_INET6)
+    {
+        const unsigned char *bytes = ((const sockaddr_in6 *)info->client_addr)->sin6_addr.s6_addr;
+        bool isZeroPrefix = true;
+        for (int i = 0; i < 10; i++)
+            isZeroPrefix = isZeroPrefix && !bytes[i];
+        if (!isZeroPrefix)
+            return false;
+
+        bool isIPv6Loopback = !bytes[10] && !bytes[11] && !bytes[12] && !bytes[13] &&
+                              !bytes[14] && bytes[15] == 1;
+        bool isIPv4Loopback = bytes[10] == 0xff && bytes[11] == 0xff && bytes[12] == 127;
+        return isIPv6Loopback || isIPv4Loopback;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Sends the response of a request
+ *
+ * @param connection The connection
+ * @param request The answered request
+ * @return MHD_Result
+ */
+static MHD_Result queueResponse(struct MHD_Connection *connection, HttpRequest &request)
+{
+    MHD_Response *mhdResponse = MHD_create_response_from_buffer(request.response.size(),
+                                                                (void *)request.response.data(),
+                                                                MHD_RESPMEM_MUST_COPY);
+    if (request.contentType)
+        MHD_add_response_header(mhdResponse, MHD_HTTP_HEADER_CONTENT_TYPE, request.contentType);
+    if (request.retryAfter)
+        MHD_add_response_header(mhdResponse, MHD_HTTP_HEADER_RETRY_AFTER, request.retryAfter);
+
+    bool isResponseQueued = MHD_queue_response(connection, request.statusCode, mhdResponse);
+    MHD_destroy_response(mhdResponse);
+
+    Metrics::addToCounter(COUNTER_BYTES_SERVED, request.response.size());
+
+    return isResponseQueued ? MHD_YES : MHD_NO;
+}
+
 /**
  * @brief HTTP request handler for libmicrohttpd
  *
@@ -63,72 +165,172 @@ MHD_Result httpRequestHandlerCallback(void *cls,
     HttpServer *server = (HttpServer *)cls;
 
     // Headers are invalid on first call, wait for second call.
-    if (con_cls == NULL)
+    if (*con_cls == NULL)
     {
-        *con_cls = cls;
+        *con_cls = new HttpRequest();
 
         return MHD_YES;
     }
 
-    // We only handle get requests
-    if ((string(method) == "GET"))
+    HttpRequest &request = *(HttpRequest *)*con_cls;
+
+    // Called again after a search worker resumed the connection: the response is ready
+    if (request.isSuspended)
     {
+        request.isSuspended = false;
+        server->requestsInFlight--;
+
+        return queueResponse(connection, request);
+    }
+
+    // Admin actions are POST requests from this machine, their body is ignored
+    if (string(method) == MHD_HTTP_METHOD_POST)
+    {
+        if (*upload_data_size)
+        {
+            *upload_data_size = 0;
+            return MHD_YES;
+        }
+
+        if (!isLoopbackClient(connection))
+        {
+            request.statusCode = MHD_HTTP_FORBIDDEN;
+            string errorResponse = "<html><body><h1>403 Forbidden</h1></body></html>";
+            request.response.assign(errorResponse.begin(), errorResponse.end());
+            return queueResponse(connection, request);
+        }
+
+        request.url = url;
+        request.isAdminRequest = true;
+        server->handleRequest(request);
+        return queueResponse(connection, request);
+    }
+
+    // Everything else is a get request
+    if (string(method) == MHD_HTTP_METHOD_GET)
+    {
+        server->requestsInFlight++;
+        StageTimer requestParseTimer(STAGE_REQUEST_PARSE);
+
         // Get arguments
-        HttpArguments arguments;
         MHD_get_connection_values(connection, MHD_GET_ARGUMENT_KIND, httpGetArgumentCallback, 
-                                  &arguments);
-
-        // Make response
-        int statusCode;
-        vector<char> response;
+                                  &request.arguments);
 
         // Clean URL
-        string cleanedUrl = url;
-        if (cleanedUrl == "")
-            cleanedUrl = "/";
+        request.url = url;
+        if (request.url == "")
+            request.url = "/";
 
         // Convert directories to files
-        if (cleanedUrl.back() == '/')
-            cleanedUrl += "index.html";
+        if (request.url.back() == '/')
+            request.url += "index.html";
 
-        if (server->httpRequestHandler &&
-            server->httpRequestHandler->handleRequest(cleanedUrl, arguments, response))
-            statusCode = MHD_HTTP_FOUND;
-        else
+        requestParseTimer.stop();
+
+        // Searches are handed to a search worker so that a slow one does not hold up the
+        // static files and other searches this thread is serving. Static files never wait
+        // behind searches, and a search that would wait too long is turned away right away.
+        if (server->httpRequestHandler && server->httpRequestHandler->isAsynchronous(request.url))
         {
-            statusCode = MHD_HTTP_NOT_FOUND;
+            lock_guard<mutex> lock(server->searchWorkersMutex);
 
-            string errorResponse = "<html><body><h1>404 Not Found</h1></body></html>";
-            response.assign(errorResponse.begin(), errorResponse.end());
+            if (server->searchWorkers &&
+                server->queuedSearches >= server->admissionLimits.maxQueuedSearches)
+            {
+                server->rejectRequest(request, COUNTER_SHED_SEARCHES);
+                server->requestsInFlight--;
+
+                return queueResponse(connection, request);
+            }
+
+            if (server->searchWorkers)
+            {
+                request.isSuspended = true;
+                request.queueTime = Metrics::getTime();
+                server->queuedSearches++;
+                MHD_suspend_connection(connection);
+
+                HttpRequest *suspendedRequest = &request;
+                server->searchWorkers->submit([server, connection, suspendedRequest]() {
+                    server->queuedSearches--;
+
+                    uint64_t waitTime = Metrics::getTime() - suspendedRequest->queueTime;
+                    uint64_t deadline = server->admissionLimits.searchDeadline * 1000000ull;
+                    if (deadline && waitTime > deadline)
+                        server->rejectRequest(*suspendedRequest, COUNTER_EXPIRED_SEARCHES);
+                    else
+                        server->handleRequest(*suspendedRequest);
+
+                    MHD_resume_connection(connection);
+                });
+
+                return MHD_YES;
+            }
         }
 
-        MHD_Response *mhdResponse = MHD_create_response_from_buffer(response.size(),
-                                                                    (void *)response.data(),
-                                                                    MHD_RESPMEM_MUST_COPY);
-        bool isResponseQueued = MHD_queue_response(connection, statusCode, mhdResponse);
-        MHD_destroy_response(mhdResponse);
+        server->handleRequest(request);
+        server->requestsInFlight--;
 
-        return isResponseQueued ? MHD_YES : MHD_NO;
+        return queueResponse(connection, request);
     }
 
     return MHD_NO;
 }
 
-HttpServer::HttpServer(int port)
+/**
+ * @brief Class constructor
+ *
+ * @param port TCP port to listen on
+ * @param searchWorkerCount Threads that answer searches, i.e. the most searches that run at
+ *                          the same time (0 for one per core)
+ * @param admissionLimits Queue and deadline limits of the searches
+ */
+HttpServer::HttpServer(int port, int searchWorkerCount, const AdmissionLimits &admissionLimits) :
+requestsInFlight(0), admissionLimits(admissionLimits), queuedSearches(0)
 {
-    daemon = MHD_start_daemon(MHD_USE_INTERNAL_POLLING_THREAD,
-                              8000,
+    httpRequestHandler = NULL;
+    retryAfter = to_string(admissionLimits.retryAfter);
+
+    if (searchWorkerCount <= 0)
+        searchWorkerCount = thread::hardware_concurrency();
+    searchWorkers = make_unique<WorkStealingPool>(searchWorkerCount);
+
+    daemon = MHD_start_daemon(MHD_USE_INTERNAL_POLLING_THREAD | MHD_ALLOW_SUSPEND_RESUME,
+                              port,
                               NULL,
                               NULL,
                               httpRequestHandlerCallback,
                               this,
+                              MHD_OPTION_NOTIFY_COMPLETED,
+                              httpRequestCompletedCallback,
+                              NULL,
                               MHD_OPTION_END);
 
-    httpRequestHandler = NULL;
+    Metrics::setGauge("edaoogle_requests_in_flight", "Requests being processed",
+                      [this]() { return (double)requestsInFlight.load(); });
+    Metrics::setGauge("edaoogle_search_workers_queue_depth", "Searches waiting for a worker",
+                      [this]() {
+                          lock_guard<mutex> lock(searchWorkersMutex);
+                          return searchWorkers ? (double)searchWorkers->getQueueDepth() : 0.0;
+                      });
 }
 
 HttpServer::~HttpServer()
 {
+    Metrics::setGauge("edaoogle_requests_in_flight", "Requests being processed",
+                      []() { return 0.0; });
+    Metrics::setGauge("edaoogle_search_workers_queue_depth", "Searches waiting for a worker",
+                      []() { return 0.0; });
+
+    // Every suspended connection must be resumed before the daemon stops, so the workers
+    // finish what they have and any request that arrives meanwhile is answered in place
+    unique_ptr<WorkStealingPool> stoppingWorkers;
+    {
+        lock_guard<mutex> lock(searchWorkersMutex);
+        stoppingWorkers = move(searchWorkers);
+    }
+    stoppingWorkers.reset();
+
     if (daemon)
         MHD_stop_daemon(daemon);
 
@@ -144,3 +346,62 @@ void HttpServer::setHttpRequestHandler(HttpRequestHandler *httpRequestHandler)
 {
     this->httpRequestHandler = httpRequestHandler;
 }
+
+/**
+ * @brief Answers a request. Runs on the daemon thread or, for asynchronous requests, on a
+ *        search worker.
+ *
+ * @param request Parsed request, its response is filled in
+ */
+void HttpServer::handleRequest(HttpRequest &request)
+{
+    if (request.isAdminRequest)
+    {
+        if (httpRequestHandler &&
+            httpRequestHandler->handleAdminRequest(request.url, request.response))
+            request.statusCode = MHD_HTTP_OK;
+        else
+        {
+            request.statusCode = MHD_HTTP_NOT_FOUND;
+            Metrics::addToCounter(COUNTER_NOT_FOUND_RESPONSES);
+            string errorResponse = "<html><body><h1>404 Not Found</h1></body></html>";
+            request.response.assign(errorResponse.begin(), errorResponse.end());
+        }
+    }
+    else if (request.url == "/metrics")
+    {
+        string metrics;
+        Metrics::renderPrometheus(metrics);
+        request.response.assign(metrics.begin(), metrics.end());
+
+        request.statusCode = MHD_HTTP_OK;
+        request.contentType = "text/plain; version=0.0.4";
+    }
+    else if (httpRequestHandler &&
+        httpRequestHandler->handleRequest(request.url, request.arguments, request.response))
+        request.statusCode = MHD_HTTP_OK;
+    else
+    {
+        request.statusCode = MHD_HTTP_NOT_FOUND;
+        Metrics::addToCounter(COUNTER_NOT_FOUND_RESPONSES);
+
+        string errorResponse = "<html><body><h1>404 Not Found</h1></body></html>";
+        request.response.assign(errorResponse.begin(), errorResponse.end());
+    }
+}
+
+/**
+ * @brief Answers a search that was not admitted with 503, telling the client when to retry
+ *
+ * @param request Request to reject, its response is filled in
+ * @param reason Counter of the reason it was rejected
+ */
+void HttpServer::rejectRequest(HttpRequest &request, MetricCounter reason)
+{
+    request.statusCode = MHD_HTTP_SERVICE_UNAVAILABLE;
+    request.retryAfter = retryAfter.c_str();
+    Metrics::addToCounter(reason);
+
+    string errorResponse = "<html><body><h1>503 Service Unavailable</h1></body></html>";
+    request.response.assign(errorResponse.begin(), errorResponse.end());
+}
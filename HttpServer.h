@@ -14,23 +14,68 @@
 
 #include <microhttpd.h>
 
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "Metrics.h"
+#include "WorkStealingPool.h"
+
 typedef std::map<std::string, std::string> HttpArguments;
 
+#define DEFAULT_MAX_QUEUED_SEARCHES 64
+#define DEFAULT_SEARCH_DEADLINE_MS 2000
+#define DEFAULT_RETRY_AFTER_SECONDS 1
+
+/**
+ * @brief Limits that keep searches from piling up past saturation. At most one search per
+ *        search worker runs at a time; the rest wait in a bounded queue.
+ */
+struct AdmissionLimits
+{
+    // Searches waiting for a worker; beyond this they are answered with 503 right away
+    int maxQueuedSearches = DEFAULT_MAX_QUEUED_SEARCHES;
+    // Milliseconds a search may wait for a worker before it is answered with 503, 0 for no limit
+    int searchDeadline = DEFAULT_SEARCH_DEADLINE_MS;
+    // Seconds sent in the Retry-After header of a 503
+    int retryAfter = DEFAULT_RETRY_AFTER_SECONDS;
+};
+
 class HttpRequestHandler
 {
 public:
     virtual bool handleRequest(std::string url, HttpArguments arguments, 
                                std::vector<char> &response) = 0;
+
+    /**
+     * @brief Requests that may take long are answered by a search worker instead of the
+     *        thread that serves the connections
+     */
+    virtual bool isAsynchronous(const std::string &url)
+    {
+        return false;
+    }
+
+    /**
+     * @brief Admin actions, which change or report the state of the server. They are only
+     *        taken as POST requests from the loopback interface; everything else is a GET.
+     */
+    virtual bool handleAdminRequest(const std::string &url, std::vector<char> &response)
+    {
+        return false;
+    }
 };
 
+struct HttpRequest;
+
 class HttpServer
 {
 public:
-    HttpServer(int port);
+    HttpServer(int port, int searchWorkerCount = 0,
+               const AdmissionLimits &admissionLimits = AdmissionLimits());
     ~HttpServer();
 
     bool isRunning();
@@ -39,6 +84,18 @@ public:
 private:
     MHD_Daemon *daemon;
     HttpRequestHandler *httpRequestHandler;
+    std::atomic<int> requestsInFlight;
+
+    AdmissionLimits admissionLimits;
+    std::string retryAfter;
+    std::atomic<int> queuedSearches;
+
+    // Search workers stop taking requests before the daemon is stopped
+    std::mutex searchWorkersMutex;
+    std::unique_ptr<WorkStealingPool> searchWorkers;
+
+    void handleRequest(HttpRequest &request);
+    void rejectRequest(HttpRequest &request, MetricCounter reason);
 
     // Grant private access to libmicrohttp request handler
     friend MHD_Result httpRequestHandlerCallback(void *cls, struct MHD_Connection *connection,
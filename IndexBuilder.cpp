@@ -0,0 +1,672 @@
+/**
+ * @file IndexBuilder.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Builds, validates and checksums the shard files of an index
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * An index artifact is the set of shard files of one generation plus a manifest that lists
+ * them. It is written either by edaindex on a build host or by edahttpd when it rebuilds its
+ * own index. A server only loads an artifact whose files match the sizes and checksums of the
+ * manifest. Example manifest (wiki_4_shards.manifest):
+ *      edaoogle-index 1
+ *      schema 4
+ *      generation 3
+ *      slice 0 1
+ *      shards 4
+ *      shard wiki_0_of_4_gen3.db 52183040 8c1f0d6e5a4b3c21 321
+ *      ...
+ *
+ * Before the shards are built, the links between the articles are extracted into a link graph
+ * and its PageRank becomes the static rank of every article. The graph always covers the whole
+ * wiki, so the static ranks of the slices of a distributed index can be compared.
+ *
+ * Near-duplicate articles are then found over the whole wiki as well (see SimHash) and every
+ * cluster of them is collapsed into its article with the highest static rank: the others are
+ * left out of the shards, so they take no space in the index, no time in a search and no
+ * place in the results. Terms are weighted by tf-idf, so the text that every article shares
+ * (menus, footers) does not make all short articles look alike.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+
+#include <sqlite3.h>
+
+#include "Analyzer.h"
+#include "HTMLParser.h"
+#include "IndexBuilder.h"
+#include "LinkGraph.h"
+#include "SimHash.h"
+#include "TermDictionary.h"
+
+using namespace std;
+
+/**
+ *@brief class constructor
+ *
+ *@param homePath       path to the folder with the html files
+ *@param indexPath      folder the shard files and the manifest are kept in
+ *@param shardCount     number of document shards the index is split into
+ *@param sliceIndex     slice of the corpus indexed in a distributed index
+ *@param sliceCount     number of slices the corpus is split into (1 to index all of it)
+ **/
+IndexBuilder::IndexBuilder(string homePath, string indexPath, int shardCount, int sliceIndex,
+                           int sliceCount)
+{
+    this->homePath = homePath;
+    this->indexPath = indexPath;
+    this->shardCount = shardCount;
+    this->sliceIndex = sliceIndex;
+    this->sliceCount = (sliceCount < 1) ? 1 : sliceCount;
+
+    sliceName = "";
+    if (this->sliceCount > 1)
+        sliceName = "_slice_" + to_string(sliceIndex) + "_of_" + to_string(this->sliceCount);
+}
+
+int IndexBuilder::getShardCount()
+{
+    return shardCount;
+}
+
+/**
+ *@brief Gets the file of a shard in a generation. Generation 0 keeps the original names.
+ **/
+string IndexBuilder::getShardPath(int shardIndex, uint64_t generation)
+{
+    string fileName = DB_NAME_PREFIX + sliceName + "_" + to_string(shardIndex) + "_of_" +
+                      to_string(shardCount);
+    if (generation > 0)
+        fileName += "_gen" + to_string(generation);
+
+    return (filesystem::u8path(indexPath) / (fileName + ".db")).u8string();
+}
+
+/**
+ *@brief Gets the manifest of this slice and shard count
+ **/
+string IndexBuilder::getManifestPath()
+{
+    string fileName = DB_NAME_PREFIX + sliceName + "_" + to_string(shardCount) +
+                      "_shards.manifest";
+
+    return (filesystem::u8path(indexPath) / fileName).u8string();
+}
+
+/**
+ *@brief Lists the shard files of this slice and shard count, of every generation
+ *
+ *@return vector        generation vs path of every file
+ **/
+vector<pair<uint64_t, string>> IndexBuilder::getShardFiles()
+{
+    vector<pair<uint64_t, string>> shardFiles;
+    regex shardFilePattern(DB_NAME_PREFIX + sliceName + "_[0-9]+_of_" + to_string(shardCount) +
+                           "(_gen([0-9]+))?\\.db");
+
+    error_code error;
+    for (const auto &file : filesystem::directory_iterator(filesystem::u8path(indexPath), error))
+    {
+        string fileName = file.path().filename().u8string();
+        smatch match;
+        if (!regex_match(fileName, match, shardFilePattern))
+            continue;
+
+        uint64_t generation = match[2].matched ? stoull(match[2].str()) : 0;
+        shardFiles.emplace_back(generation, file.path().u8string());
+    }
+
+    return shardFiles;
+}
+
+/**
+ *@brief Gets the newest generation with any file on disk, 0 if there is none
+ **/
+uint64_t IndexBuilder::getLatestGeneration()
+{
+    uint64_t generation = 0;
+    for (auto &shardFile : getShardFiles())
+        generation = max(generation, shardFile.first);
+
+    return generation;
+}
+
+/**
+ *@brief Extracts the links between all the articles of the wiki and computes their PageRank,
+ *       which buildShard() stores as the static rank of every article. Articles get a static
+ *       rank of 0 if this is not called first.
+ *
+ *@param pool           threads the html files are read and the PageRank is computed with
+ *@param stopping       if given, gives up as soon as it becomes true
+ *
+ *@return bool          true if the static ranks were computed
+ **/
+bool IndexBuilder::computeStaticRanks(WorkStealingPool &pool, const atomic<bool> *stopping)
+{
+    vector<filesystem::path> files = getWikiFiles();
+    unordered_map<string, uint32_t> pageNumbers;
+    for (uint32_t page = 0; page < files.size(); page++)
+        pageNumbers.emplace(files[page].filename().u8string(), page);
+
+    int taskCount = pool.getThreadCount();
+    vector<vector<pair<uint32_t, uint32_t>>> taskLinks(taskCount);
+    vector<function<void()>> linkTasks;
+    for (int task = 0; task < taskCount; task++)
+    {
+        linkTasks.push_back([&, task]() {
+            vector<string> pageNames;
+
+            for (size_t page = task; page < files.size(); page += taskCount)
+            {
+                if (stopping && *stopping)
+                    return;
+
+                HTMLParser::extractWikiLinks(HTMLParser::readHTMLFile(files[page].u8string()),
+                                             pageNames);
+
+                for (const auto &pageName : pageNames)
+                {
+                    auto target = pageNumbers.find(pageName);
+                    if (target != pageNumbers.end())
+                        taskLinks[task].emplace_back((uint32_t)page, target->second);
+                }
+            }
+        });
+    }
+
+    pool.run(linkTasks);
+    if (stopping && *stopping)
+        return false;
+
+    vector<pair<uint32_t, uint32_t>> links;
+    for (auto &linksOfTask : taskLinks)
+    {
+        links.insert(links.end(), linksOfTask.begin(), linksOfTask.end());
+        linksOfTask = vector<pair<uint32_t, uint32_t>>();
+    }
+
+    LinkGraph linkGraph((uint32_t)files.size(), links);
+    vector<float> ranks;
+    int iterations = linkGraph.computePageRank(pool, ranks);
+
+    staticRanks.clear();
+    for (uint32_t page = 0; page < files.size(); page++)
+        staticRanks.emplace(files[page].filename().u8string(), ranks[page]);
+
+    fprintf(stdout, "Static ranks computed (%u articles, %zu links, %d iterations)\n",
+            linkGraph.getPageCount(), linkGraph.getLinkCount(), iterations);
+
+    return true;
+}
+
+/**
+ *@brief Finds the near-duplicate articles of the wiki and the article each one collapses into,
+ *       so that buildShard() leaves them out. Should be called after computeStaticRanks().
+ *
+ *@param pool           threads the articles are read with
+ *@param stopping       if given, the detection gives up as soon as it becomes true
+ *
+ *@return bool          true if the near-duplicates were found
+ **/
+bool IndexBuilder::findDuplicates(WorkStealingPool &pool, const atomic<bool> *stopping)
+{
+    duplicates.clear();
+
+    vector<filesystem::path> files = getWikiFiles();
+    uint32_t pageCount = (uint32_t)files.size();
+
+    // Terms are read twice, first for their document frequencies and then for the fingerprints,
+    // since keeping the terms of every article in between would not fit a large wiki
+    auto readTerms = [&](uint32_t page, vector<uint64_t> &termHashes) {
+        vector<string> terms;
+        string htmlContent = HTMLParser::readHTMLFile(files[page].u8string());
+        Analyzer::analyze(HTMLParser::parseHTMLContent(htmlContent), terms);
+
+        termHashes.clear();
+        for (const auto &term : terms)
+            termHashes.push_back(TermDictionary::getHash(term));
+        sort(termHashes.begin(), termHashes.end());
+    };
+
+    int taskCount = pool.getThreadCount();
+    vector<unordered_map<uint64_t, uint32_t>> taskFrequencies(taskCount);
+    vector<function<void()>> frequencyTasks;
+    for (int task = 0; task < taskCount; task++)
+    {
+        frequencyTasks.push_back([&, task]() {
+            vector<uint64_t> termHashes;
+            for (uint32_t page = task; page < pageCount; page += taskCount)
+            {
+                if (stopping && *stopping)
+                    return;
+
+                readTerms(page, termHashes);
+                termHashes.erase(unique(termHashes.begin(), termHashes.end()), termHashes.end());
+                for (uint64_t termHash : termHashes)
+                    taskFrequencies[task][termHash]++;
+            }
+        });
+    }
+
+    pool.run(frequencyTasks);
+    if (stopping && *stopping)
+        return false;
+
+    unordered_map<uint64_t, uint32_t> &documentFrequencies = taskFrequencies[0];
+    for (int task = 1; task < taskCount; task++)
+    {
+        for (const auto &frequency : taskFrequencies[task])
+            documentFrequencies[frequency.first] += frequency.second;
+        taskFrequencies[task] = unordered_map<uint64_t, uint32_t>();
+    }
+
+    vector<uint64_t> fingerprints(pageCount, 0);
+    vector<char> isComparable(pageCount, false);
+    vector<function<void()>> fingerprintTasks;
+    for (int task = 0; task < taskCount; task++)
+    {
+        fingerprintTasks.push_back([&, task]() {
+            vector<uint64_t> termHashes;
+            vector<pair<uint64_t, double>> features;
+            for (uint32_t page = task; page < pageCount; page += taskCount)
+            {
+                if (stopping && *stopping)
+                    return;
+
+                readTerms(page, termHashes);
+
+                features.clear();
+                for (size_t i = 0, j; i < termHashes.size(); i = j)
+                {
+                    for (j = i; j < termHashes.size() && termHashes[j] == termHashes[i]; j++)
+                        ;
+
+                    // A page edited since the first pass can bring terms that were not counted
+                    auto documentFrequency = documentFrequencies.find(termHashes[i]);
+                    if (documentFrequency == documentFrequencies.end())
+                        continue;
+
+                    double idf = log((double)pageCount / documentFrequency->second);
+                    if (idf > 0)
+                        features.emplace_back(termHashes[i], (1 + log((double)(j - i))) * idf);
+                }
+
+                // The fingerprint of a stub is too coarse to tell it from other stubs
+                isComparable[page] = features.size() >= SIMHASH_MIN_TERMS;
+                fingerprints[page] = SimHash::getFingerprint(features);
+            }
+        });
+    }
+
+    pool.run(fingerprintTasks);
+    if (stopping && *stopping)
+        return false;
+
+    vector<uint32_t> clusters;
+    SimHash::findNearDuplicates(fingerprints, isComparable, clusters);
+
+    // Every cluster collapses into its highest ranked article, or its first one on a tie
+    auto getStaticRank = [&](uint32_t page) {
+        auto staticRank = staticRanks.find(files[page].filename().u8string());
+        return (staticRank != staticRanks.end()) ? staticRank->second : 0;
+    };
+
+    vector<uint32_t> canonicalPages(pageCount);
+    for (uint32_t page = 0; page < pageCount; page++)
+    {
+        canonicalPages[page] = page;
+
+        uint32_t &canonicalPage = canonicalPages[clusters[page]];
+        if (getStaticRank(page) > getStaticRank(canonicalPage))
+            canonicalPage = page;
+    }
+
+    vector<char> isCanonical(pageCount, false);
+    for (uint32_t page = 0; page < pageCount; page++)
+    {
+        uint32_t canonicalPage = canonicalPages[clusters[page]];
+        if (canonicalPage == page)
+            continue;
+
+        duplicates.emplace(files[page].filename().u8string(),
+                           files[canonicalPage].filename().u8string());
+        isCanonical[canonicalPage] = true;
+    }
+
+    fprintf(stdout, "Near-duplicates found (%zu articles collapsed into %zu)\n", duplicates.size(),
+            (size_t)count(isCanonical.begin(), isCanonical.end(), true));
+
+    return true;
+}
+
+/**
+ *@brief Parses every html file that belongs to a shard and writes that shard from scratch
+ *
+ *@param shard          shard to write, which is not being searched
+ *@param shardIndex     index of the shard
+ *@param stopping       if given, the build gives up as soon as it becomes true
+ *
+ *@return int           number of articles written, -1 if the shard was not written
+ **/
+int IndexBuilder::buildShard(IndexShard &shard, int shardIndex, const atomic<bool> *stopping)
+{
+    if (!shard.beginBuild())
+        return -1;
+
+    /* Iterate through all files in /wiki folder */
+    int articleCount = 0;
+    vector<string> categories;
+    filesystem::path folderPath = filesystem::u8path(homePath + "/wiki");
+    filesystem::directory_iterator fileIterator(folderPath);
+    for (const auto &file : fileIterator)
+    {
+        // The shard is left uncommitted, so it will not pass for built
+        if (stopping && *stopping)
+            return -1;
+
+        if (!file.is_regular_file())
+            continue;
+
+        string fileName = file.path().filename().u8string();
+        if (IndexShard::getSliceIndex(fileName, sliceCount) != sliceIndex ||
+            IndexShard::getShardIndex(fileName, shardCount, sliceCount) != shardIndex)
+            continue;
+
+        // Its canonical article is indexed instead
+        if (duplicates.count(fileName))
+            continue;
+
+        string htmlContent = HTMLParser::readHTMLFile(file.path().u8string());
+        string htmlCleanedContent = HTMLParser::parseHTMLContent(htmlContent);
+        // character ' in file names was conflictive with SQL
+        string correctedPath = HTMLParser::addCharacterNextTo(file.path().u8string(), '\'', '\'');
+
+        HTMLParser::extractCategories(htmlContent, categories);
+        string categoryList;
+        for (const auto &category : categories)
+            categoryList += category + "\n";
+
+        auto staticRank = staticRanks.find(fileName);
+        if (shard.addArticle(htmlCleanedContent, correctedPath,
+                             HTMLParser::countSpaceCharacters(htmlCleanedContent),
+                             (staticRank != staticRanks.end()) ? staticRank->second : 0,
+                             HTMLParser::addCharacterNextTo(categoryList, '\'', '\'')))
+            articleCount++;
+    }
+
+    if (!shard.endBuild())
+        return -1;
+
+    fprintf(stdout, "Shard %d built successfully (%d articles)\n", shardIndex, articleCount);
+
+    return articleCount;
+}
+
+/**
+ *@brief Checks that a shard file is consistent and holds every article it was built with
+ *
+ *@param shardIndex     index of the shard
+ *@param generation     generation of the shard
+ *@param articleCount   number of articles buildShard() wrote
+ *
+ *@return bool          true if the shard can be deployed
+ **/
+bool IndexBuilder::validateShard(int shardIndex, uint64_t generation, int articleCount)
+{
+    string databasePath = getShardPath(shardIndex, generation);
+    int storedArticleCount = 0;
+
+    if (!getShardStatistics(databasePath, storedArticleCount))
+        return false;
+
+    if (storedArticleCount != articleCount)
+    {
+        cerr << databasePath << " holds " << storedArticleCount << " articles instead of "
+             << articleCount << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ *@brief Writes the manifest of a generation whose shards are all built. The manifest is
+ *       replaced atomically, so a server never reads half of it.
+ *
+ *@param generation     generation to describe
+ *
+ *@return bool          true if the manifest was written
+ **/
+bool IndexBuilder::writeManifest(uint64_t generation)
+{
+    stringstream manifest;
+    manifest << "edaoogle-index " << INDEX_MANIFEST_VERSION << endl
+             << "schema " << INDEX_SCHEMA_VERSION << endl
+             << "generation " << generation << endl
+             << "slice " << sliceIndex << " " << sliceCount << endl
+             << "shards " << shardCount << endl;
+
+    for (int i = 0; i < shardCount; i++)
+    {
+        string databasePath = getShardPath(i, generation);
+        int articleCount = 0;
+        if (!getShardStatistics(databasePath, articleCount))
+            return false;
+
+        char checksum[32];
+        snprintf(checksum, sizeof(checksum), "%016llx",
+                 (unsigned long long)getFileChecksum(databasePath));
+
+        error_code error;
+        manifest << "shard " << filesystem::u8path(databasePath).filename().u8string() << " "
+                 << filesystem::file_size(filesystem::u8path(databasePath), error) << " "
+                 << checksum << " " << articleCount << endl;
+    }
+
+    string manifestPath = getManifestPath();
+    string temporaryPath = manifestPath + ".tmp";
+    {
+        ofstream file(filesystem::u8path(temporaryPath), ios::trunc);
+        file << manifest.str();
+        if (!file.good())
+        {
+            cerr << "Failed to write " << temporaryPath << endl;
+            return false;
+        }
+    }
+
+    error_code error;
+    filesystem::rename(filesystem::u8path(temporaryPath), filesystem::u8path(manifestPath), error);
+    if (error)
+    {
+        cerr << "Failed to write " << manifestPath << ": " << error.message() << endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool IndexBuilder::hasManifest()
+{
+    return filesystem::exists(filesystem::u8path(getManifestPath()));
+}
+
+/**
+ *@brief Checks that the manifest was written for this index layout and that every shard file
+ *       it lists is on disk with the same size and checksum
+ *
+ *@param generation     generation the manifest describes
+ *
+ *@return bool          true if the artifact can be loaded as it is
+ **/
+bool IndexBuilder::verifyManifest(uint64_t &generation)
+{
+    string manifestPath = getManifestPath();
+    ifstream file(filesystem::u8path(manifestPath));
+    if (!file.is_open())
+        return false;
+
+    string key;
+    int manifestVersion = 0;
+    int schemaVersion = 0;
+    int manifestSliceIndex = -1;
+    int manifestSliceCount = 0;
+    int manifestShardCount = 0;
+    int listedShards = 0;
+
+    while (file >> key)
+    {
+        if (key == "edaoogle-index")
+            file >> manifestVersion;
+        else if (key == "schema")
+            file >> schemaVersion;
+        else if (key == "generation")
+            file >> generation;
+        else if (key == "slice")
+            file >> manifestSliceIndex >> manifestSliceCount;
+        else if (key == "shards")
+            file >> manifestShardCount;
+        else if (key == "shard")
+        {
+            string fileName;
+            uintmax_t size;
+            string checksum;
+            int articleCount;
+            file >> fileName >> size >> checksum >> articleCount;
+
+            string databasePath = getShardPath(listedShards, generation);
+            if (filesystem::u8path(databasePath).filename().u8string() != fileName)
+            {
+                cerr << manifestPath << ": unexpected shard " << fileName << endl;
+                return false;
+            }
+
+            error_code error;
+            char fileChecksum[32];
+            snprintf(fileChecksum, sizeof(fileChecksum), "%016llx",
+                     (unsigned long long)getFileChecksum(databasePath));
+            if (filesystem::file_size(filesystem::u8path(databasePath), error) != size ||
+                checksum != fileChecksum)
+            {
+                cerr << manifestPath << ": " << fileName << " is missing or corrupt" << endl;
+                return false;
+            }
+
+            listedShards++;
+        }
+        else
+            getline(file, key);
+    }
+
+    if (manifestVersion != INDEX_MANIFEST_VERSION || schemaVersion != INDEX_SCHEMA_VERSION ||
+        manifestSliceIndex != sliceIndex || manifestSliceCount != sliceCount ||
+        manifestShardCount != shardCount || listedShards != shardCount)
+    {
+        cerr << manifestPath << " was written for another index layout" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ *@brief FNV-1a over the contents of a file, 64 bits
+ *
+ *@return uint64_t      checksum, 0 if the file cannot be read
+ **/
+uint64_t IndexBuilder::getFileChecksum(const string &filePath)
+{
+    ifstream file(filesystem::u8path(filePath), ios::binary);
+    if (!file.is_open())
+        return 0;
+
+    uint64_t hash = 14695981039346656037ull;
+    vector<char> buffer(1 << 16);
+
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0)
+    {
+        streamsize byteCount = file.gcount();
+        for (streamsize i = 0; i < byteCount; i++)
+        {
+            hash ^= (unsigned char)buffer[i];
+            hash *= 1099511628211ull;
+        }
+    }
+
+    return hash;
+}
+
+/**
+ *@brief Lists the html files of the wiki, sorted by name, so that pages are numbered the same
+ *       way whatever the directory order
+ **/
+vector<filesystem::path> IndexBuilder::getWikiFiles()
+{
+    vector<filesystem::path> files;
+    error_code error;
+    for (const auto &file : filesystem::directory_iterator(filesystem::u8path(homePath + "/wiki"),
+                                                           error))
+    {
+        if (file.is_regular_file())
+            files.push_back(file.path());
+    }
+
+    sort(files.begin(), files.end());
+
+    return files;
+}
+
+/**
+ *@brief Runs the SQLite integrity check on a shard file and counts its articles
+ *
+ *@param databasePath   shard file
+ *@param articleCount   number of articles in the shard
+ *
+ *@return bool          true if the file is consistent and has the current schema
+ **/
+bool IndexBuilder::getShardStatistics(const string &databasePath, int &articleCount)
+{
+    sqlite3 *database;
+    if (sqlite3_open_v2(databasePath.c_str(), &database, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        cerr << "Failed to open database: " << sqlite3_errmsg(database) << endl;
+        sqlite3_close(database);
+        return false;
+    }
+
+    const char *queries[] = {"PRAGMA integrity_check;", "PRAGMA user_version;",
+                             "SELECT COUNT(*) FROM ARTICLES;"};
+    string answers[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        sqlite3_stmt *statement;
+        if (sqlite3_prepare_v2(database, queries[i], -1, &statement, nullptr) != SQLITE_OK)
+            break;
+        if (sqlite3_step(statement) == SQLITE_ROW && sqlite3_column_text(statement, 0))
+            answers[i] = (const char *)sqlite3_column_text(statement, 0);
+        sqlite3_finalize(statement);
+    }
+
+    sqlite3_close(database);
+
+    if (answers[0] != "ok" || answers[1] != to_string(INDEX_SCHEMA_VERSION) || answers[2].empty())
+    {
+        cerr << databasePath << " failed validation (integrity: " << answers[0]
+             << ", schema: " << answers[1] << ")" << endl;
+        return false;
+    }
+
+    articleCount = stoi(answers[2]);
+
+    return true;
+}
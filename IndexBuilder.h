@@ -0,0 +1,71 @@
+/**
+ * @file IndexBuilder.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Builds, validates and checksums the shard files of an index
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef INDEXBUILDER_H
+#define INDEXBUILDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "IndexShard.h"
+#include "WorkStealingPool.h"
+
+#define DB_NAME_PREFIX "wiki"
+
+// Bump whenever the manifest layout changes
+#define INDEX_MANIFEST_VERSION 1
+
+class IndexBuilder
+{
+public:
+    IndexBuilder(std::string homePath, std::string indexPath, int shardCount,
+                 int sliceIndex = 0, int sliceCount = 1);
+
+    int getShardCount();
+    std::string getShardPath(int shardIndex, uint64_t generation);
+    std::string getManifestPath();
+    std::vector<std::pair<uint64_t, std::string>> getShardFiles();
+    uint64_t getLatestGeneration();
+
+    bool computeStaticRanks(WorkStealingPool &pool, const std::atomic<bool> *stopping = nullptr);
+    bool findDuplicates(WorkStealingPool &pool, const std::atomic<bool> *stopping = nullptr);
+    int buildShard(IndexShard &shard, int shardIndex, const std::atomic<bool> *stopping = nullptr);
+    bool validateShard(int shardIndex, uint64_t generation, int articleCount);
+
+    bool writeManifest(uint64_t generation);
+    bool hasManifest();
+    bool verifyManifest(uint64_t &generation);
+
+    static uint64_t getFileChecksum(const std::string &filePath);
+
+private:
+    std::vector<std::filesystem::path> getWikiFiles();
+    bool getShardStatistics(const std::string &databasePath, int &articleCount);
+
+    std::string homePath;
+    std::string indexPath;
+    int shardCount;
+    int sliceIndex;
+    int sliceCount;
+    // Shards of different slices may share the index folder
+    std::string sliceName;
+
+    // PageRank of every article of the wiki (not only of this slice), by file name
+    std::unordered_map<std::string, float> staticRanks;
+    // Near-duplicate articles of the wiki, by file name, with the article they collapse into
+    std::unordered_map<std::string, std::string> duplicates;
+};
+
+#endif
@@ -0,0 +1,961 @@
+/**
+ * @file IndexShard.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief One document shard of the EDAoogle index, stored in its own SQLite database
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Every shard owns a disjoint slice of the documents in www/wiki. A document always lands in the
+ * same shard (the shard is picked by hashing its file name), so a single shard can be deleted and
+ * rebuilt without touching the others.
+ *
+ * Every article is stored with its static rank (its PageRank in the link graph of the whole
+ * wiki, see IndexBuilder::computeStaticRanks). When the shard is loaded its documents are
+ * numbered by decreasing static rank, so the searches, which break ties by document number,
+ * prefer the more important article and find good results early.
+ *
+ * Searches can be restricted by attributes of the articles: their length (len=short, medium
+ * or long), the initial of their title (initial=a) and their categories (cat=Mamíferos). When
+ * the shard is loaded every value of every attribute gets a Roaring bitmap of its documents;
+ * the bitmaps of a search are intersected and the result restricts the candidates before
+ * anything is scored, instead of more LIKE clauses over ARTICLES.
+ *
+ * The inverted index of a shard can be shed to stay within a memory budget (see
+ * EDAoogleHttpRequestHandler). searchIndex() then reports that the index is gone and the
+ * search scans the articles text with searchText() instead, which takes no memory beyond the
+ * scores of the documents.
+ *
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+
+#include "Analyzer.h"
+#include "IndexShard.h"
+#include "Metrics.h"
+#include "QueryPlanner.h"
+#include "SlowQueryLog.h"
+#include "Tokenizer.h"
+
+using namespace std;
+
+// Candidates past this many are not looked up by ROWID: the whole table is scanned and the
+// rows of other documents are skipped, since a long IN list costs more to build, parse and
+// seek through than a scan
+#define MAX_ROWID_LOOKUPS 2048
+
+struct TermFrequencyQuery
+{
+    const vector<pair<int64_t, uint32_t>> *rowDocuments;
+    // If given, only the rows of these documents are scored
+    const RoaringBitmap *candidates;
+    pmr::vector<float> *scores;
+    pmr::vector<bool> *isMatched;
+    pmr::vector<uint32_t> *matchedDocuments;
+    uint64_t scoringTime;
+};
+
+static void addTermFrequency(TermFrequencyQuery &termFrequencyQuery, int64_t rowId,
+                             float termFrequency);
+
+/**
+ *@brief class constructor
+ *
+ *@param databasePath   path to the SQLite file that holds this shard
+ **/
+IndexShard::IndexShard(string databasePath)
+{
+    this->databasePath = databasePath;
+    buildDatabase = nullptr;
+    documentBase = 0;
+    lastSearchTime = 0;
+    indexMemory = 0;
+}
+
+IndexShard::~IndexShard()
+{
+    if (buildDatabase)
+        sqlite3_close(buildDatabase);
+}
+
+/**
+ *@brief Checks whether the shard exists on disk and was written with the current schema
+ *
+ *@return bool          true if the shard can be queried as it is
+ **/
+bool IndexShard::isBuilt()
+{
+    if (!filesystem::exists(databasePath))
+        return false;
+
+    sqlite3 *database;
+    if (sqlite3_open_v2(databasePath.c_str(), &database, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        sqlite3_close(database);
+        return false;
+    }
+
+    int version = 0;
+    sqlite3_stmt *statement;
+    if (sqlite3_prepare_v2(database, "PRAGMA user_version;", -1, &statement, nullptr) == SQLITE_OK)
+    {
+        if (sqlite3_step(statement) == SQLITE_ROW)
+            version = sqlite3_column_int(statement, 0);
+        sqlite3_finalize(statement);
+    }
+    sqlite3_close(database);
+
+    return version == INDEX_SCHEMA_VERSION;
+}
+
+string IndexShard::getDatabasePath()
+{
+    return databasePath;
+}
+
+/**
+ *@brief Deletes whatever was stored for this shard and starts a new ARTICLES table. All
+ *       articles are added inside a single transaction which is committed by endBuild().
+ *
+ *@return bool          true if the shard is ready to receive articles
+ **/
+bool IndexShard::beginBuild()
+{
+    error_code error;
+    filesystem::remove(databasePath, error);
+
+    if (sqlite3_open(databasePath.c_str(), &buildDatabase) != SQLITE_OK)
+    {
+        cerr << "Failed to open database: " << sqlite3_errmsg(buildDatabase) << endl;
+        sqlite3_close(buildDatabase);
+        buildDatabase = nullptr;
+        return false;
+    }
+
+    char *zErrMsg = 0;
+    const char *sql = "CREATE TABLE ARTICLES("
+                      "BODY            TEXT     NOT NULL,"
+                      "PATH        CHAR(50),"
+                      "WORDC          INT,"
+                      "RANK           REAL,"
+                      "CATEGORIES     TEXT);"
+                      "BEGIN TRANSACTION;";
+
+    if (sqlite3_exec(buildDatabase, sql, nullptr, 0, &zErrMsg) != SQLITE_OK)
+    {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ *@brief Adds an article to the shard being built
+ *
+ *@param body           parsed article text, with ' already escaped for SQL
+ *@param path           path to the html file, with ' already escaped for SQL
+ *@param wordCount      approximate number of words in body
+ *@param staticRank     query-independent importance of the article
+ *@param categories     categories of the article, one per line, with ' already escaped for SQL
+ *
+ *@return bool          true if the article was inserted
+ **/
+bool IndexShard::addArticle(const string &body, const string &path, int wordCount,
+                            float staticRank, const string &categories)
+{
+    if (!buildDatabase)
+        return false;
+
+    char rank[32];
+    snprintf(rank, sizeof(rank), "%.9g", staticRank);
+
+    string sqlstring = "INSERT INTO ARTICLES (BODY, PATH, WORDC, RANK, CATEGORIES)";
+    sqlstring += " VALUES ('";
+    sqlstring += body;
+    sqlstring += "', '";
+    sqlstring += path;
+    sqlstring += "', '";
+    sqlstring += to_string(wordCount);
+    sqlstring += "', ";
+    sqlstring += rank;
+    sqlstring += ", '";
+    sqlstring += categories;
+    sqlstring += "');";
+
+    char *zErrMsg = 0;
+    if (sqlite3_exec(buildDatabase, sqlstring.c_str(), nullptr, 0, &zErrMsg) != SQLITE_OK)
+    {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ *@brief Commits the articles and stamps the shard with the current schema version
+ *
+ *@return bool          true if the shard was written successfully
+ **/
+bool IndexShard::endBuild()
+{
+    if (!buildDatabase)
+        return false;
+
+    string sqlstring = "COMMIT; PRAGMA user_version = " + to_string(INDEX_SCHEMA_VERSION) + ";";
+
+    char *zErrMsg = 0;
+    int rc = sqlite3_exec(buildDatabase, sqlstring.c_str(), nullptr, 0, &zErrMsg);
+    if (rc != SQLITE_OK)
+    {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+    }
+
+    sqlite3_close(buildDatabase);
+    buildDatabase = nullptr;
+
+    return rc == SQLITE_OK;
+}
+
+/**
+ *@brief Reads the articles of the shard and builds its in-memory inverted index and its
+ *       document table
+ *
+ *@param withIndex      false to only load the documents and filters, as if the index had been
+ *                      shed, e.g. when it does not fit the memory budget
+ *
+ *@return bool          true if the shard was loaded
+ **/
+bool IndexShard::loadIndex(bool withIndex)
+{
+    sqlite3 *database;
+    if (sqlite3_open_v2(databasePath.c_str(), &database, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        cerr << "Failed to open database: " << sqlite3_errmsg(database) << endl;
+        sqlite3_close(database);
+        return false;
+    }
+
+    sqlite3_stmt *statement;
+    if (sqlite3_prepare_v2(database, "SELECT ROWID, PATH, BODY, RANK, CATEGORIES FROM ARTICLES "
+                                     "ORDER BY RANK DESC, ROWID;",
+                           -1, &statement, nullptr) != SQLITE_OK)
+    {
+        cerr << "Failed to read articles: " << sqlite3_errmsg(database) << endl;
+        sqlite3_close(database);
+        return false;
+    }
+
+    auto newIndex = make_unique<InvertedIndex>();
+    DocumentStore newDocuments;
+    vector<pair<int64_t, uint32_t>> newRowDocuments;
+    unordered_map<string, RoaringBitmap> newFilterBitmaps;
+    vector<string> tokens;
+    string url;
+    string title;
+    string filterKey;
+
+    while (sqlite3_step(statement) == SQLITE_ROW)
+    {
+        const char *path = (const char *)sqlite3_column_text(statement, 1);
+        const char *body = (const char *)sqlite3_column_text(statement, 2);
+
+        tokens.clear();
+        Analyzer::analyze(body ? body : "", tokens);
+        DocumentStore::getUrlAndTitle(path ? path : "", url, title);
+
+        uint32_t document = newDocuments.addDocument(url, title, (uint32_t)tokens.size(),
+                                                     (float)sqlite3_column_double(statement, 3));
+        if (withIndex)
+            newIndex->addDocument(document, tokens);
+        newRowDocuments.emplace_back(sqlite3_column_int64(statement, 0), document);
+
+        // Documents are added in increasing order, which is the cheapest for the bitmaps
+        if (tokens.size() < SHORT_ARTICLE_LENGTH)
+            newFilterBitmaps["len:short"].add(document);
+        else if (tokens.size() < LONG_ARTICLE_LENGTH)
+            newFilterBitmaps["len:medium"].add(document);
+        else
+            newFilterBitmaps["len:long"].add(document);
+
+        if (getFilterKey("initial", title, filterKey))
+            newFilterBitmaps[filterKey].add(document);
+
+        const char *categories = (const char *)sqlite3_column_text(statement, 4);
+        string_view categoryList = categories ? categories : "";
+        while (!categoryList.empty())
+        {
+            size_t categoryEnd = min(categoryList.find('\n'), categoryList.size());
+            if (getFilterKey("cat", string(categoryList.substr(0, categoryEnd)), filterKey))
+                newFilterBitmaps[filterKey].add(document);
+            categoryList.remove_prefix(min(categoryEnd + 1, categoryList.size()));
+        }
+    }
+
+    sqlite3_finalize(statement);
+    sqlite3_close(database);
+
+    // Articles were read in document order
+    vector<int64_t> newDocumentRows;
+    newDocumentRows.reserve(newRowDocuments.size());
+    for (const auto &rowDocument : newRowDocuments)
+        newDocumentRows.push_back(rowDocument.first);
+
+    sort(newRowDocuments.begin(), newRowDocuments.end());
+
+    if (withIndex)
+    {
+        newIndex->freeze();
+        MemoryUsage usage;
+        newIndex->getMemoryUsage(usage);
+        indexMemory = usage.getIndexTotal();
+        atomic_store(&index, shared_ptr<InvertedIndex>(move(newIndex)));
+    }
+    else
+        atomic_store(&index, shared_ptr<InvertedIndex>());
+    documents = move(newDocuments);
+    rowDocuments = move(newRowDocuments);
+    documentRows = move(newDocumentRows);
+    filterBitmaps = move(newFilterBitmaps);
+
+    return true;
+}
+
+/**
+ *@brief Loads the inverted index back after it was shed. The documents and filters must already
+ *       be loaded.
+ *
+ *@return bool          true if the index is loaded
+ **/
+bool IndexShard::reloadIndex()
+{
+    shared_ptr<InvertedIndex> newIndex = readIndex();
+    if (!newIndex)
+        return false;
+
+    MemoryUsage usage;
+    newIndex->getMemoryUsage(usage);
+    indexMemory = usage.getIndexTotal();
+    atomic_store(&index, newIndex);
+
+    return true;
+}
+
+/**
+ *@brief Checks whether the in-memory index is loaded
+ **/
+bool IndexShard::hasIndex()
+{
+    return atomic_load(&index) != nullptr;
+}
+
+/**
+ *@brief Drops the in-memory index to save memory. Searches then scan the articles text (see
+ *       searchIndex()); the documents and filters are kept. The memory is released once the
+ *       searches that use the index end.
+ *
+ *@return size_t        bytes the index took, 0 if it was not loaded
+ **/
+size_t IndexShard::shedIndex()
+{
+    shared_ptr<InvertedIndex> shedIndex = atomic_exchange(&index, shared_ptr<InvertedIndex>());
+    if (!shedIndex)
+        return 0;
+
+    MemoryUsage usage;
+    shedIndex->getMemoryUsage(usage);
+
+    return usage.getIndexTotal();
+}
+
+/**
+ *@brief Gets the memory the index takes, took before it was shed or, if it was never loaded,
+ *       is expected to take: about what the articles take on disk
+ **/
+size_t IndexShard::getIndexMemory()
+{
+    if (indexMemory)
+        return indexMemory;
+
+    error_code error;
+    uintmax_t fileSize = filesystem::file_size(databasePath, error);
+
+    return error ? 0 : (size_t)fileSize;
+}
+
+/**
+ *@brief Gets when the shard was last searched with terms, in Metrics::getTime() units
+ **/
+uint64_t IndexShard::getLastSearchTime()
+{
+    return lastSearchTime;
+}
+
+/**
+ *@brief Sets when the shard was last searched, e.g. to carry it over from the shard it
+ *       replaces in a new generation
+ **/
+void IndexShard::setLastSearchTime(uint64_t lastSearchTime)
+{
+    this->lastSearchTime = lastSearchTime;
+}
+
+/**
+ *@brief Adds the memory taken by the shard to a usage, by component
+ **/
+void IndexShard::getMemoryUsage(MemoryUsage &usage)
+{
+    shared_ptr<InvertedIndex> currentIndex = atomic_load(&index);
+    if (currentIndex)
+        currentIndex->getMemoryUsage(usage);
+
+    usage.documents += documents.getMemoryUsage() +
+                       rowDocuments.capacity() * sizeof(pair<int64_t, uint32_t>) +
+                       documentRows.capacity() * sizeof(int64_t);
+    for (const auto &filterBitmap : filterBitmaps)
+        usage.filterBitmaps += filterBitmap.first.capacity() +
+                               filterBitmap.second.getMemoryUsage();
+}
+
+/**
+ *@brief Gets the documents of the shard, numbered from 0
+ **/
+const DocumentStore &IndexShard::getDocuments()
+{
+    return documents;
+}
+
+/**
+ *@brief Sets the number of the first document of the shard in the whole index. Search results
+ *       are numbered in the whole index.
+ **/
+void IndexShard::setDocumentBase(uint32_t documentBase)
+{
+    this->documentBase = documentBase;
+}
+
+/**
+ *@brief Finds the best articles of this shard for a set of terms using the inverted index
+ *
+ *@param terms                  searched terms, from getQueryTerms()
+ *@param options                how the terms are combined
+ *@param k                      number of results wanted
+ *@param results                best results: document vs term frequency, best first
+ *@param matchCount             number of articles that match every term with match=all, else
+ *                              at least the most common term
+ *@param trace                  trace of the request, if it is being traced
+ *
+ *@return bool                  false if the index was shed, in which case the words must be
+ *                              searched with searchText()
+ **/
+bool IndexShard::searchIndex(const vector<string> &terms, const SearchOptions &options, size_t k,
+                             SearchResults &results, size_t &matchCount, QueryTrace *trace)
+{
+    // Shed shards count as searched too, so the most searched are reloaded first
+    lastSearchTime = Metrics::getTime();
+
+    shared_ptr<InvertedIndex> currentIndex = atomic_load(&index);
+    if (!currentIndex)
+        return false;
+
+    // Lookup and scoring are interleaved document by document, so both count as lookup
+    StageTimer lookupTimer(STAGE_INDEX_LOOKUP, trace);
+
+    RoaringBitmap intersection;
+    const RoaringBitmap *filter = getFilter(options, intersection);
+
+    vector<pair<uint32_t, float>> topDocuments;
+    if (options.matchAll)
+        currentIndex->searchAllTopK(terms, filter, k, topDocuments, matchCount, trace);
+    else
+        currentIndex->searchTopK(terms, filter, k, topDocuments, matchCount, trace);
+
+    results.reserve(results.size() + topDocuments.size());
+    for (const auto &document : topDocuments)
+        results.emplace_back(documentBase + document.first, document.second);
+
+    return true;
+}
+
+/**
+ *@brief Builds an inverted index from the articles of the shard, which must already be loaded
+ *
+ *@return InvertedIndex the frozen index, nullptr if the articles could not be read
+ **/
+shared_ptr<InvertedIndex> IndexShard::readIndex()
+{
+    sqlite3 *database;
+    if (sqlite3_open_v2(databasePath.c_str(), &database, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        cerr << "Failed to open database: " << sqlite3_errmsg(database) << endl;
+        sqlite3_close(database);
+        return nullptr;
+    }
+
+    // Read in ROWID order, which needs no sorting; the postings are sorted by freeze()
+    sqlite3_stmt *statement;
+    if (sqlite3_prepare_v2(database, "SELECT ROWID, BODY FROM ARTICLES;", -1, &statement,
+                           nullptr) != SQLITE_OK)
+    {
+        cerr << "Failed to read articles: " << sqlite3_errmsg(database) << endl;
+        sqlite3_close(database);
+        return nullptr;
+    }
+
+    auto newIndex = make_shared<InvertedIndex>();
+    vector<string> tokens;
+    while (sqlite3_step(statement) == SQLITE_ROW)
+    {
+        int64_t rowId = sqlite3_column_int64(statement, 0);
+        auto it = lower_bound(rowDocuments.begin(), rowDocuments.end(),
+                              make_pair(rowId, (uint32_t)0));
+        if (it == rowDocuments.end() || it->first != rowId)
+            continue;
+
+        const char *body = (const char *)sqlite3_column_text(statement, 1);
+        tokens.clear();
+        Analyzer::analyze(body ? body : "", tokens);
+        newIndex->addDocument(it->second, tokens);
+    }
+
+    sqlite3_finalize(statement);
+    sqlite3_close(database);
+
+    newIndex->freeze();
+
+    return newIndex;
+}
+
+/**
+ *@brief Finds the best articles of this shard by scanning their text for every word. Used for
+ *       the searches the inverted index cannot answer, such as phrases.
+ *
+ *@param words                  searched words, as typed by the user
+ *@param options                how the words are combined
+ *@param k                      number of results wanted
+ *@param results                best results: document vs term frequency, best first
+ *@param matchCount             number of articles that contain every word with match=all,
+ *                              else any of the words
+ *@param trace                  trace of the request, if it is being traced
+ *
+ **/
+void IndexShard::searchText(const SearchTerms &words, const SearchOptions &options, size_t k,
+                            SearchResults &results, size_t &matchCount, QueryTrace *trace)
+{
+    // Scores are accumulated in a dense array indexed by document
+    pmr::memory_resource *arena = results.get_allocator().resource();
+    pmr::vector<float> scores(documents.getDocumentCount(), 0.0f, arena);
+    pmr::vector<bool> isMatched(documents.getDocumentCount(), false, arena);
+    pmr::vector<uint32_t> matchedDocuments(arena);
+    pmr::vector<uint32_t> candidates(arena);
+
+    // With filters, only the rows of their documents are scanned
+    RoaringBitmap intersection;
+    const RoaringBitmap *filter = getFilter(options, intersection);
+    pmr::vector<uint32_t> filterDocuments(arena);
+    if (filter)
+    {
+        for (uint32_t document = filter->getNext(0); document != ROARING_NO_VALUE;
+             document = filter->getNext(document + 1))
+            filterDocuments.push_back(document);
+
+        if (filterDocuments.empty())
+        {
+            matchCount = 0;
+            return;
+        }
+    }
+
+    // With match=all the words expected to match the fewest articles are scanned first, and
+    // every scan after the first one only reads the articles that matched every word so far
+    vector<size_t> order(words.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    if (options.matchAll)
+    {
+        vector<uint32_t> estimatedMatches;
+        for (const auto &word : words)
+            estimatedMatches.push_back(estimateMatches(word));
+        QueryPlanner::orderWords(estimatedMatches, order);
+    }
+
+    for (size_t step = 0; step < order.size(); step++)
+    {
+        size_t i = order[step];
+        if (options.matchAll && step > 0)
+        {
+            // No article has every word
+            if (matchedDocuments.empty())
+                break;
+
+            candidates.swap(matchedDocuments);
+            matchedDocuments.clear();
+            for (uint32_t document : candidates)
+                isMatched[document] = false;
+        }
+
+        // character ' is escaped for SQL by doubling it
+        ArenaString word(arena);
+        word.reserve(words[i].size());
+        for (char c : words[i])
+        {
+            word += c;
+            if (c == '\'')
+                word += '\'';
+        }
+
+        const pmr::vector<uint32_t> *scannedDocuments = filter ? &filterDocuments : nullptr;
+        if (options.matchAll && step > 0)
+            scannedDocuments = &candidates;
+        calculateTermFrequency(word, scores, isMatched, matchedDocuments, trace, i,
+                               scannedDocuments);
+    }
+
+    matchCount = matchedDocuments.size();
+
+    StageTimer sortingTimer(STAGE_SORTING, trace);
+    size_t resultCount = min(matchedDocuments.size(), k);
+    partial_sort(matchedDocuments.begin(), matchedDocuments.begin() + resultCount,
+                 matchedDocuments.end(),
+                 [&](uint32_t a, uint32_t b) {
+                     // Ties go to the document with the higher static rank
+                     return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+                 });
+
+    results.reserve(results.size() + resultCount);
+    for (size_t i = 0; i < resultCount; i++)
+        results.emplace_back(documentBase + matchedDocuments[i], scores[matchedDocuments[i]]);
+}
+
+/**
+ *@brief Calculate the term frequency of a given word in the articles of this shard
+ *
+ *@param word                   searched word, with ' already escaped for SQL
+ *@param scores                 term frequencies are added here, indexed by document
+ *@param isMatched              documents that matched any word so far, indexed by document
+ *@param matchedDocuments       documents that matched for the first time are appended here
+ *@param trace                  trace of the request, if it is being traced
+ *@param termIndex              index of the word in the traced query
+ *@param candidates             if given, only these documents are scored; a few are read by
+ *                              ROWID, many are picked out of a scan of the table
+ *
+ **/
+void IndexShard::calculateTermFrequency(string_view word, pmr::vector<float> &scores,
+                                        pmr::vector<bool> &isMatched,
+                                        pmr::vector<uint32_t> &matchedDocuments,
+                                        QueryTrace *trace, size_t termIndex,
+                                        const pmr::vector<uint32_t> *candidates)
+{
+    sqlite3 *database;
+    int result = sqlite3_open(databasePath.c_str(), &database);
+
+    if (result != SQLITE_OK)
+    {
+        cerr << "Failed to open database: " << sqlite3_errmsg(database) << endl;
+        sqlite3_close(database);
+        return;
+    }
+
+    // The query is built in the arena of the scores, which belongs to the request
+    ArenaString query(scores.get_allocator());
+    query.reserve(256 + 3 * word.size());
+    query += "SELECT ROWID, (LENGTH(BODY) - LENGTH(REPLACE(LOWER(BODY), \
+                LOWER('";
+    query += word;
+    query += "'), ''))) \
+                / CAST(LENGTH('";
+    query += word;
+    query += "') AS FLOAT) / WORDC \
+                AS TermFrequency FROM ARTICLES WHERE ";
+    RoaringBitmap candidateBitmap;
+    bool isLookup = candidates && candidates->size() <= MAX_ROWID_LOOKUPS;
+    if (candidates && !isLookup)
+    {
+        // Bitmaps are cheapest to fill in increasing order
+        pmr::vector<uint32_t> sortedCandidates(*candidates, scores.get_allocator());
+        sort(sortedCandidates.begin(), sortedCandidates.end());
+        for (uint32_t document : sortedCandidates)
+            candidateBitmap.add(document);
+    }
+    if (isLookup)
+    {
+        // The rows are looked up by ROWID instead of scanning the whole table
+        query += "ROWID IN (";
+        for (size_t i = 0; i < candidates->size(); i++)
+        {
+            if (i > 0)
+                query += ',';
+            query += to_string(documentRows[(*candidates)[i]]);
+        }
+        query += ") AND ";
+    }
+    query += "LOWER(BODY) LIKE '%";
+    query += word;
+    query += "%';";
+
+    // Rows are scored as SQLite steps through them, so the scoring time is measured inside
+    // addTermFrequency() and subtracted from the lookup time
+    TermFrequencyQuery termFrequencyQuery = {&rowDocuments,
+                                             (candidates && !isLookup) ? &candidateBitmap
+                                                                       : nullptr,
+                                             &scores, &isMatched, &matchedDocuments, 0};
+    uint64_t rowsMatched = 0;
+    uint64_t rowsScanned = 0;
+    uint64_t lookupStart = Metrics::getTime();
+
+    sqlite3_stmt *statement;
+    result = sqlite3_prepare_v2(database, query.c_str(), -1, &statement, nullptr);
+    if (result == SQLITE_OK)
+    {
+        while ((result = sqlite3_step(statement)) == SQLITE_ROW)
+        {
+            addTermFrequency(termFrequencyQuery, sqlite3_column_int64(statement, 0),
+                             (float)sqlite3_column_double(statement, 1));
+            rowsMatched++;
+        }
+
+        rowsScanned = sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0) + 1;
+        sqlite3_finalize(statement);
+    }
+
+    uint64_t lookupTime = Metrics::getTime() - lookupStart;
+    Metrics::recordStage(STAGE_INDEX_LOOKUP, lookupTime - termFrequencyQuery.scoringTime);
+    Metrics::recordStage(STAGE_SCORING, termFrequencyQuery.scoringTime);
+
+    if (trace)
+    {
+        trace->addStageTime(STAGE_INDEX_LOOKUP, lookupTime - termFrequencyQuery.scoringTime);
+        trace->addStageTime(STAGE_SCORING, termFrequencyQuery.scoringTime);
+        trace->addTermStatistics(termIndex, rowsScanned, rowsMatched);
+    }
+
+    if (result != SQLITE_DONE)
+    {
+        cerr << "Failed to execute query: " << sqlite3_errmsg(database) << endl;
+    }
+
+    int cacheHits, cacheMisses, highWater;
+    sqlite3_db_status(database, SQLITE_DBSTATUS_CACHE_HIT, &cacheHits, &highWater, 0);
+    sqlite3_db_status(database, SQLITE_DBSTATUS_CACHE_MISS, &cacheMisses, &highWater, 0);
+    Metrics::addToCounter(COUNTER_CACHE_HITS, cacheHits);
+    Metrics::addToCounter(COUNTER_CACHE_MISSES, cacheMisses);
+
+    sqlite3_close(database);
+}
+
+/**
+ *@brief Gets the documents that pass every filter of a search
+ *
+ *@param options                options of the search
+ *@param intersection           holds the documents if there is more than one filter
+ *
+ *@return RoaringBitmap         the documents, nullptr if the search has no filters
+ **/
+const RoaringBitmap *IndexShard::getFilter(const SearchOptions &options,
+                                           RoaringBitmap &intersection)
+{
+    const RoaringBitmap *filter = nullptr;
+    for (const auto &filterKey : options.filters)
+    {
+        auto bitmap = filterBitmaps.find(filterKey);
+        if (bitmap == filterBitmaps.end())
+        {
+            // No document has the value
+            intersection = RoaringBitmap();
+            return &intersection;
+        }
+
+        if (!filter)
+            filter = &bitmap->second;
+        else
+        {
+            intersection = RoaringBitmap::intersect(*filter, bitmap->second);
+            filter = &intersection;
+        }
+    }
+
+    return filter;
+}
+
+/**
+ *@brief Estimates the number of articles of the shard whose text contains a word, from the
+ *       document frequencies of its terms. A word can also match inside longer words, so the
+ *       estimate is only good for ordering the words.
+ **/
+uint32_t IndexShard::estimateMatches(string_view word)
+{
+    uint32_t estimate = (uint32_t)documents.getDocumentCount();
+    shared_ptr<InvertedIndex> currentIndex = atomic_load(&index);
+    if (!currentIndex)
+        return estimate;
+
+    vector<string> terms;
+    Analyzer::analyze(word, terms);
+    for (const auto &term : terms)
+        estimate = min(estimate, currentIndex->getDocumentFrequency(term));
+
+    return estimate;
+}
+
+/**
+ *@brief Turns the searched words into index terms, with the analyzer the index was loaded
+ *       with. Stopwords are not in the index, so they are dropped. Words that are not a single
+ *       term (phrases such as "sistema solar", or bare punctuation) can only be searched in the
+ *       articles text, and so can a search made only of stopwords ("el+de"), which the index
+ *       would answer with nothing.
+ *
+ *@param words          searched words
+ *@param terms          one term per word that is not a stopword
+ *
+ *@return bool          true if every word is a single term or a stopword, at least one is a
+ *                      term, and the index can be used
+ **/
+bool IndexShard::getQueryTerms(const SearchTerms &words, vector<string> &terms)
+{
+    terms.clear();
+    vector<string> wordTerms;
+
+    for (const auto &word : words)
+    {
+        wordTerms.clear();
+        size_t tokenCount = Analyzer::analyze(word, wordTerms);
+        if (tokenCount == 1 && wordTerms.empty())
+            continue;
+        if (wordTerms.size() != 1)
+            return false;
+
+        terms.push_back(wordTerms[0]);
+    }
+
+    return !terms.empty();
+}
+
+/**
+ *@brief Gets the key of the bitmap of an attribute value. Values are tokenized, so case and
+ *       spaces do not matter: cat=Grupos de pop de Suecia is "cat:grupos_de_pop_de_suecia".
+ *
+ *@param attribute      len, initial or cat
+ *@param value          value of the attribute, as typed; only the first letter counts for
+ *                      initial
+ *@param key            the key
+ *
+ *@return bool          false if the attribute cannot be filtered by or the value is empty
+ **/
+bool IndexShard::getFilterKey(const string &attribute, const string &value, string &key)
+{
+    if (attribute != "len" && attribute != "initial" && attribute != "cat")
+        return false;
+
+    vector<string> tokens;
+    Tokenizer::tokenize(value, tokens);
+    if (tokens.empty())
+        return false;
+
+    key = attribute + ":";
+    if (attribute == "initial")
+    {
+        // The first character, which can take up to 4 bytes in UTF-8
+        unsigned char firstByte = tokens[0][0];
+        size_t length = (firstByte < 0x80) ? 1 : (firstByte < 0xe0) ? 2
+                                                 : (firstByte < 0xf0) ? 3
+                                                                      : 4;
+        key += tokens[0].substr(0, length);
+        return true;
+    }
+
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        if (i > 0)
+            key += '_';
+        key += tokens[i];
+    }
+
+    return true;
+}
+
+/**
+ *@brief Picks the shard a document belongs to inside its slice
+ *
+ *@param documentName   file name of the document
+ *@param shardCount     number of shards in the index
+ *@param sliceCount     number of slices the corpus is split into (see getSliceIndex)
+ *
+ *@return int           shard index in [0, shardCount)
+ **/
+int IndexShard::getShardIndex(const string &documentName, int shardCount, int sliceCount)
+{
+    // The low part of the hash picks the slice, so the shard is taken from what remains
+    return (int)((getDocumentHash(documentName) / (uint32_t)sliceCount) % (uint32_t)shardCount);
+}
+
+/**
+ *@brief Picks the slice of a distributed index (i.e. the shard server) a document belongs to
+ *
+ *@param documentName   file name of the document
+ *@param sliceCount     number of slices the corpus is split into
+ *
+ *@return int           slice index in [0, sliceCount)
+ **/
+int IndexShard::getSliceIndex(const string &documentName, int sliceCount)
+{
+    return (int)(getDocumentHash(documentName) % (uint32_t)sliceCount);
+}
+
+/**
+ *@brief FNV-1a over the file name, so that the placement of a document does not depend on
+ *       directory iteration order or on the platform
+ **/
+uint32_t IndexShard::getDocumentHash(const string &documentName)
+{
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : documentName)
+    {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* SCORING */
+
+/**
+ *@brief Adds the frequency of a word in a row to the score of its document. If the document
+ *       was already matched then it adds up the frequencies of the terms involved
+ *
+ *@param termFrequencyQuery     scores indexed by document
+ *@param rowId                  ROWID of the row (1st column of the query)
+ *@param termFrequency          term frequency of the word in the row (2nd column)
+ **/
+static void addTermFrequency(TermFrequencyQuery &termFrequencyQuery, int64_t rowId,
+                             float termFrequency)
+{
+    const vector<pair<int64_t, uint32_t>> &rowDocuments = *termFrequencyQuery.rowDocuments;
+    uint64_t scoringStart = Metrics::getTime();
+
+    // The document of a row is found by bisection
+    auto it = lower_bound(rowDocuments.begin(), rowDocuments.end(), make_pair(rowId, (uint32_t)0));
+
+    if (it != rowDocuments.end() && it->first == rowId &&
+        (!termFrequencyQuery.candidates || termFrequencyQuery.candidates->contains(it->second)))
+    {
+        uint32_t document = it->second;
+
+        if (!(*termFrequencyQuery.isMatched)[document])
+        {
+            (*termFrequencyQuery.isMatched)[document] = true;
+            termFrequencyQuery.matchedDocuments->push_back(document);
+        }
+        (*termFrequencyQuery.scores)[document] += termFrequency;
+    }
+
+    termFrequencyQuery.scoringTime += Metrics::getTime() - scoringStart;
+}
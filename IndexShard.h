@@ -0,0 +1,128 @@
+/**
+ * @file IndexShard.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief One document shard of the EDAoogle index, stored in its own SQLite database
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef INDEXSHARD_H
+#define INDEXSHARD_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "DocumentStore.h"
+#include "InvertedIndex.h"
+#include "MemoryUsage.h"
+#include "RequestArena.h"
+#include "RoaringBitmap.h"
+
+struct QueryTrace;
+
+// Bump whenever the ARTICLES layout or the articles that are indexed change, so that stale
+// shards are rebuilt
+#define INDEX_SCHEMA_VERSION 4
+
+// Articles with fewer terms are len=short, with at least LONG_ARTICLE_LENGTH len=long and the
+// rest len=medium
+#define SHORT_ARTICLE_LENGTH 1500
+#define LONG_ARTICLE_LENGTH 6000
+
+/**
+ * @brief How the words of a search are combined
+ */
+struct SearchOptions
+{
+    // Only the articles that contain every word match (match=all), instead of any word
+    bool matchAll = false;
+    // Attribute values every result must have (len=long), as keys from getFilterKey()
+    std::vector<std::string> filters;
+};
+
+class IndexShard
+{
+public:
+    IndexShard(std::string databasePath);
+    ~IndexShard();
+
+    bool isBuilt();
+    std::string getDatabasePath();
+
+    bool beginBuild();
+    bool addArticle(const std::string &body, const std::string &path, int wordCount,
+                    float staticRank = 0, const std::string &categories = "");
+    bool endBuild();
+
+    bool loadIndex(bool withIndex = true);
+    bool reloadIndex();
+    bool hasIndex();
+    size_t shedIndex();
+    size_t getIndexMemory();
+    uint64_t getLastSearchTime();
+    void setLastSearchTime(uint64_t lastSearchTime);
+    void getMemoryUsage(MemoryUsage &usage);
+    const DocumentStore &getDocuments();
+    void setDocumentBase(uint32_t documentBase);
+
+    bool searchIndex(const std::vector<std::string> &terms, const SearchOptions &options,
+                     size_t k, SearchResults &results, size_t &matchCount,
+                     QueryTrace *trace = nullptr);
+    void searchText(const SearchTerms &words, const SearchOptions &options, size_t k,
+                    SearchResults &results, size_t &matchCount, QueryTrace *trace = nullptr);
+
+    static bool getQueryTerms(const SearchTerms &words, std::vector<std::string> &terms);
+    static bool getFilterKey(const std::string &attribute, const std::string &value,
+                             std::string &key);
+
+    static int getShardIndex(const std::string &documentName, int shardCount, int sliceCount = 1);
+    static int getSliceIndex(const std::string &documentName, int sliceCount);
+
+private:
+    static uint32_t getDocumentHash(const std::string &documentName);
+
+    std::shared_ptr<InvertedIndex> readIndex();
+    const RoaringBitmap *getFilter(const SearchOptions &options, RoaringBitmap &intersection);
+    uint32_t estimateMatches(std::string_view word);
+    void calculateTermFrequency(std::string_view word, std::pmr::vector<float> &scores,
+                                std::pmr::vector<bool> &isMatched,
+                                std::pmr::vector<uint32_t> &matchedDocuments,
+                                QueryTrace *trace, size_t termIndex,
+                                const std::pmr::vector<uint32_t> *candidates = nullptr);
+
+    std::string databasePath;
+    sqlite3 *buildDatabase;
+
+    // Documents are numbered by decreasing static rank. Document d of the shard is document
+    // documentBase + d of the whole index; rowDocuments maps the ROWID of every article to its
+    // document, sorted by ROWID, and documentRows maps every document back to its ROWID.
+    // The index can be shed while searches use it, so it is read and replaced with
+    // atomic_load/atomic_store and a search keeps the index it started with.
+    std::shared_ptr<InvertedIndex> index;
+    DocumentStore documents;
+    std::vector<std::pair<int64_t, uint32_t>> rowDocuments;
+    std::vector<int64_t> documentRows;
+    uint32_t documentBase;
+
+    // When the shard was last searched with terms (see Metrics::getTime()), so the coldest
+    // shards are shed first and the hottest are reloaded first
+    std::atomic<uint64_t> lastSearchTime;
+    // Memory the index takes, or took before it was shed; 0 if it was never loaded
+    std::atomic<size_t> indexMemory;
+
+    // Documents with each attribute value, by filter key (e.g. "len:long", "initial:a",
+    // "cat:grupos_de_pop_de_suecia")
+    std::unordered_map<std::string, RoaringBitmap> filterBitmaps;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file IndexSnapshot.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Immutable generation of the local index: its shards and their documents
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * The handler publishes the current snapshot through an atomic shared_ptr. A search loads the
+ * pointer once and uses that snapshot until its page is rendered, so a rebuild can publish a
+ * new generation at any time (read-copy-update). The old generation is destroyed, and its
+ * shard files deleted, when the last search that holds it lets it go.
+ *
+ */
+
+#include <filesystem>
+
+#include "IndexSnapshot.h"
+
+using namespace std;
+
+/**
+ *@brief class constructor. Joins the documents of the shards, which must already be loaded.
+ *
+ *@param generation     number of the build that wrote the shards
+ *@param shards         shards of this generation
+ **/
+IndexSnapshot::IndexSnapshot(uint64_t generation, vector<unique_ptr<IndexShard>> shards) :
+generation(generation), shards(move(shards)), isRetired(false)
+{
+    for (auto &shard : this->shards)
+    {
+        shard->setDocumentBase((uint32_t)documents.getDocumentCount());
+        documents.append(shard->getDocuments());
+    }
+}
+
+IndexSnapshot::~IndexSnapshot()
+{
+    if (!isRetired)
+        return;
+
+    vector<string> databasePaths;
+    for (auto &shard : shards)
+        databasePaths.push_back(shard->getDatabasePath());
+    shards.clear();
+
+    for (auto &databasePath : databasePaths)
+    {
+        error_code error;
+        filesystem::remove(databasePath, error);
+    }
+}
+
+uint64_t IndexSnapshot::getGeneration() const
+{
+    return generation;
+}
+
+size_t IndexSnapshot::getShardCount() const
+{
+    return shards.size();
+}
+
+IndexShard &IndexSnapshot::getShard(size_t shardIndex) const
+{
+    return *shards[shardIndex];
+}
+
+const DocumentStore &IndexSnapshot::getDocuments() const
+{
+    return documents;
+}
+
+/**
+ *@brief Marks the snapshot as replaced. Its shard files are deleted when it is destroyed.
+ **/
+void IndexSnapshot::retire() const
+{
+    isRetired = true;
+}
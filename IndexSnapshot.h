@@ -0,0 +1,46 @@
+/**
+ * @file IndexSnapshot.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Immutable generation of the local index: its shards and their documents
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef INDEXSNAPSHOT_H
+#define INDEXSNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "DocumentStore.h"
+#include "IndexShard.h"
+
+class IndexSnapshot
+{
+public:
+    IndexSnapshot(uint64_t generation, std::vector<std::unique_ptr<IndexShard>> shards);
+    ~IndexSnapshot();
+
+    uint64_t getGeneration() const;
+    size_t getShardCount() const;
+    IndexShard &getShard(size_t shardIndex) const;
+    const DocumentStore &getDocuments() const;
+
+    void retire() const;
+
+private:
+    uint64_t generation;
+    std::vector<std::unique_ptr<IndexShard>> shards;
+    // Documents of all the shards, numbered shard after shard
+    DocumentStore documents;
+
+    // Set once a newer generation replaces this one, so that its files are deleted when the
+    // last search that uses it ends
+    mutable std::atomic<bool> isRetired;
+};
+
+#endif
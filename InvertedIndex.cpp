@@ -0,0 +1,656 @@
+/**
+ * @file InvertedIndex.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief In-memory inverted index of a shard with Block-Max WAND top-k retrieval
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Every term has a postings list of (document, term frequency) sorted by document, where the
+ * term frequency is the number of occurrences over the length of the document; the score of a
+ * document is the sum of the term frequencies of the searched terms, as it has always been.
+ *
+ * Postings are grouped in blocks of POSTING_BLOCK_SIZE, and the index keeps the best score of
+ * every term and of every block. The top-k search (Block-Max WAND) walks the lists in document
+ * order and skips every document whose upper bound (sum of the maximum scores of the terms it
+ * could contain, refined with the block maxima) cannot beat the k-th best score found so far.
+ * Once the top-k fills up with good documents, a common term is only read where a rare term
+ * could make a document competitive.
+ *
+ * Documents are numbered by decreasing static rank (see IndexShard) and ties are broken by
+ * document number, so a document never displaces an earlier one with the same score. Any
+ * document that can at most tie the k-th best is skipped, and since the important documents
+ * are met first the top-k fills up with good scores early and the threshold rises sooner.
+ *
+ * Searches that require every word (match=all) are not scored with WAND but intersected, rarest
+ * term first, as planned by QueryPlanner. The terms that are in a large share of the documents
+ * also get a bitmap, so that a few rare candidates are checked against them without reading
+ * their long postings.
+ *
+ * A search can be restricted to the documents of a filter bitmap (see IndexShard). WAND skips
+ * straight from a pivot the filter drops to the next document it keeps, before any block or
+ * posting of it is read, and the intersections start from the filter when it is smaller than
+ * the rarest term, so a filter only ever takes work away.
+ *
+ * Terms are numbered by a minimal perfect hash (see TermDictionary), so looking a searched term
+ * up does not compare strings and the terms themselves are not kept once the index is frozen.
+ *
+ * @cite Ding, Suel - Faster top-k document retrieval using block-max indexes (SIGIR 2011)
+ *
+ */
+
+#include <algorithm>
+#include <bitset>
+#include <functional>
+#include <limits>
+
+#include "InvertedIndex.h"
+#include "QueryPlanner.h"
+#include "SlowQueryLog.h"
+
+using namespace std;
+
+#define NO_DOCUMENT numeric_limits<uint32_t>::max()
+
+/**
+ * @brief Position of a searched term in its postings list
+ */
+struct InvertedIndex::Cursor
+{
+    size_t termIndex;
+    uint32_t start;
+    uint32_t position;
+    uint32_t end;
+    uint32_t block;
+    uint32_t firstBlock;
+    uint32_t blockEnd;
+    uint32_t document;
+    float maxScore;
+    uint64_t postingsScanned;
+};
+
+/**
+ *@brief class constructor. The index starts empty and accepts documents until it is frozen.
+ **/
+InvertedIndex::InvertedIndex()
+{
+    frozen = false;
+    documentCount = 0;
+    bitmapWordCount = 0;
+}
+
+/**
+ *@brief Adds a document. Documents can come in any order, since the postings are sorted
+ *       when the index is frozen.
+ *
+ *@param document       document number inside the shard
+ *@param tokens         terms of the document, as returned by Tokenizer
+ **/
+void InvertedIndex::addDocument(uint32_t document, const vector<string> &tokens)
+{
+    if (frozen)
+        return;
+
+    // Counted even without terms: a filter can still make it a candidate of a search
+    documentCount = max(documentCount, document + 1);
+    if (tokens.empty())
+        return;
+
+    unordered_map<string, uint32_t> counts;
+    for (const auto &token : tokens)
+        counts[token]++;
+
+    float length = (float)tokens.size();
+    for (const auto &count : counts)
+        buildPostings[count.first].emplace_back(document, count.second / length);
+}
+
+/**
+ *@brief Lays the postings out in flat arrays and computes the term and block maxima. No more
+ *       documents can be added afterwards.
+ **/
+void InvertedIndex::freeze()
+{
+    if (frozen)
+        return;
+
+    vector<string> terms;
+    terms.reserve(buildPostings.size());
+    for (const auto &postings : buildPostings)
+        terms.push_back(postings.first);
+
+    // The postings are laid out in the order of the numbers the dictionary gives the terms
+    termDictionary.build(terms);
+    vector<string> termsById(terms.size());
+    for (auto &term : terms)
+    {
+        uint32_t termId;
+        termDictionary.find(term, termId);
+        termsById[termId] = move(term);
+    }
+    terms = vector<string>();
+
+    termOffsets.push_back(0);
+    blockOffsets.push_back(0);
+
+    for (uint32_t termId = 0; termId < termsById.size(); termId++)
+    {
+        auto &postings = buildPostings[termsById[termId]];
+        sort(postings.begin(), postings.end());
+
+        float termMaxScore = 0;
+        for (size_t i = 0; i < postings.size(); i++)
+        {
+            postingDocuments.push_back(postings[i].first);
+            postingScores.push_back(postings[i].second);
+            termMaxScore = max(termMaxScore, postings[i].second);
+
+            if (i % POSTING_BLOCK_SIZE == 0)
+                blockMaxScores.push_back(0);
+            blockMaxScores.back() = max(blockMaxScores.back(), postings[i].second);
+            if (i % POSTING_BLOCK_SIZE == POSTING_BLOCK_SIZE - 1 || i == postings.size() - 1)
+                blockLastDocuments.push_back(postings[i].first);
+        }
+
+        termMaxScores.push_back(termMaxScore);
+        termOffsets.push_back((uint32_t)postingDocuments.size());
+        blockOffsets.push_back((uint32_t)blockLastDocuments.size());
+
+        postings = vector<pair<uint32_t, float>>();
+    }
+
+    buildPostings.clear();
+
+    // A bitmap takes documentCount bits, at most half the memory of the postings it indexes
+    bitmapWordCount = (documentCount + 63) / 64;
+    for (uint32_t termId = 0; termId + 1 < termOffsets.size(); termId++)
+    {
+        uint32_t postingCount = termOffsets[termId + 1] - termOffsets[termId];
+        if (postingCount < POSTING_BLOCK_SIZE ||
+            (uint64_t)postingCount * BITMAP_TERM_DENSITY < documentCount)
+            continue;
+
+        size_t firstWord = bitmapWords.size();
+        termBitmaps.emplace(termId, (uint32_t)(firstWord / bitmapWordCount));
+        bitmapWords.resize(firstWord + bitmapWordCount, 0);
+        bitmapRanks.resize(firstWord + bitmapWordCount, 0);
+
+        for (uint32_t position = termOffsets[termId]; position < termOffsets[termId + 1];
+             position++)
+        {
+            uint32_t document = postingDocuments[position];
+            bitmapWords[firstWord + document / 64] |= 1ull << (document % 64);
+        }
+
+        uint32_t rank = 0;
+        for (size_t word = firstWord; word < bitmapWords.size(); word++)
+        {
+            bitmapRanks[word] = rank;
+            rank += (uint32_t)bitset<64>(bitmapWords[word]).count();
+        }
+    }
+
+    frozen = true;
+}
+
+bool InvertedIndex::isFrozen()
+{
+    return frozen;
+}
+
+size_t InvertedIndex::getDocumentCount()
+{
+    return documentCount;
+}
+
+size_t InvertedIndex::getTermCount()
+{
+    return termMaxScores.size();
+}
+
+/**
+ *@brief Adds the memory taken by the frozen index to a usage, by component
+ **/
+void InvertedIndex::getMemoryUsage(MemoryUsage &usage) const
+{
+    usage.dictionary += termDictionary.getMemoryUsage();
+    usage.postings += (termOffsets.capacity() + postingDocuments.capacity() +
+                       blockOffsets.capacity() + blockLastDocuments.capacity()) *
+                          sizeof(uint32_t) +
+                      (termMaxScores.capacity() + postingScores.capacity() +
+                       blockMaxScores.capacity()) *
+                          sizeof(float);
+    usage.termBitmaps += bitmapWords.capacity() * sizeof(uint64_t) +
+                         bitmapRanks.capacity() * sizeof(uint32_t) +
+                         termBitmaps.size() * sizeof(pair<uint32_t, uint32_t>);
+}
+
+/**
+ *@brief Gets the number of documents that contain a term, 0 if it is not in the index
+ **/
+uint32_t InvertedIndex::getDocumentFrequency(string_view term)
+{
+    uint32_t termId;
+    if (!frozen || !findTerm(term, termId))
+        return 0;
+
+    return termOffsets[termId + 1] - termOffsets[termId];
+}
+
+/**
+ *@brief Finds the best k documents for a set of terms
+ *
+ *@param terms          searched terms; a document scores the sum of their term frequencies
+ *@param filter         if given, only its documents can be results
+ *@param k              number of results wanted
+ *@param results        best documents and their scores, best first
+ *@param matchCount     number of documents that contain the most common of the terms (a lower
+ *                      bound of the documents that match, which would cost a full scan), or
+ *                      of the documents of the filter if there are fewer
+ *@param trace          trace of the request, if it is being traced
+ **/
+void InvertedIndex::searchTopK(const vector<string> &terms, const RoaringBitmap *filter, size_t k,
+                               vector<pair<uint32_t, float>> &results, size_t &matchCount,
+                               QueryTrace *trace)
+{
+    results.clear();
+    matchCount = 0;
+    if (!frozen || k == 0)
+        return;
+
+    vector<Cursor> cursors;
+    cursors.reserve(terms.size());
+    for (size_t i = 0; i < terms.size(); i++)
+    {
+        uint32_t termId;
+        if (!findTerm(terms[i], termId))
+            continue;
+
+        Cursor cursor;
+        cursor.termIndex = i;
+        cursor.start = termOffsets[termId];
+        cursor.position = cursor.start;
+        cursor.end = termOffsets[termId + 1];
+        cursor.firstBlock = blockOffsets[termId];
+        cursor.block = cursor.firstBlock;
+        cursor.blockEnd = blockOffsets[termId + 1];
+        cursor.document = postingDocuments[cursor.position];
+        cursor.maxScore = termMaxScores[termId];
+        cursor.postingsScanned = 1;
+        cursors.push_back(cursor);
+
+        matchCount = max(matchCount, (size_t)(cursor.end - cursor.start));
+    }
+    if (filter)
+        matchCount = min(matchCount, filter->getCardinality());
+
+    vector<Cursor *> order;
+    for (auto &cursor : cursors)
+        order.push_back(&cursor);
+
+    // Min-heap with the best k so far: its top is the score to beat once it is full
+    vector<pair<float, uint32_t>> topK;
+    auto worseResult = [](const pair<float, uint32_t> &a, const pair<float, uint32_t> &b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+    uint64_t candidatesScored = 0;
+
+    while (true)
+    {
+        order.erase(remove_if(order.begin(), order.end(),
+                              [](Cursor *cursor) { return cursor->document == NO_DOCUMENT; }),
+                    order.end());
+        if (order.empty())
+            break;
+
+        sort(order.begin(), order.end(),
+             [](Cursor *a, Cursor *b) { return a->document < b->document; });
+
+        float threshold = (topK.size() < k) ? -1.0f : topK.front().first;
+
+        // Pivot: first document where the terms up to it could beat the threshold
+        float upperBound = 0;
+        int pivot = -1;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            upperBound += order[i]->maxScore;
+            if (upperBound > threshold)
+            {
+                pivot = (int)i;
+                break;
+            }
+        }
+        if (pivot < 0)
+            break;
+
+        uint32_t pivotDocument = order[pivot]->document;
+        while (pivot + 1 < (int)order.size() && order[pivot + 1]->document == pivotDocument)
+            pivot++;
+
+        if (filter && !filter->contains(pivotDocument))
+        {
+            // No document before the next one the filter keeps can be a result
+            uint32_t target = filter->getNext(pivotDocument);
+            for (int i = 0; i <= pivot; i++)
+                advance(*order[i], target);
+            continue;
+        }
+
+        // Refine the bound with the blocks that hold the pivot
+        float blockUpperBound = 0;
+        uint32_t blockBoundary = NO_DOCUMENT;
+        for (int i = 0; i <= pivot; i++)
+        {
+            Cursor &cursor = *order[i];
+            moveToBlock(cursor, pivotDocument);
+            if (cursor.block < cursor.blockEnd)
+            {
+                blockUpperBound += blockMaxScores[cursor.block];
+                blockBoundary = min(blockBoundary, blockLastDocuments[cursor.block] + 1);
+            }
+        }
+
+        if (blockUpperBound <= threshold)
+        {
+            // No document before the end of these blocks can make it
+            uint32_t target = blockBoundary;
+            if (pivot + 1 < (int)order.size())
+                target = min(target, order[pivot + 1]->document);
+
+            for (int i = 0; i <= pivot; i++)
+                advance(*order[i], target);
+            continue;
+        }
+
+        if (order[0]->document == pivotDocument)
+        {
+            float score = 0;
+            for (int i = 0; i <= pivot; i++)
+                score += postingScores[order[i]->position];
+            candidatesScored++;
+
+            if (topK.size() < k)
+            {
+                topK.emplace_back(score, pivotDocument);
+                push_heap(topK.begin(), topK.end(), worseResult);
+            }
+            else if (score > topK.front().first)
+            {
+                pop_heap(topK.begin(), topK.end(), worseResult);
+                topK.back() = make_pair(score, pivotDocument);
+                push_heap(topK.begin(), topK.end(), worseResult);
+            }
+
+            for (int i = 0; i <= pivot; i++)
+                advance(*order[i], pivotDocument + 1);
+        }
+        else
+        {
+            // Documents before the pivot cannot make it with the terms that come before it
+            for (int i = 0; i < pivot && order[i]->document < pivotDocument; i++)
+                advance(*order[i], pivotDocument);
+        }
+    }
+
+    sort(topK.begin(), topK.end(), worseResult);
+    for (auto &result : topK)
+        results.emplace_back(result.second, result.first);
+
+    if (trace)
+    {
+        trace->candidatesScored += candidatesScored;
+        for (auto &cursor : cursors)
+            trace->addTermStatistics(cursor.termIndex, cursor.postingsScanned,
+                                     cursor.end - cursor.start);
+    }
+}
+
+/**
+ *@brief Finds the best k documents among the ones that contain every term
+ *
+ *@param terms          searched terms; a document scores the sum of their term frequencies
+ *@param filter         if given, only its documents can be results
+ *@param k              number of results wanted
+ *@param results        best documents and their scores, best first
+ *@param matchCount     number of documents that contain every term
+ *@param trace          trace of the request, if it is being traced
+ **/
+void InvertedIndex::searchAllTopK(const vector<string> &terms, const RoaringBitmap *filter,
+                                  size_t k, vector<pair<uint32_t, float>> &results,
+                                  size_t &matchCount, QueryTrace *trace)
+{
+    results.clear();
+    matchCount = 0;
+    if (!frozen || k == 0 || terms.empty())
+        return;
+
+    vector<uint32_t> termIds(terms.size(), 0);
+    vector<uint32_t> documentFrequencies(terms.size(), 0);
+    for (size_t i = 0; i < terms.size(); i++)
+    {
+        if (findTerm(terms[i], termIds[i]))
+            documentFrequencies[i] = termOffsets[termIds[i] + 1] - termOffsets[termIds[i]];
+    }
+
+    // Candidates: the documents that contain every term so far and their scores
+    vector<pair<uint32_t, float>> candidates;
+    vector<uint64_t> postingsRead(terms.size(), 0);
+    vector<size_t> order;
+
+    if (QueryPlanner::orderTerms(documentFrequencies, order))
+    {
+        size_t firstStep = 1;
+        if (filter && filter->getCardinality() < documentFrequencies[order[0]])
+        {
+            // The filter is smaller than the rarest term, so every term is intersected with it
+            vector<uint32_t> filterDocuments;
+            filter->getValues(filterDocuments);
+            candidates.reserve(filterDocuments.size());
+            for (uint32_t document : filterDocuments)
+                candidates.emplace_back(document, 0.0f);
+            firstStep = 0;
+        }
+        else
+        {
+            uint32_t rarestTerm = termIds[order[0]];
+            candidates.reserve(documentFrequencies[order[0]]);
+            for (uint32_t position = termOffsets[rarestTerm];
+                 position < termOffsets[rarestTerm + 1]; position++)
+            {
+                if (!filter || filter->contains(postingDocuments[position]))
+                    candidates.emplace_back(postingDocuments[position], postingScores[position]);
+            }
+            postingsRead[order[0]] = documentFrequencies[order[0]];
+        }
+
+        for (size_t step = firstStep; step < order.size() && !candidates.empty(); step++)
+        {
+            size_t term = order[step];
+            auto bitmap = termBitmaps.find(termIds[term]);
+
+            switch (QueryPlanner::chooseStrategy(candidates.size(), documentFrequencies[term],
+                                                 bitmap != termBitmaps.end()))
+            {
+            case INTERSECTION_MERGE:
+                postingsRead[term] = intersectMerge(candidates, termIds[term]);
+                break;
+            case INTERSECTION_GALLOPING:
+                postingsRead[term] = intersectGalloping(candidates, termIds[term]);
+                break;
+            case INTERSECTION_BITMAP:
+                postingsRead[term] = intersectBitmap(candidates, termIds[term], bitmap->second);
+                break;
+            }
+        }
+    }
+
+    matchCount = candidates.size();
+
+    size_t resultCount = min(k, candidates.size());
+    partial_sort(candidates.begin(), candidates.begin() + resultCount, candidates.end(),
+                 [](const pair<uint32_t, float> &a, const pair<uint32_t, float> &b) {
+                     return a.second > b.second || (a.second == b.second && a.first < b.first);
+                 });
+    results.assign(candidates.begin(), candidates.begin() + resultCount);
+
+    if (trace)
+    {
+        trace->candidatesScored += candidates.size();
+        for (size_t i = 0; i < terms.size(); i++)
+            trace->addTermStatistics(i, postingsRead[i], documentFrequencies[i]);
+    }
+}
+
+/**
+ *@brief Keeps the candidates that contain a term by walking both lists
+ *
+ *@return uint64_t      postings read
+ **/
+uint64_t InvertedIndex::intersectMerge(vector<pair<uint32_t, float>> &candidates,
+                                       uint32_t termId)
+{
+    uint32_t position = termOffsets[termId];
+    uint32_t end = termOffsets[termId + 1];
+    size_t keptCount = 0;
+
+    for (size_t i = 0; i < candidates.size() && position < end; i++)
+    {
+        while (position < end && postingDocuments[position] < candidates[i].first)
+            position++;
+
+        if (position < end && postingDocuments[position] == candidates[i].first)
+        {
+            candidates[keptCount].first = candidates[i].first;
+            candidates[keptCount++].second = candidates[i].second + postingScores[position++];
+        }
+    }
+
+    candidates.resize(keptCount);
+
+    return position - termOffsets[termId];
+}
+
+/**
+ *@brief Keeps the candidates that contain a term by looking every candidate up in its postings
+ *       with exponential search from the last one found
+ *
+ *@return uint64_t      postings read
+ **/
+uint64_t InvertedIndex::intersectGalloping(vector<pair<uint32_t, float>> &candidates,
+                                           uint32_t termId)
+{
+    uint32_t position = termOffsets[termId];
+    uint32_t end = termOffsets[termId + 1];
+    size_t keptCount = 0;
+    uint64_t postingsRead = 0;
+
+    for (size_t i = 0; i < candidates.size() && position < end; i++)
+    {
+        uint32_t target = candidates[i].first;
+
+        // Every posting before low is known to be smaller than the target
+        uint32_t low = position;
+        uint32_t high = position;
+        for (uint32_t step = 1; high < end && postingDocuments[high] < target; step *= 2)
+        {
+            low = high + 1;
+            high = position + step;
+            postingsRead++;
+        }
+        high = (high < end) ? high + 1 : end;
+
+        for (uint32_t range = high - low; range > 0; range /= 2)
+            postingsRead++;
+        position = (uint32_t)(lower_bound(postingDocuments.begin() + low,
+                                          postingDocuments.begin() + high, target) -
+                              postingDocuments.begin());
+
+        if (position < end && postingDocuments[position] == target)
+        {
+            candidates[keptCount].first = target;
+            candidates[keptCount++].second = candidates[i].second + postingScores[position++];
+        }
+    }
+
+    candidates.resize(keptCount);
+
+    return postingsRead;
+}
+
+/**
+ *@brief Keeps the candidates that contain a term by testing them in its bitmap
+ *
+ *@return uint64_t      bitmap words read
+ **/
+uint64_t InvertedIndex::intersectBitmap(vector<pair<uint32_t, float>> &candidates,
+                                        uint32_t termId, uint32_t bitmap)
+{
+    const uint64_t *words = bitmapWords.data() + (size_t)bitmap * bitmapWordCount;
+    const uint32_t *ranks = bitmapRanks.data() + (size_t)bitmap * bitmapWordCount;
+    uint64_t postingsRead = candidates.size();
+    size_t keptCount = 0;
+
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        uint32_t document = candidates[i].first;
+        uint64_t word = words[document / 64];
+        uint64_t bit = 1ull << (document % 64);
+        if (!(word & bit))
+            continue;
+
+        // The rank of the document in the bitmap is its position in the postings
+        uint32_t position = termOffsets[termId] + ranks[document / 64] +
+                            (uint32_t)bitset<64>(word & (bit - 1)).count();
+        candidates[keptCount].first = document;
+        candidates[keptCount++].second = candidates[i].second + postingScores[position];
+    }
+
+    candidates.resize(keptCount);
+
+    return postingsRead;
+}
+
+/**
+ *@brief Looks a term up in the dictionary
+ **/
+bool InvertedIndex::findTerm(string_view term, uint32_t &termId)
+{
+    return termDictionary.find(term, termId);
+}
+
+/**
+ *@brief Moves a cursor to the first block that may hold target, without reading postings
+ **/
+void InvertedIndex::moveToBlock(Cursor &cursor, uint32_t target)
+{
+    while (cursor.block < cursor.blockEnd && blockLastDocuments[cursor.block] < target)
+        cursor.block++;
+}
+
+/**
+ *@brief Moves a cursor to the first posting whose document is at least target
+ **/
+void InvertedIndex::advance(Cursor &cursor, uint32_t target)
+{
+    if (cursor.document >= target)
+        return;
+
+    moveToBlock(cursor, target);
+    if (cursor.block == cursor.blockEnd)
+    {
+        cursor.document = NO_DOCUMENT;
+        return;
+    }
+
+    // Whole blocks before the target are skipped without reading their postings
+    uint32_t blockStart = cursor.start + (cursor.block - cursor.firstBlock) * POSTING_BLOCK_SIZE;
+    cursor.position = max(cursor.position, blockStart);
+
+    while (postingDocuments[cursor.position] < target)
+    {
+        cursor.position++;
+        cursor.postingsScanned++;
+    }
+
+    cursor.document = postingDocuments[cursor.position];
+}
@@ -0,0 +1,94 @@
+/**
+ * @file InvertedIndex.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief In-memory inverted index of a shard with Block-Max WAND top-k retrieval
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef INVERTEDINDEX_H
+#define INVERTEDINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MemoryUsage.h"
+#include "RoaringBitmap.h"
+#include "TermDictionary.h"
+
+// Postings per block; every block stores its last document and its best score
+#define POSTING_BLOCK_SIZE 64
+// Terms in at least one of every BITMAP_TERM_DENSITY documents also get a bitmap
+#define BITMAP_TERM_DENSITY 32
+
+struct QueryTrace;
+
+class InvertedIndex
+{
+public:
+    InvertedIndex();
+
+    /*Building*/
+    void addDocument(uint32_t document, const std::vector<std::string> &tokens);
+    void freeze();
+
+    /*Searching*/
+    bool isFrozen();
+    size_t getDocumentCount();
+    size_t getTermCount();
+    void getMemoryUsage(MemoryUsage &usage) const;
+    uint32_t getDocumentFrequency(std::string_view term);
+    void searchTopK(const std::vector<std::string> &terms, const RoaringBitmap *filter, size_t k,
+                    std::vector<std::pair<uint32_t, float>> &results, size_t &matchCount,
+                    QueryTrace *trace = nullptr);
+    void searchAllTopK(const std::vector<std::string> &terms, const RoaringBitmap *filter,
+                       size_t k, std::vector<std::pair<uint32_t, float>> &results,
+                       size_t &matchCount, QueryTrace *trace = nullptr);
+
+private:
+    struct Cursor;
+
+    bool findTerm(std::string_view term, uint32_t &termId);
+    void advance(Cursor &cursor, uint32_t target);
+    void moveToBlock(Cursor &cursor, uint32_t target);
+
+    uint64_t intersectMerge(std::vector<std::pair<uint32_t, float>> &candidates,
+                            uint32_t termId);
+    uint64_t intersectGalloping(std::vector<std::pair<uint32_t, float>> &candidates,
+                                uint32_t termId);
+    uint64_t intersectBitmap(std::vector<std::pair<uint32_t, float>> &candidates,
+                             uint32_t termId, uint32_t bitmap);
+
+    bool frozen;
+    uint32_t documentCount;
+
+    // Only used while building
+    std::unordered_map<std::string, std::vector<std::pair<uint32_t, float>>> buildPostings;
+
+    // Frozen layout: the postings of term t are [termOffsets[t], termOffsets[t + 1]) and its
+    // blocks are [blockOffsets[t], blockOffsets[t + 1]). Terms are numbered by the dictionary.
+    TermDictionary termDictionary;
+    std::vector<uint32_t> termOffsets;
+    std::vector<float> termMaxScores;
+    std::vector<uint32_t> postingDocuments;
+    std::vector<float> postingScores;
+    std::vector<uint32_t> blockOffsets;
+    std::vector<uint32_t> blockLastDocuments;
+    std::vector<float> blockMaxScores;
+
+    // Bitmaps of the terms that are in many documents, bitmapWordCount words each, back to
+    // back. termBitmaps maps a term to its bitmap; bitmapRanks holds the postings of the term
+    // before every word of its bitmap, so a document is found in the postings in O(1).
+    std::unordered_map<uint32_t, uint32_t> termBitmaps;
+    size_t bitmapWordCount;
+    std::vector<uint64_t> bitmapWords;
+    std::vector<uint32_t> bitmapRanks;
+};
+
+#endif
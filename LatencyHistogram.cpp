@@ -0,0 +1,158 @@
+/**
+ * @file LatencyHistogram.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Lock-free log-linear latency histogram
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Values are bucketed by their highest set bit and the HISTOGRAM_SUB_BUCKET_BITS bits that
+ * follow it, so recording is a couple of shifts and one relaxed atomic increment. Histograms
+ * recorded by different threads can be merged when they are reported.
+ *
+ */
+
+#include "LatencyHistogram.h"
+
+using namespace std;
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+/**
+ *@brief Records a value. Safe to call from several threads at once.
+ *
+ *@param value          value to record (e.g. a latency in nanoseconds)
+ **/
+void LatencyHistogram::record(uint64_t value)
+{
+    buckets[getBucketIndex(value)].fetch_add(1, memory_order_relaxed);
+    count.fetch_add(1, memory_order_relaxed);
+    sum.fetch_add(value, memory_order_relaxed);
+
+    uint64_t currentMax = max.load(memory_order_relaxed);
+    while (value > currentMax &&
+           !max.compare_exchange_weak(currentMax, value, memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ *@brief Adds the values recorded by another histogram to this one
+ **/
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; i++)
+        buckets[i].fetch_add(other.buckets[i].load(memory_order_relaxed), memory_order_relaxed);
+
+    count.fetch_add(other.count.load(memory_order_relaxed), memory_order_relaxed);
+    sum.fetch_add(other.sum.load(memory_order_relaxed), memory_order_relaxed);
+
+    uint64_t otherMax = other.max.load(memory_order_relaxed);
+    uint64_t currentMax = max.load(memory_order_relaxed);
+    while (otherMax > currentMax &&
+           !max.compare_exchange_weak(currentMax, otherMax, memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; i++)
+        buckets[i].store(0, memory_order_relaxed);
+
+    count.store(0, memory_order_relaxed);
+    sum.store(0, memory_order_relaxed);
+    max.store(0, memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+    return count.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getSum() const
+{
+    return sum.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getMax() const
+{
+    return max.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getBucketCount(int bucket) const
+{
+    return buckets[bucket].load(memory_order_relaxed);
+}
+
+/**
+ *@brief Estimates a percentile from the buckets
+ *
+ *@param percentile     percentile in [0, 100]
+ *
+ *@return uint64_t      upper bound of the bucket holding the percentile (never above the max)
+ **/
+uint64_t LatencyHistogram::getPercentile(double percentile) const
+{
+    uint64_t total = getCount();
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total);
+    if (rank >= total)
+        rank = total - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKET_COUNT; i++)
+    {
+        seen += getBucketCount(i);
+        if (seen > rank)
+        {
+            uint64_t upperBound = getBucketUpperBound(i);
+            return upperBound < getMax() ? upperBound : getMax();
+        }
+    }
+
+    return getMax();
+}
+
+/**
+ *@brief Maps a value to its bucket
+ **/
+int LatencyHistogram::getBucketIndex(uint64_t value)
+{
+    const uint64_t subBucketCount = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+
+    // Small values get one exact bucket each
+    if (value < subBucketCount)
+        return (int)value;
+
+    int highestBit = 63;
+    while (!(value & (1ULL << highestBit)))
+        highestBit--;
+
+    int shift = highestBit - HISTOGRAM_SUB_BUCKET_BITS;
+    int subBucket = (int)((value >> shift) & (subBucketCount - 1));
+
+    return (shift + 1) * (int)subBucketCount + subBucket;
+}
+
+/**
+ *@brief Largest value that falls in a bucket
+ **/
+uint64_t LatencyHistogram::getBucketUpperBound(int bucket)
+{
+    const int subBucketCount = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+
+    if (bucket < subBucketCount)
+        return bucket;
+
+    int shift = bucket / subBucketCount - 1;
+    uint64_t subBucket = bucket % subBucketCount;
+    uint64_t lowerBound = (subBucketCount + subBucket) << shift;
+
+    return lowerBound + (1ULL << shift) - 1;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file LatencyHistogram.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Lock-free log-linear latency histogram
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+// Every power of two is split into 2^HISTOGRAM_SUB_BUCKET_BITS buckets (~12% relative error)
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+#define HISTOGRAM_BUCKET_COUNT (64 << HISTOGRAM_SUB_BUCKET_BITS)
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(uint64_t value);
+    void merge(const LatencyHistogram &other);
+    void reset();
+
+    uint64_t getCount() const;
+    uint64_t getSum() const;
+    uint64_t getMax() const;
+    uint64_t getPercentile(double percentile) const;
+    uint64_t getBucketCount(int bucket) const;
+
+    static int getBucketIndex(uint64_t value);
+    static uint64_t getBucketUpperBound(int bucket);
+
+private:
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKET_COUNT];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+};
+
+#endif
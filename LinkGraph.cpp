@@ -0,0 +1,178 @@
+/**
+ * @file LinkGraph.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Link graph of the wiki in compressed sparse row form, and its PageRank
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * The graph is stored transposed: every page keeps the pages that link to it, in one flat
+ * array. An iteration of PageRank then "pulls" the rank of the sources of every page, so the
+ * pages can be split in ranges that are updated in parallel without any locking.
+ *
+ * Pages without outgoing links spread their rank over every page, so the ranks always add up
+ * to 1.
+ *
+ * @cite Page, Brin, Motwani, Winograd - The PageRank citation ranking (1999)
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "LinkGraph.h"
+
+using namespace std;
+
+// Pages updated by one task of an iteration
+#define PAGERANK_TASK_SIZE 4096
+
+/**
+ *@brief class constructor
+ *
+ *@param pageCount      number of pages, numbered from 0
+ *@param links          source vs target of every link. Repeated links count once and links
+ *                      of a page to itself are ignored. The vector is sorted in place.
+ **/
+LinkGraph::LinkGraph(uint32_t pageCount, vector<pair<uint32_t, uint32_t>> &links)
+{
+    this->pageCount = pageCount;
+
+    links.erase(remove_if(links.begin(), links.end(),
+                          [pageCount](const pair<uint32_t, uint32_t> &link) {
+                              return link.first == link.second || link.first >= pageCount ||
+                                     link.second >= pageCount;
+                          }),
+                links.end());
+
+    // By target, so that the sources of every page end up next to each other
+    sort(links.begin(), links.end(),
+         [](const pair<uint32_t, uint32_t> &a, const pair<uint32_t, uint32_t> &b) {
+             return a.second < b.second || (a.second == b.second && a.first < b.first);
+         });
+    links.erase(unique(links.begin(), links.end()), links.end());
+
+    linkOffsets.assign(pageCount + 1, 0);
+    linkSources.reserve(links.size());
+    outDegrees.assign(pageCount, 0);
+
+    for (const auto &link : links)
+    {
+        linkOffsets[link.second + 1]++;
+        linkSources.push_back(link.first);
+        outDegrees[link.first]++;
+    }
+
+    for (uint32_t page = 0; page < pageCount; page++)
+        linkOffsets[page + 1] += linkOffsets[page];
+}
+
+uint32_t LinkGraph::getPageCount() const
+{
+    return pageCount;
+}
+
+size_t LinkGraph::getLinkCount() const
+{
+    return linkSources.size();
+}
+
+/**
+ *@brief Computes the PageRank of every page by power iteration
+ *
+ *@param pool           threads the iterations are spread over
+ *@param ranks          PageRank of every page, adding up to 1
+ *@param damping        probability of following a link instead of jumping to any page
+ *@param maxIterations  iterations after which the ranks are taken as they are
+ *@param tolerance      the iteration stops when the ranks change less than this in total
+ *
+ *@return int           number of iterations run
+ **/
+int LinkGraph::computePageRank(WorkStealingPool &pool, vector<float> &ranks, double damping,
+                               int maxIterations, double tolerance) const
+{
+    ranks.assign(pageCount, 0);
+    if (pageCount == 0)
+        return 0;
+
+    vector<double> rank(pageCount, 1.0 / pageCount);
+    vector<double> newRank(pageCount);
+    // Rank each page hands to every page it links to
+    vector<double> contribution(pageCount);
+
+    size_t taskCount = (pageCount + PAGERANK_TASK_SIZE - 1) / PAGERANK_TASK_SIZE;
+    vector<double> taskDanglingRanks(taskCount);
+    vector<double> taskChanges(taskCount);
+
+    int iteration = 0;
+    while (iteration < maxIterations)
+    {
+        iteration++;
+
+        vector<function<void()>> scatterTasks;
+        for (size_t task = 0; task < taskCount; task++)
+        {
+            scatterTasks.push_back([&, task]() {
+                uint32_t first = (uint32_t)(task * PAGERANK_TASK_SIZE);
+                uint32_t last = min(pageCount, first + PAGERANK_TASK_SIZE);
+                double danglingRank = 0;
+
+                for (uint32_t page = first; page < last; page++)
+                {
+                    if (outDegrees[page] == 0)
+                    {
+                        danglingRank += rank[page];
+                        contribution[page] = 0;
+                    }
+                    else
+                        contribution[page] = rank[page] / outDegrees[page];
+                }
+
+                taskDanglingRanks[task] = danglingRank;
+            });
+        }
+        pool.run(scatterTasks);
+
+        double danglingRank = 0;
+        for (double taskDanglingRank : taskDanglingRanks)
+            danglingRank += taskDanglingRank;
+        double baseRank = (1.0 - damping) / pageCount + damping * danglingRank / pageCount;
+
+        vector<function<void()>> gatherTasks;
+        for (size_t task = 0; task < taskCount; task++)
+        {
+            gatherTasks.push_back([&, task]() {
+                uint32_t first = (uint32_t)(task * PAGERANK_TASK_SIZE);
+                uint32_t last = min(pageCount, first + PAGERANK_TASK_SIZE);
+                double change = 0;
+
+                for (uint32_t page = first; page < last; page++)
+                {
+                    double linkedRank = 0;
+                    for (uint32_t i = linkOffsets[page]; i < linkOffsets[page + 1]; i++)
+                        linkedRank += contribution[linkSources[i]];
+
+                    newRank[page] = baseRank + damping * linkedRank;
+                    change += fabs(newRank[page] - rank[page]);
+                }
+
+                taskChanges[task] = change;
+            });
+        }
+        pool.run(gatherTasks);
+
+        rank.swap(newRank);
+
+        double change = 0;
+        for (double taskChange : taskChanges)
+            change += taskChange;
+        if (change < tolerance)
+            break;
+    }
+
+    for (uint32_t page = 0; page < pageCount; page++)
+        ranks[page] = (float)rank[page];
+
+    return iteration;
+}
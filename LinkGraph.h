@@ -0,0 +1,46 @@
+/**
+ * @file LinkGraph.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Link graph of the wiki in compressed sparse row form, and its PageRank
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef LINKGRAPH_H
+#define LINKGRAPH_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "WorkStealingPool.h"
+
+#define PAGERANK_DAMPING 0.85
+#define PAGERANK_MAX_ITERATIONS 100
+#define PAGERANK_TOLERANCE 1e-6
+
+class LinkGraph
+{
+public:
+    LinkGraph(uint32_t pageCount, std::vector<std::pair<uint32_t, uint32_t>> &links);
+
+    uint32_t getPageCount() const;
+    size_t getLinkCount() const;
+
+    int computePageRank(WorkStealingPool &pool, std::vector<float> &ranks,
+                        double damping = PAGERANK_DAMPING,
+                        int maxIterations = PAGERANK_MAX_ITERATIONS,
+                        double tolerance = PAGERANK_TOLERANCE) const;
+
+private:
+    uint32_t pageCount;
+
+    // Pages that link to page p are linkSources[linkOffsets[p], linkOffsets[p + 1])
+    std::vector<uint32_t> linkOffsets;
+    std::vector<uint32_t> linkSources;
+    std::vector<uint32_t> outDegrees;
+};
+
+#endif
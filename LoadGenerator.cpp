@@ -0,0 +1,393 @@
+/**
+ * @file LoadGenerator.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief HTTP load generator that replays searches and page fetches against edahttpd
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Searches are either replayed from a query log or drawn from the index vocabulary with a
+ * Zipfian distribution, and a configurable share of the requests fetch static www/wiki pages.
+ *
+ * With a target rate the generator runs open loop: request i is scheduled at i / rate seconds
+ * and its latency is measured from that scheduled time, so a slow server cannot hide its
+ * queueing delay by slowing the generator down (coordinated omission). Without a target rate
+ * every worker sends its next request as soon as the previous one returns.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#include <httplib.h>
+#include <sqlite3.h>
+
+#include "LoadGenerator.h"
+
+using namespace std;
+
+/**
+ *@brief class constructor
+ *
+ *@param host           address of the server under test
+ *@param port           port of the server under test
+ **/
+LoadGenerator::LoadGenerator(string host, int port) : nextQueryLogEntry(0), nextRequest(0)
+{
+    this->host = host;
+    this->port = port;
+
+    rate = 0;
+    duration = 0;
+    requestLimit = 0;
+    staticRatio = 0;
+    maxTermsPerQuery = 1;
+    elapsedTime = 0;
+
+    for (int i = 0; i < REQUEST_KIND_COUNT; i++)
+    {
+        errors[i] = 0;
+        bytesReceived[i] = 0;
+    }
+}
+
+/**
+ *@brief Loads a query log. Every line is either a full URL path (e.g. "/search?q=agua") or a
+ *       search string as typed by a user (e.g. "agua+fuego"). Queries are replayed in order.
+ *
+ *@param queryLogPath   path to the query log
+ *
+ *@return bool          true if at least one query was loaded
+ **/
+bool LoadGenerator::loadQueryLog(const string &queryLogPath)
+{
+    ifstream file(queryLogPath);
+    if (!file.is_open())
+    {
+        cerr << "Failed to open query log: " << queryLogPath << endl;
+        return false;
+    }
+
+    string line;
+    while (getline(file, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+
+        if (line[0] == '/')
+            queryLog.push_back(line);
+        else
+            queryLog.push_back("/search?q=" + encodeQueryString(line));
+    }
+
+    return !queryLog.empty();
+}
+
+/**
+ *@brief Builds the vocabulary synthetic searches are drawn from, using the most frequent words
+ *       of the articles stored in the index shards. Word of rank r is picked with probability
+ *       proportional to 1 / r^zipfExponent.
+ *
+ *@param databasePaths  index shards to read
+ *@param vocabularySize number of distinct words to keep
+ *@param zipfExponent   skew of the distribution (1.0 is classic Zipf)
+ *
+ *@return bool          true if some words were found
+ **/
+bool LoadGenerator::loadVocabulary(const vector<string> &databasePaths, size_t vocabularySize,
+                                   double zipfExponent)
+{
+    unordered_map<string, uint64_t> wordCounts;
+
+    for (const auto &databasePath : databasePaths)
+    {
+        sqlite3 *database;
+        if (sqlite3_open_v2(databasePath.c_str(), &database, SQLITE_OPEN_READONLY,
+                            nullptr) != SQLITE_OK)
+        {
+            cerr << "Failed to open database: " << sqlite3_errmsg(database) << endl;
+            sqlite3_close(database);
+            continue;
+        }
+
+        sqlite3_stmt *statement;
+        if (sqlite3_prepare_v2(database, "SELECT BODY FROM ARTICLES;", -1, &statement,
+                               nullptr) == SQLITE_OK)
+        {
+            while (sqlite3_step(statement) == SQLITE_ROW)
+            {
+                const char *body = (const char *)sqlite3_column_text(statement, 0);
+                if (!body)
+                    continue;
+
+                // Only plain ASCII words are kept: tokens with html entities or digits
+                // (e.g. "l&#237;quido" or "1984") are skipped
+                string word;
+                bool plainWord = true;
+                for (const char *c = body;; c++)
+                {
+                    unsigned char character = (unsigned char)*c;
+                    if (isalnum(character) || character == '&' || character == '#' ||
+                        character == ';')
+                    {
+                        plainWord = plainWord && isalpha(character);
+                        word += (char)tolower(character);
+                        continue;
+                    }
+
+                    if (plainWord && word.size() >= 3)
+                        wordCounts[word]++;
+                    word.clear();
+                    plainWord = true;
+
+                    if (!character)
+                        break;
+                }
+            }
+            sqlite3_finalize(statement);
+        }
+
+        sqlite3_close(database);
+    }
+
+    vector<pair<string, uint64_t>> sortedWords(wordCounts.begin(), wordCounts.end());
+    sort(sortedWords.begin(), sortedWords.end(),
+         [](const pair<string, uint64_t> &a, const pair<string, uint64_t> &b) {
+             return a.second > b.second || (a.second == b.second && a.first < b.first);
+         });
+
+    if (sortedWords.size() > vocabularySize)
+        sortedWords.resize(vocabularySize);
+
+    vocabulary.clear();
+    vocabularyWeights.clear();
+
+    double cumulativeWeight = 0;
+    for (size_t rank = 0; rank < sortedWords.size(); rank++)
+    {
+        cumulativeWeight += 1.0 / pow((double)(rank + 1), zipfExponent);
+        vocabulary.push_back(sortedWords[rank].first);
+        vocabularyWeights.push_back(cumulativeWeight);
+    }
+
+    return !vocabulary.empty();
+}
+
+/**
+ *@brief Lists the static pages that can be fetched
+ *
+ *@param wikiPath       path to the www/wiki folder
+ *
+ *@return bool          true if some pages were found
+ **/
+bool LoadGenerator::loadStaticPages(const string &wikiPath)
+{
+    error_code error;
+    for (const auto &file : filesystem::directory_iterator(wikiPath, error))
+    {
+        if (file.is_regular_file())
+            staticPages.push_back("/wiki/" + encodeQueryString(file.path().filename().u8string()));
+    }
+
+    return !staticPages.empty();
+}
+
+/**
+ *@brief Checks that there is something to request: searches or static pages
+ **/
+bool LoadGenerator::canRun()
+{
+    return !queryLog.empty() || !vocabulary.empty() || !staticPages.empty();
+}
+
+/**
+ *@brief Sends requests until the duration or the request limit is reached
+ *
+ *@param concurrency        number of connections used in parallel
+ *@param rate               target requests per second, 0 to send as fast as possible
+ *@param duration           seconds to run, 0 for no time limit
+ *@param requestLimit       number of requests to send, 0 for no limit
+ *@param staticRatio        share of the requests that fetch static pages, in [0, 1]
+ *@param maxTermsPerQuery   synthetic searches join 1 to maxTermsPerQuery words with an
+ *                          encoded '+' (%2B)
+ **/
+void LoadGenerator::run(int concurrency, double rate, double duration, uint64_t requestLimit,
+                        double staticRatio, int maxTermsPerQuery)
+{
+    this->rate = rate;
+    this->duration = duration;
+    this->requestLimit = requestLimit;
+    this->staticRatio = (staticPages.empty()) ? 0 : staticRatio;
+    this->maxTermsPerQuery = max(1, maxTermsPerQuery);
+
+    if (queryLog.empty() && vocabulary.empty())
+        this->staticRatio = 1;
+
+    if (duration <= 0 && requestLimit == 0)
+        this->duration = 10;
+
+    startTime = chrono::steady_clock::now();
+
+    vector<thread> workers;
+    for (int i = 0; i < max(1, concurrency); i++)
+        workers.emplace_back(&LoadGenerator::workerLoop, this, i);
+
+    for (auto &worker : workers)
+        worker.join();
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+    elapsedTime = elapsed.count();
+}
+
+/**
+ *@brief Prints throughput and latency percentiles, split by request kind
+ **/
+void LoadGenerator::printReport(ostream &output)
+{
+    const char *kindNames[REQUEST_KIND_COUNT] = {"search", "static"};
+
+    LatencyHistogram total;
+    uint64_t totalErrors = 0;
+    uint64_t totalBytes = 0;
+
+    output << fixed << setprecision(2);
+    output << "Ran for " << elapsedTime << " s" << endl << endl;
+    output << left << setw(8) << "kind" << right << setw(10) << "requests" << setw(8)
+           << "errors" << setw(10) << "req/s" << setw(10) << "MB/s" << setw(10) << "p50 ms"
+           << setw(10) << "p90 ms" << setw(10) << "p99 ms" << setw(10) << "p999 ms" << setw(10)
+           << "max ms" << endl;
+
+    auto printRow = [&](const char *name, const LatencyHistogram &histogram, uint64_t kindErrors,
+                        uint64_t kindBytes) {
+        double seconds = (elapsedTime > 0) ? elapsedTime : 1;
+
+        output << left << setw(8) << name << right << setw(10) << histogram.getCount()
+               << setw(8) << kindErrors << setw(10) << histogram.getCount() / seconds
+               << setw(10) << kindBytes / seconds / (1024.0 * 1024.0)
+               << setw(10) << histogram.getPercentile(50) / 1e6
+               << setw(10) << histogram.getPercentile(90) / 1e6
+               << setw(10) << histogram.getPercentile(99) / 1e6
+               << setw(10) << histogram.getPercentile(99.9) / 1e6
+               << setw(10) << histogram.getMax() / 1e6 << endl;
+    };
+
+    for (int i = 0; i < REQUEST_KIND_COUNT; i++)
+    {
+        printRow(kindNames[i], latencies[i], errors[i], bytesReceived[i]);
+
+        total.merge(latencies[i]);
+        totalErrors += errors[i];
+        totalBytes += bytesReceived[i];
+    }
+
+    printRow("total", total, totalErrors, totalBytes);
+}
+
+void LoadGenerator::workerLoop(int workerIndex)
+{
+    mt19937_64 random(0x5eed + workerIndex);
+    uniform_real_distribution<double> uniform(0, 1);
+
+    httplib::Client client(host, port);
+    client.set_keep_alive(true);
+    client.set_connection_timeout(10);
+    client.set_read_timeout(30);
+
+    while (true)
+    {
+        uint64_t requestIndex = nextRequest++;
+        if (requestLimit > 0 && requestIndex >= requestLimit)
+            break;
+
+        auto scheduledTime = chrono::steady_clock::now();
+        if (rate > 0)
+        {
+            scheduledTime = startTime + chrono::duration_cast<chrono::steady_clock::duration>(
+                                            chrono::duration<double>(requestIndex / rate));
+            this_thread::sleep_until(scheduledTime);
+        }
+
+        if (duration > 0 && scheduledTime - startTime > chrono::duration<double>(duration))
+            break;
+
+        RequestKind kind = (uniform(random) < staticRatio) ? STATIC_REQUEST : SEARCH_REQUEST;
+        string url = (kind == STATIC_REQUEST) ? getNextStaticUrl(random) : getNextSearchUrl(random);
+
+        auto response = client.Get(url);
+        auto endTime = chrono::steady_clock::now();
+
+        latencies[kind].record(
+            chrono::duration_cast<chrono::nanoseconds>(endTime - scheduledTime).count());
+
+        if (!response || response->status != 200)
+            errors[kind]++;
+        else
+            bytesReceived[kind] += response->body.size();
+    }
+}
+
+/**
+ *@brief Next search: the next query log entry or a Zipfian draw from the vocabulary
+ **/
+string LoadGenerator::getNextSearchUrl(mt19937_64 &random)
+{
+    if (!queryLog.empty())
+        return queryLog[nextQueryLogEntry++ % queryLog.size()];
+
+    uniform_real_distribution<double> uniform(0, vocabularyWeights.back());
+    uniform_int_distribution<int> termCount(1, maxTermsPerQuery);
+
+    string query;
+    for (int i = termCount(random); i > 0; i--)
+    {
+        auto word = lower_bound(vocabularyWeights.begin(), vocabularyWeights.end(),
+                                uniform(random));
+        size_t rank = min((size_t)(word - vocabularyWeights.begin()), vocabulary.size() - 1);
+
+        // A literal '+' would reach the server as a space
+        if (!query.empty())
+            query += "%2B";
+        query += vocabulary[rank];
+    }
+
+    return "/search?q=" + query;
+}
+
+string LoadGenerator::getNextStaticUrl(mt19937_64 &random)
+{
+    uniform_int_distribution<size_t> page(0, staticPages.size() - 1);
+
+    return staticPages[page(random)];
+}
+
+/**
+ *@brief Percent-encodes everything but unreserved characters. The term separator '+' is
+ *       encoded too, since a literal '+' in a query string is read as a space.
+ **/
+string LoadGenerator::encodeQueryString(const string &query)
+{
+    const char *hexDigits = "0123456789ABCDEF";
+    string encodedQuery;
+
+    for (unsigned char c : query)
+    {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+            encodedQuery += (char)c;
+        else
+        {
+            encodedQuery += '%';
+            encodedQuery += hexDigits[c >> 4];
+            encodedQuery += hexDigits[c & 0xf];
+        }
+    }
+
+    return encodedQuery;
+}
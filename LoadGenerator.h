@@ -0,0 +1,75 @@
+/**
+ * @file LoadGenerator.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief HTTP load generator that replays searches and page fetches against edahttpd
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "LatencyHistogram.h"
+
+class LoadGenerator
+{
+public:
+    LoadGenerator(std::string host, int port);
+
+    bool loadQueryLog(const std::string &queryLogPath);
+    bool loadVocabulary(const std::vector<std::string> &databasePaths, size_t vocabularySize,
+                        double zipfExponent);
+    bool loadStaticPages(const std::string &wikiPath);
+    bool canRun();
+
+    void run(int concurrency, double rate, double duration, uint64_t requestLimit,
+             double staticRatio, int maxTermsPerQuery);
+    void printReport(std::ostream &output);
+
+private:
+    enum RequestKind
+    {
+        SEARCH_REQUEST,
+        STATIC_REQUEST,
+        REQUEST_KIND_COUNT
+    };
+
+    void workerLoop(int workerIndex);
+    std::string getNextSearchUrl(std::mt19937_64 &random);
+    std::string getNextStaticUrl(std::mt19937_64 &random);
+    static std::string encodeQueryString(const std::string &query);
+
+    std::string host;
+    int port;
+
+    std::vector<std::string> queryLog;
+    std::atomic<size_t> nextQueryLogEntry;
+    std::vector<std::string> vocabulary;
+    std::vector<double> vocabularyWeights;
+    std::vector<std::string> staticPages;
+
+    double rate;
+    double duration;
+    uint64_t requestLimit;
+    double staticRatio;
+    int maxTermsPerQuery;
+    std::chrono::steady_clock::time_point startTime;
+    double elapsedTime;
+    std::atomic<uint64_t> nextRequest;
+
+    LatencyHistogram latencies[REQUEST_KIND_COUNT];
+    std::atomic<uint64_t> errors[REQUEST_KIND_COUNT];
+    std::atomic<uint64_t> bytesReceived[REQUEST_KIND_COUNT];
+};
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file MemoryUsage.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Memory taken by every component of the index, in bytes
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Components report the capacity of their containers, not their size, since that is what
+ * they hold on to. Allocator overhead and the nodes of hash tables are left out, so the
+ * numbers are a slight underestimate of what the process takes for them.
+ *
+ */
+
+#include "MemoryUsage.h"
+
+/**
+ *@brief Gets the memory taken by the in-memory index, which is everything but SQLite
+ **/
+size_t MemoryUsage::getIndexTotal() const
+{
+    return dictionary + postings + termBitmaps + filterBitmaps + documents;
+}
+
+/**
+ *@brief Gets the memory taken by every component
+ **/
+size_t MemoryUsage::getTotal() const
+{
+    return getIndexTotal() + sqlite;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file MemoryUsage.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Memory taken by every component of the index, in bytes
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <cstddef>
+
+struct MemoryUsage
+{
+    // Term dictionaries of the inverted indexes
+    size_t dictionary = 0;
+    // Postings, their blocks and the best scores of terms and blocks
+    size_t postings = 0;
+    // Bitmaps of the terms in many documents, for match=all
+    size_t termBitmaps = 0;
+    // Bitmaps of the attribute values, for filters
+    size_t filterBitmaps = 0;
+    // What the results page shows of every document, and the maps from documents to rows
+    size_t documents = 0;
+    // Heap of SQLite, mostly the page caches of the open connections
+    size_t sqlite = 0;
+
+    size_t getIndexTotal() const;
+    size_t getTotal() const;
+};
+
+#endif
@@ -0,0 +1,256 @@
+/**
+ * @file Metrics.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Low-overhead per-stage latency histograms and counters, exported in Prometheus format
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Every thread records into its own set of histograms and counters, so the hot path is a
+ * monotonic clock read and a few relaxed atomic increments on cache lines no other thread
+ * writes. A lock is only taken the first time a thread records something (to register its
+ * set) and when /metrics is scraped (to merge all the sets).
+ *
+ */
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "Metrics.h"
+#include "SlowQueryLog.h"
+
+using namespace std;
+
+struct ThreadMetrics
+{
+    LatencyHistogram stages[STAGE_COUNT];
+    atomic<uint64_t> counters[COUNTER_COUNT];
+};
+
+struct Gauge
+{
+    string name;
+    string help;
+    function<double()> read;
+};
+
+struct MetricsRegistry
+{
+    mutex registryMutex;
+    vector<unique_ptr<ThreadMetrics>> threadMetrics;
+    vector<Gauge> gauges;
+};
+
+static const char *stageNames[STAGE_COUNT] = {
+    "request_parse",
+    "query_normalization",
+    "index_lookup",
+    "scoring",
+    "sorting",
+    "rendering",
+    "static_serving",
+};
+
+static const char *counterNames[COUNTER_COUNT][2] = {
+    {"edaoogle_search_requests_total", "Search requests received"},
+    {"edaoogle_static_requests_total", "Static file requests received"},
+    {"edaoogle_not_found_responses_total", "Requests answered with 404"},
+    {"edaoogle_bytes_served_total", "Response body bytes sent"},
+    {"edaoogle_cache_hits_total", "Lookups answered from a cache"},
+    {"edaoogle_cache_misses_total", "Lookups that missed a cache"},
+    {"edaoogle_shed_searches_total", "Searches answered with 503 because the queue was full"},
+    {"edaoogle_expired_searches_total", "Searches answered with 503 after waiting past their "
+                                        "deadline"},
+    {"edaoogle_coalesced_searches_total", "Searches that shared the result of an identical "
+                                          "search already running"},
+    {"edaoogle_shed_indexes_total", "Shard indexes dropped from memory to stay within the memory "
+                                    "budget"},
+    {"edaoogle_reloaded_indexes_total", "Shed shard indexes loaded back once they fit the memory "
+                                        "budget"},
+    {"edaoogle_shed_index_searches_total", "Shard searches that scanned the articles because "
+                                           "the shard index was shed"},
+};
+
+// Upper bounds of the exported histogram buckets, in seconds
+static const double bucketBounds[] = {0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005,
+                                      0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+                                      0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+static MetricsRegistry &getRegistry()
+{
+    // Never destroyed: threads may still record while the process exits
+    static MetricsRegistry *registry = new MetricsRegistry();
+    return *registry;
+}
+
+static ThreadMetrics &getThreadMetrics()
+{
+    thread_local ThreadMetrics *metrics = nullptr;
+
+    if (!metrics)
+    {
+        MetricsRegistry &registry = getRegistry();
+        lock_guard<mutex> lock(registry.registryMutex);
+
+        registry.threadMetrics.push_back(make_unique<ThreadMetrics>());
+        metrics = registry.threadMetrics.back().get();
+        for (auto &counter : metrics->counters)
+            counter.store(0, memory_order_relaxed);
+    }
+
+    return *metrics;
+}
+
+/**
+ *@brief Records the time spent in a stage
+ *
+ *@param stage          stage of request processing
+ *@param nanoseconds    time spent, from Metrics::getTime() differences
+ **/
+void Metrics::recordStage(MetricStage stage, uint64_t nanoseconds)
+{
+    getThreadMetrics().stages[stage].record(nanoseconds);
+}
+
+/**
+ *@brief Adds a value to a counter
+ **/
+void Metrics::addToCounter(MetricCounter counter, uint64_t value)
+{
+    getThreadMetrics().counters[counter].fetch_add(value, memory_order_relaxed);
+}
+
+/**
+ *@brief Registers (or replaces) a value that is read when the metrics are scraped
+ *
+ *@param name           Prometheus metric name
+ *@param help           description of the metric
+ *@param gauge          function that returns the current value
+ **/
+void Metrics::setGauge(const string &name, const string &help, function<double()> gauge)
+{
+    MetricsRegistry &registry = getRegistry();
+    lock_guard<mutex> lock(registry.registryMutex);
+
+    for (auto &existingGauge : registry.gauges)
+    {
+        if (existingGauge.name == name)
+        {
+            existingGauge.help = help;
+            existingGauge.read = gauge;
+            return;
+        }
+    }
+
+    registry.gauges.push_back({name, help, gauge});
+}
+
+/**
+ *@brief Renders all metrics in the Prometheus text exposition format
+ *
+ *@param output         rendered metrics
+ **/
+void Metrics::renderPrometheus(string &output)
+{
+    MetricsRegistry &registry = getRegistry();
+    lock_guard<mutex> lock(registry.registryMutex);
+
+    LatencyHistogram stages[STAGE_COUNT];
+    uint64_t counters[COUNTER_COUNT] = {0};
+
+    for (auto &threadMetrics : registry.threadMetrics)
+    {
+        for (int i = 0; i < STAGE_COUNT; i++)
+            stages[i].merge(threadMetrics->stages[i]);
+        for (int i = 0; i < COUNTER_COUNT; i++)
+            counters[i] += threadMetrics->counters[i].load(memory_order_relaxed);
+    }
+
+    stringstream ss;
+
+    ss << "# HELP edaoogle_stage_duration_seconds Time spent in each stage of a request" << endl
+       << "# TYPE edaoogle_stage_duration_seconds histogram" << endl;
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        string labels = string("stage=\"") + stageNames[i] + "\"";
+
+        // An internal bucket is counted under the first exported bound that contains it
+        uint64_t cumulativeCount = 0;
+        int bucket = 0;
+        for (double bound : bucketBounds)
+        {
+            uint64_t boundNanoseconds = (uint64_t)(bound * 1e9);
+            while (bucket < HISTOGRAM_BUCKET_COUNT &&
+                   LatencyHistogram::getBucketUpperBound(bucket) <= boundNanoseconds)
+                cumulativeCount += stages[i].getBucketCount(bucket++);
+
+            ss << "edaoogle_stage_duration_seconds_bucket{" << labels << ",le=\"" << bound
+               << "\"} " << cumulativeCount << endl;
+        }
+        ss << "edaoogle_stage_duration_seconds_bucket{" << labels << ",le=\"+Inf\"} "
+           << stages[i].getCount() << endl;
+        ss << "edaoogle_stage_duration_seconds_sum{" << labels << "} "
+           << stages[i].getSum() / 1e9 << endl;
+        ss << "edaoogle_stage_duration_seconds_count{" << labels << "} "
+           << stages[i].getCount() << endl;
+    }
+
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        ss << "# HELP " << counterNames[i][0] << " " << counterNames[i][1] << endl
+           << "# TYPE " << counterNames[i][0] << " counter" << endl
+           << counterNames[i][0] << " " << counters[i] << endl;
+    }
+
+    for (auto &gauge : registry.gauges)
+    {
+        ss << "# HELP " << gauge.name << " " << gauge.help << endl
+           << "# TYPE " << gauge.name << " gauge" << endl
+           << gauge.name << " " << gauge.read() << endl;
+    }
+
+    output = ss.str();
+}
+
+/**
+ *@brief Reads the monotonic clock
+ *
+ *@return uint64_t      nanoseconds since an arbitrary point in time
+ **/
+uint64_t Metrics::getTime()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+StageTimer::StageTimer(MetricStage stage, QueryTrace *trace)
+{
+    this->stage = stage;
+    this->trace = trace;
+    start = Metrics::getTime();
+    running = true;
+}
+
+StageTimer::~StageTimer()
+{
+    stop();
+}
+
+/**
+ *@brief Records the stage now instead of when the timer goes out of scope
+ **/
+void StageTimer::stop()
+{
+    if (!running)
+        return;
+
+    uint64_t elapsed = Metrics::getTime() - start;
+    Metrics::recordStage(stage, elapsed);
+    if (trace)
+        trace->addStageTime(stage, elapsed);
+
+    running = false;
+}
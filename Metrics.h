@@ -0,0 +1,84 @@
+/**
+ * @file Metrics.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Low-overhead per-stage latency histograms and counters, exported in Prometheus format
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "LatencyHistogram.h"
+
+enum MetricStage
+{
+    STAGE_REQUEST_PARSE,
+    STAGE_QUERY_NORMALIZATION,
+    STAGE_INDEX_LOOKUP,
+    STAGE_SCORING,
+    STAGE_SORTING,
+    STAGE_RENDERING,
+    STAGE_STATIC_SERVING,
+    STAGE_COUNT
+};
+
+enum MetricCounter
+{
+    COUNTER_SEARCH_REQUESTS,
+    COUNTER_STATIC_REQUESTS,
+    COUNTER_NOT_FOUND_RESPONSES,
+    COUNTER_BYTES_SERVED,
+    COUNTER_CACHE_HITS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_SHED_SEARCHES,
+    COUNTER_EXPIRED_SEARCHES,
+    COUNTER_COALESCED_SEARCHES,
+    COUNTER_SHED_INDEXES,
+    COUNTER_RELOADED_INDEXES,
+    COUNTER_SHED_INDEX_SEARCHES,
+    COUNTER_COUNT
+};
+
+struct QueryTrace;
+
+class Metrics
+{
+public:
+    static void recordStage(MetricStage stage, uint64_t nanoseconds);
+    static void addToCounter(MetricCounter counter, uint64_t value = 1);
+    static void setGauge(const std::string &name, const std::string &help,
+                         std::function<double()> gauge);
+
+    static void renderPrometheus(std::string &output);
+
+    static uint64_t getTime();
+};
+
+/**
+ * @brief Records the time between its construction and its destruction (or stop()) as a stage,
+ *        and adds it to the trace of the request when there is one
+ */
+class StageTimer
+{
+public:
+    StageTimer(MetricStage stage, QueryTrace *trace = nullptr);
+    ~StageTimer();
+
+    void stop();
+
+private:
+    MetricStage stage;
+    QueryTrace *trace;
+    uint64_t start;
+    bool running;
+};
+
+#endif
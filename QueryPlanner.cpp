@@ -0,0 +1,130 @@
+/**
+ * @file QueryPlanner.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Cost-based planning of the searches that require every word
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * A search with match=all only returns the articles that contain every word, so its cost
+ * should follow its rarest word, not the words as they were typed. The planner orders the
+ * words by document frequency, rarest first: the candidates start as the articles of the rarest
+ * word and can only shrink. A word that is in no article ends the search before anything is
+ * read.
+ *
+ * Every following word is intersected with the candidates in the cheapest way for the sizes of
+ * both lists:
+ *      merge       walks both lists; best when they are about the same size
+ *      galloping   looks every candidate up in the postings with exponential then binary
+ *                  search, about log(postings / candidates) probes each; best when the
+ *                  postings are much longer than the candidates
+ *      bitmap      tests every candidate in the bitmap of the word, which only the words that
+ *                  are in a large share of the articles have; one probe each
+ * The strategy is chosen at every step with the real number of candidates left, not with an
+ * estimate, since words are rarely independent.
+ *
+ * Searches that scan the articles text (phrases) are ordered the same way, with the document
+ * frequencies of their terms as an estimate, and every scan after the first only reads the
+ * articles that are still candidates.
+ *
+ * @cite Culpepper, Moffat - Efficient set intersection for inverted indexing (ACM TOIS, 2010)
+ * @cite Demaine, López-Ortiz, Munro - Adaptive set intersections, unions, and differences
+ *       (SODA 2000)
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "QueryPlanner.h"
+
+using namespace std;
+
+/**
+ *@brief Orders the words of a search by document frequency, rarest first
+ *
+ *@param documentFrequencies    number of articles that contain each word
+ *@param order                  indexes of the words, in the order they should be intersected
+ *
+ *@return bool                  false if a word is in no article, so nothing can match
+ **/
+bool QueryPlanner::orderTerms(const vector<uint32_t> &documentFrequencies, vector<size_t> &order)
+{
+    order.clear();
+    for (uint32_t documentFrequency : documentFrequencies)
+    {
+        if (documentFrequency == 0)
+            return false;
+    }
+
+    orderWords(documentFrequencies, order);
+
+    return true;
+}
+
+/**
+ *@brief Orders the words of a search by the number of articles they are expected to match,
+ *       fewest first. Unlike orderTerms(), an estimate of 0 does not rule out a match.
+ *
+ *@param estimatedMatches       expected number of articles that contain each word
+ *@param order                  indexes of the words, in the order they should be scanned
+ **/
+void QueryPlanner::orderWords(const vector<uint32_t> &estimatedMatches, vector<size_t> &order)
+{
+    order.resize(estimatedMatches.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    // Stable, so that words with the same estimate keep the order they were typed in
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return estimatedMatches[a] < estimatedMatches[b];
+    });
+}
+
+/**
+ *@brief Chooses how to intersect the candidates with the postings of the next word
+ *
+ *@param candidateCount         articles that contain every word so far
+ *@param postingCount           articles that contain the next word
+ *@param hasBitmap              whether the next word has a bitmap
+ *
+ *@return IntersectionStrategy  the cheapest strategy
+ **/
+IntersectionStrategy QueryPlanner::chooseStrategy(size_t candidateCount, size_t postingCount,
+                                                  bool hasBitmap)
+{
+    IntersectionStrategy strategy = INTERSECTION_MERGE;
+    double cost = getCost(INTERSECTION_MERGE, candidateCount, postingCount);
+
+    double gallopingCost = getCost(INTERSECTION_GALLOPING, candidateCount, postingCount);
+    if (gallopingCost < cost)
+    {
+        strategy = INTERSECTION_GALLOPING;
+        cost = gallopingCost;
+    }
+
+    if (hasBitmap && getCost(INTERSECTION_BITMAP, candidateCount, postingCount) < cost)
+        strategy = INTERSECTION_BITMAP;
+
+    return strategy;
+}
+
+/**
+ *@brief Estimates the cost of an intersection, in postings read by a merge
+ **/
+double QueryPlanner::getCost(IntersectionStrategy strategy, size_t candidateCount,
+                             size_t postingCount)
+{
+    switch (strategy)
+    {
+    case INTERSECTION_MERGE:
+        return (double)candidateCount + postingCount;
+    case INTERSECTION_GALLOPING:
+        return GALLOPING_PROBE_COST * candidateCount *
+               (1 + log2(1 + (double)postingCount / max((size_t)1, candidateCount)));
+    case INTERSECTION_BITMAP:
+        return BITMAP_PROBE_COST * candidateCount;
+    }
+
+    return 0;
+}
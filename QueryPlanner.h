@@ -0,0 +1,44 @@
+/**
+ * @file QueryPlanner.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Cost-based planning of the searches that require every word
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef QUERYPLANNER_H
+#define QUERYPLANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Relative cost of a galloping probe against a posting read by a merge; a probe jumps around
+// the list, so it misses the cache more
+#define GALLOPING_PROBE_COST 2.0
+// Relative cost of looking a candidate up in a bitmap: a word read and a rank
+#define BITMAP_PROBE_COST 1.5
+
+enum IntersectionStrategy
+{
+    INTERSECTION_MERGE,
+    INTERSECTION_GALLOPING,
+    INTERSECTION_BITMAP,
+};
+
+class QueryPlanner
+{
+public:
+    static bool orderTerms(const std::vector<uint32_t> &documentFrequencies,
+                           std::vector<size_t> &order);
+    static void orderWords(const std::vector<uint32_t> &estimatedMatches,
+                           std::vector<size_t> &order);
+    static IntersectionStrategy chooseStrategy(size_t candidateCount, size_t postingCount,
+                                               bool hasBitmap);
+    static double getCost(IntersectionStrategy strategy, size_t candidateCount,
+                          size_t postingCount);
+};
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * @file RequestArena.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Per-request monotonic arena for the strings and vectors of a search
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * A search used to make hundreds of small heap allocations (terms, SQL strings, result paths,
+ * pieces of the page), all freed a few milliseconds later. With many requests in flight those
+ * allocations contend inside malloc and fragment the heap. The arena serves them from a buffer
+ * that lives inside the arena object itself (usually on the stack of the request) and only
+ * falls back to the heap, in geometrically growing blocks, when a search outgrows it.
+ *
+ */
+
+#include "RequestArena.h"
+
+using namespace std;
+
+/**
+ *@brief class constructor
+ **/
+RequestArena::RequestArena() :
+resource(initialBuffer, sizeof(initialBuffer), pmr::new_delete_resource())
+{
+}
+
+/**
+ *@brief Gets the memory resource to build the containers of the request with
+ **/
+pmr::memory_resource *RequestArena::getResource()
+{
+    return &resource;
+}
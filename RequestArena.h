@@ -0,0 +1,49 @@
+/**
+ * @file RequestArena.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Per-request monotonic arena for the strings and vectors of a search
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef REQUESTARENA_H
+#define REQUESTARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Enough for the terms, the top results and the rendered page of a typical search
+#define REQUEST_ARENA_INITIAL_SIZE 16384
+
+typedef std::pmr::string ArenaString;
+typedef std::pmr::vector<ArenaString> SearchTerms;
+typedef std::pair<uint32_t, float> SearchResult; // document number vs score
+typedef std::pmr::vector<SearchResult> SearchResults;
+
+/**
+ * @brief Memory that lives as long as one request. Allocations are a pointer bump and
+ *        deallocations are no-ops; everything is released at once when the arena is destroyed.
+ *        Not thread-safe: tasks that run in parallel must each use their own arena.
+ */
+class RequestArena
+{
+public:
+    RequestArena();
+
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    std::pmr::memory_resource *getResource();
+
+private:
+    alignas(std::max_align_t) char initialBuffer[REQUEST_ARENA_INITIAL_SIZE];
+    std::pmr::monotonic_buffer_resource resource;
+};
+
+#endif
@@ -0,0 +1,328 @@
+/**
+ * @file RoaringBitmap.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Compressed bitmap of 32-bit values (Roaring)
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Values are split by their upper 16 bits into containers of up to 65536 values. A container
+ * with few values keeps them as a sorted array of their lower 16 bits (2 bytes a value) and a
+ * full one as a plain bitmap (8 KB), whichever is smaller, so a sparse attribute costs about
+ * its number of documents and a dense one a bit per document. Intersections work container by
+ * container, with a merge, a lookup in a bitmap or an AND of words depending on the kinds of
+ * both containers.
+ *
+ * @cite Chambi, Lemire, Kaser, Godin - Better bitmap performance with Roaring bitmaps
+ *       (Software: Practice and Experience, 2016)
+ *
+ */
+
+#include <algorithm>
+#include <bitset>
+
+#include "RoaringBitmap.h"
+
+using namespace std;
+
+#define ROARING_BITMAP_WORDS (65536 / 64)
+
+/**
+ *@brief Gets the position of the lowest bit set in a word that is not 0
+ **/
+static uint32_t getLowestBit(uint64_t word)
+{
+    return (uint32_t)bitset<64>((word & (~word + 1)) - 1).count();
+}
+
+/**
+ *@brief class constructor
+ **/
+RoaringBitmap::RoaringBitmap()
+{
+}
+
+/**
+ *@brief Adds a value to the bitmap. Values are cheapest to add in increasing order.
+ **/
+void RoaringBitmap::add(uint32_t value)
+{
+    uint16_t key = (uint16_t)(value >> 16);
+    uint16_t low = (uint16_t)value;
+
+    size_t index = findContainer(key);
+    if (index == containers.size() || containers[index].key != key)
+    {
+        Container container;
+        container.key = key;
+        container.cardinality = 0;
+        containers.insert(containers.begin() + index, container);
+    }
+
+    Container &container = containers[index];
+    if (container.words.empty())
+    {
+        auto position = lower_bound(container.values.begin(), container.values.end(), low);
+        if (position != container.values.end() && *position == low)
+            return;
+
+        container.values.insert(position, low);
+        container.cardinality++;
+        if (container.cardinality > ROARING_ARRAY_MAX_SIZE)
+            toBitmap(container);
+    }
+    else
+    {
+        uint64_t bit = 1ull << (low % 64);
+        if (!(container.words[low / 64] & bit))
+        {
+            container.words[low / 64] |= bit;
+            container.cardinality++;
+        }
+    }
+}
+
+/**
+ *@brief Checks whether a value is in the bitmap
+ **/
+bool RoaringBitmap::contains(uint32_t value) const
+{
+    uint16_t key = (uint16_t)(value >> 16);
+    size_t index = findContainer(key);
+
+    return index < containers.size() && containers[index].key == key &&
+           containsLow(containers[index], (uint16_t)value);
+}
+
+/**
+ *@brief Gets the smallest value of the bitmap that is not below a value
+ *
+ *@param value          value to start from
+ *
+ *@return uint32_t      the next value, ROARING_NO_VALUE if there is none
+ **/
+uint32_t RoaringBitmap::getNext(uint32_t value) const
+{
+    uint16_t key = (uint16_t)(value >> 16);
+    uint32_t low = (uint16_t)value;
+
+    for (size_t index = findContainer(key); index < containers.size(); index++)
+    {
+        // Containers past the one of the value start from their first value
+        if (containers[index].key != key)
+            low = 0;
+
+        uint32_t nextLow = getNextLow(containers[index], low);
+        if (nextLow != ROARING_NO_VALUE)
+            return ((uint32_t)containers[index].key << 16) | nextLow;
+    }
+
+    return ROARING_NO_VALUE;
+}
+
+/**
+ *@brief Gets the number of values in the bitmap
+ **/
+size_t RoaringBitmap::getCardinality() const
+{
+    size_t cardinality = 0;
+    for (const auto &container : containers)
+        cardinality += container.cardinality;
+
+    return cardinality;
+}
+
+/**
+ *@brief Gets the memory taken by the bitmap, in bytes
+ **/
+size_t RoaringBitmap::getMemoryUsage() const
+{
+    size_t memoryUsage = sizeof(*this) + containers.capacity() * sizeof(Container);
+    for (const auto &container : containers)
+        memoryUsage += container.values.capacity() * sizeof(uint16_t) +
+                       container.words.capacity() * sizeof(uint64_t);
+
+    return memoryUsage;
+}
+
+/**
+ *@brief Gets every value of the bitmap, in increasing order
+ **/
+void RoaringBitmap::getValues(vector<uint32_t> &values) const
+{
+    values.clear();
+    values.reserve(getCardinality());
+
+    for (const auto &container : containers)
+    {
+        uint32_t high = (uint32_t)container.key << 16;
+        if (container.words.empty())
+        {
+            for (uint16_t low : container.values)
+                values.push_back(high | low);
+            continue;
+        }
+
+        for (uint32_t word = 0; word < ROARING_BITMAP_WORDS; word++)
+        {
+            for (uint64_t bits = container.words[word]; bits; bits &= bits - 1)
+                values.push_back(high | (word * 64 + getLowestBit(bits)));
+        }
+    }
+}
+
+/**
+ *@brief Gets the values that are in both bitmaps
+ **/
+RoaringBitmap RoaringBitmap::intersect(const RoaringBitmap &bitmap1,
+                                       const RoaringBitmap &bitmap2)
+{
+    RoaringBitmap result;
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < bitmap1.containers.size() && j < bitmap2.containers.size())
+    {
+        const Container &container1 = bitmap1.containers[i];
+        const Container &container2 = bitmap2.containers[j];
+
+        if (container1.key < container2.key)
+            i++;
+        else if (container2.key < container1.key)
+            j++;
+        else
+        {
+            Container container = intersect(container1, container2);
+            if (container.cardinality)
+                result.containers.push_back(move(container));
+            i++;
+            j++;
+        }
+    }
+
+    return result;
+}
+
+/**
+ *@brief Gets the index of the container of a key, or where it would be inserted
+ **/
+size_t RoaringBitmap::findContainer(uint16_t key) const
+{
+    return lower_bound(containers.begin(), containers.end(), key,
+                       [](const Container &container, uint16_t key) {
+                           return container.key < key;
+                       }) -
+           containers.begin();
+}
+
+/**
+ *@brief Turns an array container into a bitmap container
+ **/
+void RoaringBitmap::toBitmap(Container &container)
+{
+    container.words.assign(ROARING_BITMAP_WORDS, 0);
+    for (uint16_t low : container.values)
+        container.words[low / 64] |= 1ull << (low % 64);
+
+    container.values = vector<uint16_t>();
+}
+
+/**
+ *@brief Turns a bitmap container into an array container
+ **/
+void RoaringBitmap::toArray(Container &container)
+{
+    container.values.clear();
+    container.values.reserve(container.cardinality);
+    for (uint32_t word = 0; word < ROARING_BITMAP_WORDS; word++)
+    {
+        for (uint64_t bits = container.words[word]; bits; bits &= bits - 1)
+            container.values.push_back((uint16_t)(word * 64 + getLowestBit(bits)));
+    }
+
+    container.words = vector<uint64_t>();
+}
+
+/**
+ *@brief Checks whether a container holds the lower 16 bits of a value
+ **/
+bool RoaringBitmap::containsLow(const Container &container, uint16_t low)
+{
+    if (!container.words.empty())
+        return (container.words[low / 64] >> (low % 64)) & 1;
+
+    return binary_search(container.values.begin(), container.values.end(), low);
+}
+
+/**
+ *@brief Gets the smallest lower 16 bits of a container that are not below low, or
+ *       ROARING_NO_VALUE if there are none
+ **/
+uint32_t RoaringBitmap::getNextLow(const Container &container, uint32_t low)
+{
+    if (container.words.empty())
+    {
+        auto position = lower_bound(container.values.begin(), container.values.end(), low);
+        return (position != container.values.end()) ? *position : ROARING_NO_VALUE;
+    }
+
+    uint32_t word = low / 64;
+    // Bits below low are masked out of its own word
+    uint64_t bits = container.words[word] & (~0ull << (low % 64));
+    while (!bits)
+    {
+        if (++word == ROARING_BITMAP_WORDS)
+            return ROARING_NO_VALUE;
+        bits = container.words[word];
+    }
+
+    return word * 64 + getLowestBit(bits);
+}
+
+/**
+ *@brief Gets the values that are in two containers with the same key
+ **/
+RoaringBitmap::Container RoaringBitmap::intersect(const Container &container1,
+                                                  const Container &container2)
+{
+    Container result;
+    result.key = container1.key;
+    result.cardinality = 0;
+
+    bool isBitmap1 = !container1.words.empty();
+    bool isBitmap2 = !container2.words.empty();
+
+    if (isBitmap1 && isBitmap2)
+    {
+        result.words.resize(ROARING_BITMAP_WORDS);
+        for (uint32_t word = 0; word < ROARING_BITMAP_WORDS; word++)
+        {
+            result.words[word] = container1.words[word] & container2.words[word];
+            result.cardinality += (uint32_t)bitset<64>(result.words[word]).count();
+        }
+
+        if (result.cardinality <= ROARING_ARRAY_MAX_SIZE)
+            toArray(result);
+    }
+    else if (isBitmap1 || isBitmap2)
+    {
+        // Every value of the array is looked up in the bitmap
+        const Container &array = isBitmap1 ? container2 : container1;
+        const Container &bitmap = isBitmap1 ? container1 : container2;
+        for (uint16_t low : array.values)
+        {
+            if (containsLow(bitmap, low))
+                result.values.push_back(low);
+        }
+        result.cardinality = (uint32_t)result.values.size();
+    }
+    else
+    {
+        set_intersection(container1.values.begin(), container1.values.end(),
+                         container2.values.begin(), container2.values.end(),
+                         back_inserter(result.values));
+        result.cardinality = (uint32_t)result.values.size();
+    }
+
+    return result;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file RoaringBitmap.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Compressed bitmap of 32-bit values (Roaring)
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef ROARINGBITMAP_H
+#define ROARINGBITMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Values a container keeps as a sorted array; a fuller container becomes a bitmap, which is
+// smaller from this size on
+#define ROARING_ARRAY_MAX_SIZE 4096
+#define ROARING_NO_VALUE UINT32_MAX
+
+class RoaringBitmap
+{
+public:
+    RoaringBitmap();
+
+    void add(uint32_t value);
+
+    bool contains(uint32_t value) const;
+    uint32_t getNext(uint32_t value) const;
+    size_t getCardinality() const;
+    size_t getMemoryUsage() const;
+    void getValues(std::vector<uint32_t> &values) const;
+
+    static RoaringBitmap intersect(const RoaringBitmap &bitmap1, const RoaringBitmap &bitmap2);
+
+private:
+    // The values whose upper 16 bits are key, by their lower 16 bits: a sorted array while
+    // there are at most ROARING_ARRAY_MAX_SIZE of them, else a bitmap of 1024 words
+    struct Container
+    {
+        uint16_t key;
+        uint32_t cardinality;
+        std::vector<uint16_t> values;
+        std::vector<uint64_t> words;
+    };
+
+    size_t findContainer(uint16_t key) const;
+    static void toBitmap(Container &container);
+    static void toArray(Container &container);
+    static bool containsLow(const Container &container, uint16_t low);
+    static uint32_t getNextLow(const Container &container, uint32_t low);
+    static Container intersect(const Container &container1, const Container &container2);
+
+    // Sorted by key
+    std::vector<Container> containers;
+};
+
+#endif
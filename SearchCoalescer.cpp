@@ -0,0 +1,103 @@
+/**
+ * @file SearchCoalescer.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Single-flight execution of identical concurrent searches
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * When a link goes viral many requests for the same query arrive at once. The first one runs
+ * the search; the ones that arrive while it is running wait for it and share its ranked
+ * result instead of repeating the work. Nothing is kept once the search finishes, so this is
+ * not a cache: a request that arrives later runs the search again.
+ *
+ */
+
+#include "SearchCoalescer.h"
+
+#include "IndexShard.h"
+
+using namespace std;
+
+/**
+ *@brief Runs a search, or waits for an identical one that is already running
+ *
+ *@param key            normalized query, from getKey()
+ *@param search         fills in the result, only called if no identical search is running
+ *@param isShared       true if the result came from another request
+ *
+ *@return the ranked result
+ **/
+shared_ptr<const CoalescedSearch> SearchCoalescer::run(const string &key,
+                                                       const SearchFunction &search,
+                                                       bool &isShared)
+{
+    promise<shared_ptr<const CoalescedSearch>> searchPromise;
+    PendingSearch pendingSearch;
+
+    unique_lock<mutex> lock(pendingMutex);
+    auto runningSearch = pendingSearches.find(key);
+    isShared = runningSearch != pendingSearches.end();
+    if (isShared)
+        pendingSearch = runningSearch->second;
+    else
+    {
+        pendingSearch = searchPromise.get_future().share();
+        pendingSearches.emplace(key, pendingSearch);
+    }
+    lock.unlock();
+
+    if (!isShared)
+    {
+        try
+        {
+            shared_ptr<CoalescedSearch> result = make_shared<CoalescedSearch>();
+            search(*result);
+            searchPromise.set_value(result);
+        }
+        catch (...)
+        {
+            searchPromise.set_exception(current_exception());
+        }
+
+        lock.lock();
+        pendingSearches.erase(key);
+        lock.unlock();
+    }
+
+    // Rethrows the exception of the search, if it failed
+    return pendingSearch.get();
+}
+
+/**
+ *@brief Normalizes a query so that searches that rank the same documents share a key. Queries
+ *       the inverted index answers are keyed by their index terms, so case and punctuation do
+ *       not matter; the rest are keyed by their words as typed.
+ *
+ *@param words          searched words, as typed by the user
+ *@param options        how the words are combined and filtered
+ *
+ *@return the key
+ **/
+string SearchCoalescer::getKey(const SearchTerms &words, const SearchOptions &options)
+{
+    vector<string> terms;
+    string key = options.matchAll ? "all:" : "any:";
+    for (const auto &filterKey : options.filters)
+        key += filterKey + "|";
+
+    if (IndexShard::getQueryTerms(words, terms))
+    {
+        key += "terms";
+        for (const auto &term : terms)
+            key += "+" + term;
+    }
+    else
+    {
+        key += "words";
+        for (const auto &word : words)
+            key.append("+").append(word.begin(), word.end());
+    }
+
+    return key;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file SearchCoalescer.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Single-flight execution of identical concurrent searches
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef SEARCHCOALESCER_H
+#define SEARCHCOALESCER_H
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DocumentStore.h"
+#include "IndexShard.h"
+#include "RequestArena.h"
+
+/**
+ * @brief Ranked result of a search, shared by every request that waited on it
+ */
+struct CoalescedSearch
+{
+    std::vector<SearchResult> results;
+    std::shared_ptr<const DocumentStore> documents;
+    size_t matchCount = 0;
+    int unavailableShards = 0;
+};
+
+class SearchCoalescer
+{
+public:
+    typedef std::function<void(CoalescedSearch &)> SearchFunction;
+
+    std::shared_ptr<const CoalescedSearch> run(const std::string &key,
+                                               const SearchFunction &search, bool &isShared);
+
+    static std::string getKey(const SearchTerms &words, const SearchOptions &options);
+
+private:
+    typedef std::shared_future<std::shared_ptr<const CoalescedSearch>> PendingSearch;
+
+    std::mutex pendingMutex;
+    std::unordered_map<std::string, PendingSearch> pendingSearches;
+};
+
+#endif
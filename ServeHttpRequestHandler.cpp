@@ -14,6 +14,7 @@
 #include <iostream>
 
 #include "ServeHttpRequestHandler.h"
+#include "Metrics.h"
 
 using namespace std;
 
@@ -38,6 +39,9 @@ bool ServeHttpRequestHandler::handleRequest(string url, HttpArguments arguments,
  */
 bool ServeHttpRequestHandler::serve(string url, vector<char> &response)
 {
+    StageTimer staticServingTimer(STAGE_STATIC_SERVING);
+    Metrics::addToCounter(COUNTER_STATIC_REQUESTS);
+
     // Blocks directory traversal
     // e.g. https://www.example.com/show_file.php?file=../../MyFile
     // * Builds absolute local path from url
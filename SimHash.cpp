@@ -0,0 +1,154 @@
+/**
+ * @file SimHash.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief SimHash fingerprints of articles and near-duplicate detection with banded LSH
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * The SimHash of an article is a 64-bit fingerprint whose bits are the signs of the weighted
+ * sum of the hashes of its terms: every term adds its weight to the bits that are set in its
+ * hash and subtracts it from the rest. Articles that share most of their weight get
+ * fingerprints that differ in a few bits, so near-duplicates (mirrors, copies with another
+ * title, articles that only differ in a date or a navigation box) are found by Hamming
+ * distance.
+ *
+ * Comparing every pair of fingerprints is quadratic, so they are bucketed with banded LSH: the
+ * fingerprint is cut into SIMHASH_MAX_DISTANCE + 1 bands and, by pigeonhole, two fingerprints
+ * within that distance are equal in at least one band. For every band the fingerprints are
+ * sorted with that band first, and only the fingerprints of a run with the same band value
+ * are compared. Near-duplicates are joined transitively into clusters.
+ *
+ * @cite Charikar - Similarity estimation techniques from rounding algorithms (STOC 2002)
+ * @cite Manku, Jain, Das Sarma - Detecting near-duplicates for web crawling (WWW 2007)
+ *
+ */
+
+#include <algorithm>
+#include <bitset>
+
+#include "SimHash.h"
+
+using namespace std;
+
+#define SIMHASH_BAND_BITS (64 / SIMHASH_BAND_COUNT)
+
+/**
+ *@brief Finds the cluster of a page, shortening the path on the way
+ **/
+static uint32_t findCluster(vector<uint32_t> &clusters, uint32_t page)
+{
+    while (clusters[page] != page)
+    {
+        clusters[page] = clusters[clusters[page]];
+        page = clusters[page];
+    }
+
+    return page;
+}
+
+/**
+ *@brief Rotates a fingerprint so that a band takes its highest bits
+ **/
+static uint64_t rotateBand(uint64_t fingerprint, int band)
+{
+    int shift = band * SIMHASH_BAND_BITS;
+    return shift ? (fingerprint << shift) | (fingerprint >> (64 - shift)) : fingerprint;
+}
+
+/**
+ *@brief Checks whether two rotated fingerprints have the same value in their first band
+ **/
+static bool isSameBucket(uint64_t fingerprint1, uint64_t fingerprint2)
+{
+    return (fingerprint1 >> (64 - SIMHASH_BAND_BITS)) == (fingerprint2 >> (64 - SIMHASH_BAND_BITS));
+}
+
+/**
+ *@brief Computes the SimHash fingerprint of an article
+ *
+ *@param features       hash and weight of every distinct term of the article
+ *
+ *@return uint64_t      the fingerprint
+ **/
+uint64_t SimHash::getFingerprint(const vector<pair<uint64_t, double>> &features)
+{
+    double sums[64] = {};
+    for (const auto &feature : features)
+    {
+        for (int bit = 0; bit < 64; bit++)
+            sums[bit] += ((feature.first >> bit) & 1) ? feature.second : -feature.second;
+    }
+
+    uint64_t fingerprint = 0;
+    for (int bit = 0; bit < 64; bit++)
+    {
+        if (sums[bit] > 0)
+            fingerprint |= 1ull << bit;
+    }
+
+    return fingerprint;
+}
+
+/**
+ *@brief Gets the number of bits two fingerprints differ in
+ **/
+int SimHash::getDistance(uint64_t fingerprint1, uint64_t fingerprint2)
+{
+    return (int)bitset<64>(fingerprint1 ^ fingerprint2).count();
+}
+
+/**
+ *@brief Groups near-duplicate fingerprints into clusters
+ *
+ *@param fingerprints   fingerprint of every page
+ *@param isComparable   whether the fingerprint of a page is meaningful; the rest are left alone
+ *@param clusters       cluster of every page, as the lowest page number of the cluster
+ *
+ *@return size_t        number of pages that are in the cluster of another page
+ **/
+size_t SimHash::findNearDuplicates(const vector<uint64_t> &fingerprints,
+                                   const vector<char> &isComparable, vector<uint32_t> &clusters)
+{
+    uint32_t pageCount = (uint32_t)fingerprints.size();
+    clusters.resize(pageCount);
+    for (uint32_t page = 0; page < pageCount; page++)
+        clusters[page] = page;
+
+    vector<pair<uint64_t, uint32_t>> table;
+    for (int band = 0; band < SIMHASH_BAND_COUNT; band++)
+    {
+        table.clear();
+        for (uint32_t page = 0; page < pageCount; page++)
+        {
+            if (isComparable[page])
+                table.emplace_back(rotateBand(fingerprints[page], band), page);
+        }
+        sort(table.begin(), table.end());
+
+        for (size_t i = 0; i < table.size(); i++)
+        {
+            size_t end = min(table.size(), i + 1 + SIMHASH_BUCKET_WINDOW);
+            for (size_t j = i + 1; j < end && isSameBucket(table[i].first, table[j].first); j++)
+            {
+                if (getDistance(table[i].first, table[j].first) > SIMHASH_MAX_DISTANCE)
+                    continue;
+
+                uint32_t cluster1 = findCluster(clusters, table[i].second);
+                uint32_t cluster2 = findCluster(clusters, table[j].second);
+                if (cluster1 != cluster2)
+                    clusters[max(cluster1, cluster2)] = min(cluster1, cluster2);
+            }
+        }
+    }
+
+    size_t duplicateCount = 0;
+    for (uint32_t page = 0; page < pageCount; page++)
+    {
+        clusters[page] = findCluster(clusters, page);
+        if (clusters[page] != page)
+            duplicateCount++;
+    }
+
+    return duplicateCount;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file SimHash.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief SimHash fingerprints of articles and near-duplicate detection with banded LSH
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef SIMHASH_H
+#define SIMHASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Articles whose fingerprints differ in at most this many bits are near-duplicates
+#define SIMHASH_MAX_DISTANCE 3
+// One more band than the distance, so that two near-duplicates always share a whole band
+#define SIMHASH_BAND_COUNT (SIMHASH_MAX_DISTANCE + 1)
+// Articles with fewer distinctive terms are never taken for near-duplicates
+#define SIMHASH_MIN_TERMS 16
+// A fingerprint is only compared to this many others of its bucket, so that a crowded bucket
+// cannot make the detection quadratic
+#define SIMHASH_BUCKET_WINDOW 256
+
+class SimHash
+{
+public:
+    static uint64_t getFingerprint(const std::vector<std::pair<uint64_t, double>> &features);
+    static int getDistance(uint64_t fingerprint1, uint64_t fingerprint2);
+
+    static size_t findNearDuplicates(const std::vector<uint64_t> &fingerprints,
+                                     const std::vector<char> &isComparable,
+                                     std::vector<uint32_t> &clusters);
+};
+
+#endif
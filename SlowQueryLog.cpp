@@ -0,0 +1,262 @@
+/**
+ * @file SlowQueryLog.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Structured per-request search traces and a non-blocking slow query log
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Searches slower than the threshold are written as one JSON object per line, e.g.:
+ *      {"time":1700000000,"query":"agua+fuego","term_count":2,"terms":[{"term":"agua",
+ *       "rows_scanned":1284,"rows_matched":310},...],"candidates_scored":402,"results":100,
+ *       "total_ms":41.2,"stages_ms":{"query_normalization":0.01,...}}
+ *
+ * Request threads never touch the file: they format the line and push it into a bounded
+ * multi-producer ring buffer (one compare-and-swap, no locks). A background thread drains the
+ * buffer and writes to disk. When the buffer is full the entry is dropped and counted instead
+ * of making the request wait.
+ *
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "SlowQueryLog.h"
+
+using namespace std;
+
+static const char *traceStageNames[STAGE_COUNT] = {
+    "request_parse",
+    "query_normalization",
+    "index_lookup",
+    "scoring",
+    "sorting",
+    "rendering",
+    "static_serving",
+};
+
+/**
+ *@brief Escapes a string so that it can be written inside JSON quotes
+ **/
+static string escapeJson(const string &input)
+{
+    const char *hexDigits = "0123456789abcdef";
+    string output;
+
+    for (unsigned char c : input)
+    {
+        if (c == '"' || c == '\\')
+        {
+            output += '\\';
+            output += (char)c;
+        }
+        else if (c < 0x20)
+        {
+            output += "\\u00";
+            output += hexDigits[c >> 4];
+            output += hexDigits[c & 0xf];
+        }
+        else
+            output += (char)c;
+    }
+
+    return output;
+}
+
+QueryTrace::QueryTrace() : candidatesScored(0), resultCount(0), totalTime(0)
+{
+    for (auto &stageTime : stageTimes)
+        stageTime.store(0, memory_order_relaxed);
+}
+
+/**
+ *@brief Sets the normalized terms of the search, in evaluation order
+ **/
+void QueryTrace::setTerms(const SearchTerms &terms)
+{
+    lock_guard<mutex> lock(termMutex);
+
+    this->terms.assign(terms.begin(), terms.end());
+    rowsScanned.assign(terms.size(), 0);
+    rowsMatched.assign(terms.size(), 0);
+
+    query.clear();
+    for (size_t i = 0; i < terms.size(); i++)
+        query += (i > 0 ? "+" : "") + terms[i];
+}
+
+/**
+ *@brief Adds what one shard did to evaluate a term
+ *
+ *@param termIndex      index of the term in terms
+ *@param rowsScanned    rows or postings visited
+ *@param rowsMatched    rows or postings that contained the term
+ **/
+void QueryTrace::addTermStatistics(size_t termIndex, uint64_t rowsScanned, uint64_t rowsMatched)
+{
+    lock_guard<mutex> lock(termMutex);
+
+    if (termIndex >= terms.size())
+        return;
+
+    this->rowsScanned[termIndex] += rowsScanned;
+    this->rowsMatched[termIndex] += rowsMatched;
+}
+
+void QueryTrace::addStageTime(MetricStage stage, uint64_t nanoseconds)
+{
+    stageTimes[stage].fetch_add(nanoseconds, memory_order_relaxed);
+}
+
+/**
+ *@brief Formats the trace as a single JSON line (without the line break)
+ **/
+string QueryTrace::toJson()
+{
+    lock_guard<mutex> lock(termMutex);
+
+    stringstream ss;
+    ss << fixed << setprecision(3);
+
+    ss << "{\"time\":" << chrono::duration_cast<chrono::seconds>(
+                              chrono::system_clock::now().time_since_epoch()).count()
+       << ",\"query\":\"" << escapeJson(query) << "\""
+       << ",\"term_count\":" << terms.size()
+       << ",\"terms\":[";
+    for (size_t i = 0; i < terms.size(); i++)
+    {
+        ss << (i > 0 ? "," : "")
+           << "{\"term\":\"" << escapeJson(terms[i]) << "\""
+           << ",\"rows_scanned\":" << rowsScanned[i]
+           << ",\"rows_matched\":" << rowsMatched[i] << "}";
+    }
+    ss << "],\"candidates_scored\":" << candidatesScored.load()
+       << ",\"results\":" << resultCount
+       << ",\"total_ms\":" << totalTime / 1e6
+       << ",\"stages_ms\":{";
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        ss << (i > 0 ? "," : "") << "\"" << traceStageNames[i] << "\":"
+           << stageTimes[i].load() / 1e6;
+    }
+    ss << "}}";
+
+    return ss.str();
+}
+
+/**
+ *@brief class constructor. Starts the background writer thread.
+ *
+ *@param logPath                file the slow searches are appended to
+ *@param thresholdMilliseconds  searches that take longer than this are logged
+ **/
+SlowQueryLog::SlowQueryLog(string logPath, uint64_t thresholdMilliseconds) :
+logFile(logPath, ios::app), slots(new Slot[SLOW_QUERY_LOG_CAPACITY]), enqueuePosition(0),
+dequeuePosition(0), droppedEntries(0), stopping(false)
+{
+    threshold = thresholdMilliseconds * 1000000;
+
+    if (!logFile.is_open())
+        cerr << "Failed to open slow query log: " << logPath << endl;
+
+    for (size_t i = 0; i < SLOW_QUERY_LOG_CAPACITY; i++)
+        slots[i].sequence.store(i, memory_order_relaxed);
+
+    writer = thread(&SlowQueryLog::writerLoop, this);
+
+    Metrics::setGauge("edaoogle_slow_query_log_dropped", "Slow query traces dropped because the "
+                      "log buffer was full", [this]() { return (double)getDroppedEntries(); });
+}
+
+SlowQueryLog::~SlowQueryLog()
+{
+    Metrics::setGauge("edaoogle_slow_query_log_dropped", "Slow query traces dropped because the "
+                      "log buffer was full", []() { return 0.0; });
+
+    stopping = true;
+    writer.join();
+}
+
+/**
+ *@brief Checks whether a search took long enough to be logged
+ **/
+bool SlowQueryLog::isSlow(uint64_t nanoseconds)
+{
+    return nanoseconds >= threshold;
+}
+
+/**
+ *@brief Queues a trace for writing. Never blocks.
+ *
+ *@param trace          trace of a finished search
+ *
+ *@return bool          false if the buffer was full and the trace was dropped
+ **/
+bool SlowQueryLog::log(QueryTrace &trace)
+{
+    string line = trace.toJson();
+
+    size_t position = enqueuePosition.load(memory_order_relaxed);
+    Slot *slot;
+
+    while (true)
+    {
+        slot = &slots[position % SLOW_QUERY_LOG_CAPACITY];
+        size_t sequence = slot->sequence.load(memory_order_acquire);
+
+        if (sequence == position)
+        {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1,
+                                                      memory_order_relaxed))
+                break;
+        }
+        else if (sequence < position)
+        {
+            droppedEntries++;
+            return false;
+        }
+        else
+            position = enqueuePosition.load(memory_order_relaxed);
+    }
+
+    slot->line = move(line);
+    slot->sequence.store(position + 1, memory_order_release);
+
+    return true;
+}
+
+uint64_t SlowQueryLog::getDroppedEntries()
+{
+    return droppedEntries.load();
+}
+
+void SlowQueryLog::writerLoop()
+{
+    while (true)
+    {
+        bool wroteEntries = false;
+
+        while (true)
+        {
+            Slot &slot = slots[dequeuePosition % SLOW_QUERY_LOG_CAPACITY];
+            if (slot.sequence.load(memory_order_acquire) != dequeuePosition + 1)
+                break;
+
+            logFile << slot.line << '\n';
+            slot.line.clear();
+            slot.sequence.store(dequeuePosition + SLOW_QUERY_LOG_CAPACITY, memory_order_release);
+
+            dequeuePosition++;
+            wroteEntries = true;
+        }
+
+        if (wroteEntries)
+            logFile.flush();
+        else if (stopping)
+            return;
+        else
+            this_thread::sleep_for(chrono::milliseconds(50));
+    }
+}
@@ -0,0 +1,86 @@
+/**
+ * @file SlowQueryLog.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Structured per-request search traces and a non-blocking slow query log
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef SLOWQUERYLOG_H
+#define SLOWQUERYLOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+#include "RequestArena.h"
+
+#define SLOW_QUERY_LOG_CAPACITY 1024
+
+/**
+ * @brief What a single search did. Shard tasks add to it concurrently.
+ */
+struct QueryTrace
+{
+    QueryTrace();
+
+    void setTerms(const SearchTerms &terms);
+    void addTermStatistics(size_t termIndex, uint64_t rowsScanned, uint64_t rowsMatched);
+    void addStageTime(MetricStage stage, uint64_t nanoseconds);
+
+    std::string toJson();
+
+    std::string query;
+    std::vector<std::string> terms;
+    std::vector<uint64_t> rowsScanned;
+    std::vector<uint64_t> rowsMatched;
+    std::atomic<uint64_t> candidatesScored;
+    uint64_t resultCount;
+    uint64_t totalTime;
+    std::atomic<uint64_t> stageTimes[STAGE_COUNT];
+
+private:
+    std::mutex termMutex;
+};
+
+class SlowQueryLog
+{
+public:
+    SlowQueryLog(std::string logPath, uint64_t thresholdMilliseconds);
+    ~SlowQueryLog();
+
+    bool isSlow(uint64_t nanoseconds);
+    bool log(QueryTrace &trace);
+
+    uint64_t getDroppedEntries();
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        std::string line;
+    };
+
+    void writerLoop();
+
+    std::ofstream logFile;
+    uint64_t threshold;
+
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> enqueuePosition;
+    size_t dequeuePosition;
+    std::atomic<uint64_t> droppedEntries;
+
+    std::atomic<bool> stopping;
+    std::thread writer;
+};
+
+#endif
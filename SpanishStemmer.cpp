@@ -0,0 +1,505 @@
+/**
+ * @file SpanishStemmer.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Snowball stemmer for Spanish
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Reduces the inflected forms of a word to a common stem by removing suffixes, so that
+ * "canciones", "canción" and "cancion" all become "cancion". The steps and suffix lists follow
+ * the Snowball algorithm:
+ *      0. attached pronouns (haciéndola -> haciendo)
+ *      1. standard suffixes (-amiento, -ación, -mente, -idad...)
+ *      2. verb suffixes, if step 1 removed nothing
+ *      3. residual vowels
+ * and acute accents are removed at the end. Suffixes are only removed from the regions of the
+ * word (RV, R1, R2) the algorithm allows, so short words are left alone.
+ *
+ * Words are lowercase UTF-8, as returned by Tokenizer, and are handled as code points.
+ *
+ * @cite https://snowballstem.org/algorithms/spanish/stemmer.html
+ *
+ */
+
+#include "SpanishStemmer.h"
+
+using namespace std;
+
+/**
+ * @brief Suffix and the number of the action to take when it is the longest that matches
+ */
+struct SuffixRule
+{
+    const char32_t *suffix;
+    int action;
+};
+
+enum StandardSuffixAction
+{
+    DELETE_IN_R2 = 1,
+    DELETE_IN_R2_AND_IC,
+    REPLACE_WITH_LOG,
+    REPLACE_WITH_U,
+    REPLACE_WITH_ENTE,
+    AMENTE,
+    MENTE,
+    IDAD,
+    IVA
+};
+
+static const SuffixRule standardSuffixes[] = {
+    {U"anza", DELETE_IN_R2}, {U"anzas", DELETE_IN_R2}, {U"ico", DELETE_IN_R2},
+    {U"ica", DELETE_IN_R2}, {U"icos", DELETE_IN_R2}, {U"icas", DELETE_IN_R2},
+    {U"ismo", DELETE_IN_R2}, {U"ismos", DELETE_IN_R2}, {U"able", DELETE_IN_R2},
+    {U"ables", DELETE_IN_R2}, {U"ible", DELETE_IN_R2}, {U"ibles", DELETE_IN_R2},
+    {U"ista", DELETE_IN_R2}, {U"istas", DELETE_IN_R2}, {U"oso", DELETE_IN_R2},
+    {U"osa", DELETE_IN_R2}, {U"osos", DELETE_IN_R2}, {U"osas", DELETE_IN_R2},
+    {U"amiento", DELETE_IN_R2}, {U"amientos", DELETE_IN_R2}, {U"imiento", DELETE_IN_R2},
+    {U"imientos", DELETE_IN_R2},
+    {U"adora", DELETE_IN_R2_AND_IC}, {U"ador", DELETE_IN_R2_AND_IC},
+    {U"ación", DELETE_IN_R2_AND_IC}, {U"adoras", DELETE_IN_R2_AND_IC},
+    {U"adores", DELETE_IN_R2_AND_IC}, {U"aciones", DELETE_IN_R2_AND_IC},
+    {U"ante", DELETE_IN_R2_AND_IC}, {U"antes", DELETE_IN_R2_AND_IC},
+    {U"ancia", DELETE_IN_R2_AND_IC}, {U"ancias", DELETE_IN_R2_AND_IC},
+    {U"logía", REPLACE_WITH_LOG}, {U"logías", REPLACE_WITH_LOG},
+    {U"ución", REPLACE_WITH_U}, {U"uciones", REPLACE_WITH_U},
+    {U"encia", REPLACE_WITH_ENTE}, {U"encias", REPLACE_WITH_ENTE},
+    {U"amente", AMENTE},
+    {U"mente", MENTE},
+    {U"idad", IDAD}, {U"idades", IDAD},
+    {U"iva", IVA}, {U"ivo", IVA}, {U"ivas", IVA}, {U"ivos", IVA},
+};
+
+static const char32_t *attachedPronouns[] = {
+    U"me", U"se", U"sela", U"selo", U"selas", U"selos", U"la", U"le", U"lo", U"las", U"les",
+    U"los", U"nos",
+};
+
+// Endings an attached pronoun can follow, with the accent they lose once it is removed
+static const pair<const char32_t *, const char32_t *> pronounEndings[] = {
+    {U"iéndo", U"iendo"}, {U"ándo", U"ando"}, {U"ár", U"ar"}, {U"ér", U"er"}, {U"ír", U"ir"},
+    {U"ando", U"ando"}, {U"iendo", U"iendo"}, {U"ar", U"ar"}, {U"er", U"er"}, {U"ir", U"ir"},
+    {U"yendo", U"yendo"},
+};
+
+static const char32_t *yVerbSuffixes[] = {
+    U"ya", U"ye", U"yan", U"yen", U"yeron", U"yendo", U"yo", U"yó", U"yas", U"yes", U"yais",
+    U"yamos",
+};
+
+// The first four are removed together with the u of a preceding "gu"
+#define GU_VERB_SUFFIX_COUNT 4
+
+static const char32_t *verbSuffixes[] = {
+    U"en", U"es", U"éis", U"emos",
+    U"arían", U"arías", U"arán", U"arás", U"aríais", U"aría", U"aréis", U"aríamos", U"aremos",
+    U"ará", U"aré", U"erían", U"erías", U"erán", U"erás", U"eríais", U"ería", U"eréis",
+    U"eríamos", U"eremos", U"erá", U"eré", U"irían", U"irías", U"irán", U"irás", U"iríais",
+    U"iría", U"iréis", U"iríamos", U"iremos", U"irá", U"iré", U"aba", U"ada", U"ida", U"ía",
+    U"ara", U"iera", U"ad", U"ed", U"id", U"ase", U"iese", U"aste", U"iste", U"an", U"aban",
+    U"ían", U"aran", U"ieran", U"asen", U"iesen", U"aron", U"ieron", U"ado", U"ido", U"ando",
+    U"iendo", U"ió", U"ar", U"er", U"ir", U"as", U"abas", U"adas", U"idas", U"ías", U"aras",
+    U"ieras", U"ases", U"ieses", U"ís", U"áis", U"abais", U"íais", U"arais", U"ierais",
+    U"aseis", U"ieseis", U"asteis", U"isteis", U"ados", U"idos", U"amos", U"ábamos", U"íamos",
+    U"imos", U"áramos", U"iéramos", U"iésemos", U"ásemos",
+};
+
+static const char32_t *residualSuffixes[] = {
+    U"os", U"a", U"o", U"á", U"í", U"ó",
+};
+
+static bool isVowel(char32_t c)
+{
+    return c == U'a' || c == U'e' || c == U'i' || c == U'o' || c == U'u' || c == U'á' ||
+           c == U'é' || c == U'í' || c == U'ó' || c == U'ú' || c == U'ü';
+}
+
+/**
+ *@brief Checks whether a word ends with a suffix that starts at or after a region
+ **/
+static bool endsWith(const u32string &word, const u32string &suffix, size_t region = 0)
+{
+    return word.size() >= suffix.size() && word.size() - suffix.size() >= region &&
+           word.compare(word.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ *@brief Finds the longest suffix of a list that the word ends with
+ *
+ *@return int           index of the suffix in the list, -1 if none matches
+ **/
+static int findLongestSuffix(const u32string &word, const char32_t *const *suffixes,
+                             size_t suffixCount)
+{
+    int longest = -1;
+    size_t longestSize = 0;
+
+    for (size_t i = 0; i < suffixCount; i++)
+    {
+        u32string suffix = suffixes[i];
+        if (suffix.size() > longestSize && endsWith(word, suffix))
+        {
+            longest = (int)i;
+            longestSize = suffix.size();
+        }
+    }
+
+    return longest;
+}
+
+/**
+ *@brief Decodes lowercase UTF-8 into code points
+ *
+ *@return bool          false if the text is not valid UTF-8
+ **/
+static bool decodeUTF8(const string &text, u32string &codePoints)
+{
+    codePoints.clear();
+
+    for (size_t i = 0; i < text.size();)
+    {
+        unsigned char c = text[i];
+        size_t length = (c < 0x80) ? 1 : ((c & 0xe0) == 0xc0) ? 2 : ((c & 0xf0) == 0xe0) ? 3 :
+                        ((c & 0xf8) == 0xf0) ? 4 : 0;
+        if (length == 0 || i + length > text.size())
+            return false;
+
+        char32_t codePoint = (length == 1) ? c : c & (0x7f >> length);
+        for (size_t j = 1; j < length; j++)
+        {
+            if ((text[i + j] & 0xc0) != 0x80)
+                return false;
+            codePoint = (codePoint << 6) | (text[i + j] & 0x3f);
+        }
+
+        codePoints += codePoint;
+        i += length;
+    }
+
+    return true;
+}
+
+static void encodeUTF8(const u32string &codePoints, string &text)
+{
+    text.clear();
+
+    for (char32_t codePoint : codePoints)
+    {
+        if (codePoint < 0x80)
+            text += (char)codePoint;
+        else if (codePoint < 0x800)
+        {
+            text += (char)(0xc0 | (codePoint >> 6));
+            text += (char)(0x80 | (codePoint & 0x3f));
+        }
+        else if (codePoint < 0x10000)
+        {
+            text += (char)(0xe0 | (codePoint >> 12));
+            text += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+            text += (char)(0x80 | (codePoint & 0x3f));
+        }
+        else
+        {
+            text += (char)(0xf0 | (codePoint >> 18));
+            text += (char)(0x80 | ((codePoint >> 12) & 0x3f));
+            text += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+            text += (char)(0x80 | (codePoint & 0x3f));
+        }
+    }
+}
+
+/**
+ *@brief Reduces a word to its stem
+ *
+ *@param word           lowercase UTF-8 word, replaced with its stem
+ **/
+void SpanishStemmer::stem(string &word)
+{
+    u32string codePoints;
+    if (!decodeUTF8(word, codePoints))
+        return;
+
+    size_t rv, r1, r2;
+    markRegions(codePoints, rv, r1, r2);
+
+    removeAttachedPronoun(codePoints, rv);
+    if (!removeStandardSuffix(codePoints, r1, r2) && !removeYVerbSuffix(codePoints, rv))
+        removeVerbSuffix(codePoints, rv);
+    removeResidualSuffix(codePoints, rv);
+
+    for (char32_t &c : codePoints)
+    {
+        switch (c)
+        {
+        case U'á':
+            c = U'a';
+            break;
+        case U'é':
+            c = U'e';
+            break;
+        case U'í':
+            c = U'i';
+            break;
+        case U'ó':
+            c = U'o';
+            break;
+        case U'ú':
+            c = U'u';
+            break;
+        default:
+            break;
+        }
+    }
+
+    encodeUTF8(codePoints, word);
+}
+
+/**
+ *@brief Finds where the regions of a word start. Suffixes are only removed from inside them.
+ *
+ *@param word           word to stem
+ *@param rv             start of RV: after the first vowel that follows a consonant, after the
+ *                      first consonant that follows two vowels, or after the third letter
+ *@param r1             start of R1: after the first consonant that follows a vowel
+ *@param r2             start of R2: R1 of R1
+ **/
+void SpanishStemmer::markRegions(const u32string &word, size_t &rv, size_t &r1, size_t &r2)
+{
+    size_t length = word.size();
+    rv = r1 = r2 = length;
+
+    if (length >= 2)
+    {
+        if (!isVowel(word[1]))
+        {
+            for (size_t i = 2; i < length; i++)
+            {
+                if (isVowel(word[i]))
+                {
+                    rv = i + 1;
+                    break;
+                }
+            }
+        }
+        else if (isVowel(word[0]))
+        {
+            for (size_t i = 2; i < length; i++)
+            {
+                if (!isVowel(word[i]))
+                {
+                    rv = i + 1;
+                    break;
+                }
+            }
+        }
+        else
+            rv = min(length, (size_t)3);
+    }
+
+    // R2 is found like R1, starting from R1
+    size_t *regions[] = {&r1, &r2};
+    size_t start = 0;
+    for (size_t *region : regions)
+    {
+        for (size_t i = start + 1; i < length; i++)
+        {
+            if (!isVowel(word[i]) && isVowel(word[i - 1]))
+            {
+                *region = i + 1;
+                break;
+            }
+        }
+        start = *region;
+    }
+}
+
+/**
+ *@brief Step 0: removes a pronoun attached to an infinitive or a gerund
+ **/
+bool SpanishStemmer::removeAttachedPronoun(u32string &word, size_t rv)
+{
+    int pronoun = findLongestSuffix(word, attachedPronouns,
+                                    sizeof(attachedPronouns) / sizeof(attachedPronouns[0]));
+    if (pronoun < 0)
+        return false;
+
+    u32string pronounSuffix = attachedPronouns[pronoun];
+    if (word.size() - pronounSuffix.size() < rv)
+        return false;
+
+    u32string stem = word.substr(0, word.size() - pronounSuffix.size());
+    const pair<const char32_t *, const char32_t *> *longestEnding = nullptr;
+    size_t longestSize = 0;
+    for (const auto &ending : pronounEndings)
+    {
+        u32string endingSuffix = ending.first;
+        if (endingSuffix.size() > longestSize && endsWith(stem, endingSuffix, rv))
+        {
+            longestEnding = &ending;
+            longestSize = endingSuffix.size();
+        }
+    }
+    if (!longestEnding)
+        return false;
+
+    // "yendo" only takes a pronoun after a u (oyéndolo is handled by the accented ending)
+    if (u32string(longestEnding->first) == U"yendo" &&
+        !endsWith(stem.substr(0, stem.size() - longestSize), U"u"))
+        return false;
+
+    word = stem.substr(0, stem.size() - longestSize) + longestEnding->second;
+
+    return true;
+}
+
+/**
+ *@brief Step 1: removes a derivational suffix
+ *
+ *@return bool          true if a suffix was removed
+ **/
+bool SpanishStemmer::removeStandardSuffix(u32string &word, size_t r1, size_t r2)
+{
+    const SuffixRule *rule = nullptr;
+    size_t ruleSize = 0;
+    for (const auto &standardSuffix : standardSuffixes)
+    {
+        u32string suffix = standardSuffix.suffix;
+        if (suffix.size() > ruleSize && endsWith(word, suffix))
+        {
+            rule = &standardSuffix;
+            ruleSize = suffix.size();
+        }
+    }
+    if (!rule)
+        return false;
+
+    u32string suffix = rule->suffix;
+    size_t region = (rule->action == AMENTE) ? r1 : r2;
+    if (!endsWith(word, suffix, region))
+        return false;
+
+    word.erase(word.size() - suffix.size());
+
+    switch (rule->action)
+    {
+    case DELETE_IN_R2_AND_IC:
+        if (endsWith(word, U"ic", r2))
+            word.erase(word.size() - 2);
+        break;
+
+    case REPLACE_WITH_LOG:
+        word += U"log";
+        break;
+
+    case REPLACE_WITH_U:
+        word += U"u";
+        break;
+
+    case REPLACE_WITH_ENTE:
+        word += U"ente";
+        break;
+
+    case AMENTE:
+        if (endsWith(word, U"iv", r2))
+        {
+            word.erase(word.size() - 2);
+            if (endsWith(word, U"at", r2))
+                word.erase(word.size() - 2);
+        }
+        else if (endsWith(word, U"os", r2) || endsWith(word, U"ic", r2) ||
+                 endsWith(word, U"ad", r2))
+            word.erase(word.size() - 2);
+        break;
+
+    case MENTE:
+        if (endsWith(word, U"ante", r2) || endsWith(word, U"able", r2) ||
+            endsWith(word, U"ible", r2))
+            word.erase(word.size() - 4);
+        break;
+
+    case IDAD:
+        if (endsWith(word, U"abil", r2))
+            word.erase(word.size() - 4);
+        else if (endsWith(word, U"ic", r2) || endsWith(word, U"iv", r2))
+            word.erase(word.size() - 2);
+        break;
+
+    case IVA:
+        if (endsWith(word, U"at", r2))
+            word.erase(word.size() - 2);
+        break;
+
+    default:
+        break;
+    }
+
+    return true;
+}
+
+/**
+ *@brief Step 2a: removes a verb suffix that starts with y after a u (huyeron -> hu)
+ *
+ *@return bool          true if a suffix was removed
+ **/
+bool SpanishStemmer::removeYVerbSuffix(u32string &word, size_t rv)
+{
+    int suffixIndex = findLongestSuffix(word, yVerbSuffixes,
+                                        sizeof(yVerbSuffixes) / sizeof(yVerbSuffixes[0]));
+    if (suffixIndex < 0)
+        return false;
+
+    u32string suffix = yVerbSuffixes[suffixIndex];
+    if (!endsWith(word, suffix, rv) || !endsWith(word, U"u" + suffix))
+        return false;
+
+    word.erase(word.size() - suffix.size());
+
+    return true;
+}
+
+/**
+ *@brief Step 2b: removes any other verb suffix
+ *
+ *@return bool          true if a suffix was removed
+ **/
+bool SpanishStemmer::removeVerbSuffix(u32string &word, size_t rv)
+{
+    int suffixIndex = findLongestSuffix(word, verbSuffixes,
+                                        sizeof(verbSuffixes) / sizeof(verbSuffixes[0]));
+    if (suffixIndex < 0)
+        return false;
+
+    u32string suffix = verbSuffixes[suffixIndex];
+    if (!endsWith(word, suffix, rv))
+        return false;
+
+    word.erase(word.size() - suffix.size());
+    if (suffixIndex < GU_VERB_SUFFIX_COUNT && endsWith(word, U"gu"))
+        word.erase(word.size() - 1);
+
+    return true;
+}
+
+/**
+ *@brief Step 3: removes a final vowel left in RV
+ **/
+void SpanishStemmer::removeResidualSuffix(u32string &word, size_t rv)
+{
+    int suffixIndex = findLongestSuffix(word, residualSuffixes,
+                                        sizeof(residualSuffixes) / sizeof(residualSuffixes[0]));
+    if (suffixIndex >= 0)
+    {
+        u32string suffix = residualSuffixes[suffixIndex];
+        if (endsWith(word, suffix, rv))
+            word.erase(word.size() - suffix.size());
+        return;
+    }
+
+    if (endsWith(word, U"e", rv) || endsWith(word, U"é", rv))
+    {
+        word.erase(word.size() - 1);
+        if (endsWith(word, U"u", rv) && endsWith(word, U"gu"))
+            word.erase(word.size() - 1);
+    }
+}
@@ -0,0 +1,31 @@
+/**
+ * @file SpanishStemmer.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Snowball stemmer for Spanish
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef SPANISHSTEMMER_H
+#define SPANISHSTEMMER_H
+
+#include <string>
+
+class SpanishStemmer
+{
+public:
+    static void stem(std::string &word);
+
+private:
+    static void markRegions(const std::u32string &word, size_t &rv, size_t &r1, size_t &r2);
+
+    static bool removeAttachedPronoun(std::u32string &word, size_t rv);
+    static bool removeStandardSuffix(std::u32string &word, size_t r1, size_t r2);
+    static bool removeYVerbSuffix(std::u32string &word, size_t rv);
+    static bool removeVerbSuffix(std::u32string &word, size_t rv);
+    static void removeResidualSuffix(std::u32string &word, size_t rv);
+};
+
+#endif
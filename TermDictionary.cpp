@@ -0,0 +1,236 @@
+/**
+ * @file TermDictionary.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Minimal perfect hash from the terms of a frozen index to their term numbers
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * A minimal perfect hash maps the n terms of the index to the numbers 0..n-1 without
+ * collisions and without storing the terms. It is built like BBHash: every term is hashed into
+ * a bit array of about TERM_DICTIONARY_GAMMA * n bits, the terms that landed alone on a slot
+ * keep it, and the ones that collided are hashed again into a smaller level. The number of a
+ * term is the number of bits set before its slot (its rank) over all the levels, found with
+ * one rank sample and a few popcounts.
+ *
+ * A lookup of a term of the index hashes it once and usually reads a single level: one or two
+ * cache misses, against the string comparisons of a hash table. The levels take about 3.7 bits
+ * per term. Since the terms are not stored, a 32-bit fingerprint of every term is checked, so
+ * that a searched word that is not in the index is rejected (all but one in four billion).
+ *
+ * Everything is kept in flat arrays of integers, so the dictionary could be written to and
+ * mapped from a file as it is.
+ *
+ * @cite Limasset, Rizk, Chikhi, Peterlongo - Fast and scalable minimal perfect hashing for
+ *       massive key sets (SEA 2017)
+ *
+ */
+
+#include <cmath>
+
+#include "TermDictionary.h"
+
+using namespace std;
+
+/**
+ *@brief Mixes the bits of a 64-bit value (the splitmix64 finalizer)
+ **/
+static uint64_t mix(uint64_t value)
+{
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+static uint32_t getFingerprint(uint64_t hash)
+{
+    return (uint32_t)(mix(hash ^ 0xc2b2ae3d27d4eb4full) >> 32);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define POPCOUNT(word) __builtin_popcountll(word)
+#else
+static int POPCOUNT(uint64_t word)
+{
+    int count = 0;
+    for (; word; word &= word - 1)
+        count++;
+    return count;
+}
+#endif
+
+/**
+ *@brief class constructor. The dictionary starts empty.
+ **/
+TermDictionary::TermDictionary()
+{
+    termCount = 0;
+    levelOffsets.push_back(0);
+}
+
+/**
+ *@brief Builds the dictionary of a set of terms. Afterwards find() gives every term a
+ *       different number in [0, number of terms).
+ *
+ *@param terms          terms, without repetitions
+ **/
+void TermDictionary::build(const vector<string> &terms)
+{
+    termCount = (uint32_t)terms.size();
+    levelBits.clear();
+    levelOffsets.assign(1, 0);
+    rankSamples.clear();
+    fingerprints.clear();
+    fallbackTerms.clear();
+
+    vector<uint64_t> hashes(terms.size());
+    vector<uint32_t> pending(terms.size());
+    for (uint32_t i = 0; i < terms.size(); i++)
+    {
+        hashes[i] = getHash(terms[i]);
+        pending[i] = i;
+    }
+
+    vector<uint64_t> collisions;
+    for (size_t level = 0; level < TERM_DICTIONARY_MAX_LEVELS && !pending.empty(); level++)
+    {
+        // Levels are whole words, so a level starts on a word boundary
+        uint64_t levelSize = (uint64_t)ceil(TERM_DICTIONARY_GAMMA * pending.size() / 64) * 64;
+        uint64_t levelOffset = levelOffsets.back();
+        levelOffsets.push_back(levelOffset + levelSize);
+        levelBits.resize(levelOffsets.back() / 64, 0);
+        collisions.assign(levelSize / 64, 0);
+
+        uint64_t *bits = levelBits.data() + levelOffset / 64;
+        for (uint32_t term : pending)
+        {
+            uint64_t position = getPosition(hashes[term], level) - levelOffset;
+            uint64_t bit = 1ull << (position % 64);
+            if (bits[position / 64] & bit)
+                collisions[position / 64] |= bit;
+            bits[position / 64] |= bit;
+        }
+
+        for (size_t i = 0; i < collisions.size(); i++)
+            bits[i] &= ~collisions[i];
+
+        vector<uint32_t> colliding;
+        for (uint32_t term : pending)
+        {
+            uint64_t position = getPosition(hashes[term], level) - levelOffset;
+            if (!(bits[position / 64] & (1ull << (position % 64))))
+                colliding.push_back(term);
+        }
+        pending.swap(colliding);
+    }
+
+    uint32_t rank = 0;
+    for (size_t word = 0; word < levelBits.size(); word++)
+    {
+        if (word % TERM_DICTIONARY_RANK_WORDS == 0)
+            rankSamples.push_back(rank);
+        rank += POPCOUNT(levelBits[word]);
+    }
+
+    // The terms that never landed alone take the numbers after the ones of the levels
+    for (uint32_t term : pending)
+        fallbackTerms.emplace(terms[term], rank++);
+
+    // The numbers are looked up before there are fingerprints to check
+    vector<uint32_t> termIds(terms.size());
+    for (uint32_t i = 0; i < terms.size(); i++)
+        find(terms[i], termIds[i]);
+
+    fingerprints.resize(termCount);
+    for (uint32_t i = 0; i < terms.size(); i++)
+        fingerprints[termIds[i]] = getFingerprint(hashes[i]);
+}
+
+/**
+ *@brief Looks a term up
+ *
+ *@param term           term to look up
+ *@param termId         number of the term, in [0, number of terms)
+ *
+ *@return bool          false if the term is not in the dictionary
+ **/
+bool TermDictionary::find(string_view term, uint32_t &termId) const
+{
+    uint64_t hash = getHash(term);
+
+    for (size_t level = 0; level + 1 < levelOffsets.size(); level++)
+    {
+        uint64_t position = getPosition(hash, level);
+        if (levelBits[position / 64] & (1ull << (position % 64)))
+        {
+            termId = getRank(position);
+            return fingerprints.empty() || fingerprints[termId] == getFingerprint(hash);
+        }
+    }
+
+    if (fallbackTerms.empty())
+        return false;
+
+    auto fallbackTerm = fallbackTerms.find(string(term));
+    if (fallbackTerm == fallbackTerms.end())
+        return false;
+
+    termId = fallbackTerm->second;
+    return true;
+}
+
+size_t TermDictionary::getTermCount() const
+{
+    return termCount;
+}
+
+/**
+ *@brief Gets the bytes taken by the dictionary, without the terms that fell back
+ **/
+size_t TermDictionary::getMemoryUsage() const
+{
+    return levelBits.size() * sizeof(uint64_t) + levelOffsets.size() * sizeof(uint64_t) +
+           rankSamples.size() * sizeof(uint32_t) + fingerprints.size() * sizeof(uint32_t);
+}
+
+/**
+ *@brief FNV-1a over the term, mixed so that every bit depends on every byte
+ **/
+uint64_t TermDictionary::getHash(string_view term)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : term)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    return mix(hash);
+}
+
+/**
+ *@brief Gets the slot of a term in a level, as a position in levelBits
+ **/
+uint64_t TermDictionary::getPosition(uint64_t hash, size_t level) const
+{
+    uint64_t levelSize = levelOffsets[level + 1] - levelOffsets[level];
+    uint64_t levelHash = mix(hash + (level + 1) * 0x9e3779b97f4a7c15ull);
+
+    // Multiply-shift maps the hash to [0, levelSize) without a division
+    return levelOffsets[level] + (((levelHash >> 32) * levelSize) >> 32);
+}
+
+/**
+ *@brief Counts the bits set before a position of levelBits
+ **/
+uint32_t TermDictionary::getRank(uint64_t position) const
+{
+    size_t word = position / 64;
+    size_t sample = word / TERM_DICTIONARY_RANK_WORDS;
+    uint32_t rank = rankSamples[sample];
+
+    for (size_t i = sample * TERM_DICTIONARY_RANK_WORDS; i < word; i++)
+        rank += POPCOUNT(levelBits[i]);
+
+    return rank + POPCOUNT(levelBits[word] & ((1ull << (position % 64)) - 1));
+}
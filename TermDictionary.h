@@ -0,0 +1,58 @@
+/**
+ * @file TermDictionary.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Minimal perfect hash from the terms of a frozen index to their term numbers
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef TERMDICTIONARY_H
+#define TERMDICTIONARY_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Bits per term of the first level; more makes construction faster and lookups shorter
+#define TERM_DICTIONARY_GAMMA 2.0
+#define TERM_DICTIONARY_MAX_LEVELS 32
+// 64-bit words per rank sample
+#define TERM_DICTIONARY_RANK_WORDS 8
+
+class TermDictionary
+{
+public:
+    TermDictionary();
+
+    void build(const std::vector<std::string> &terms);
+    bool find(std::string_view term, uint32_t &termId) const;
+
+    size_t getTermCount() const;
+    size_t getMemoryUsage() const;
+
+    static uint64_t getHash(std::string_view term);
+
+private:
+    uint64_t getPosition(uint64_t hash, size_t level) const;
+    uint32_t getRank(uint64_t position) const;
+
+    uint32_t termCount;
+
+    // Levels of the hash, one bit per slot, back to back. Level l takes the bits
+    // [levelOffsets[l], levelOffsets[l + 1]).
+    std::vector<uint64_t> levelBits;
+    std::vector<uint64_t> levelOffsets;
+    // Bits set before every block of TERM_DICTIONARY_RANK_WORDS words
+    std::vector<uint32_t> rankSamples;
+    // Checked on every lookup, so that terms that are not in the dictionary are rejected
+    std::vector<uint32_t> fingerprints;
+
+    // The few terms still colliding after the last level
+    std::unordered_map<std::string, uint32_t> fallbackTerms;
+};
+
+#endif
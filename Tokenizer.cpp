@@ -0,0 +1,192 @@
+/**
+ * @file Tokenizer.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Splits article text and searched words into index terms
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * A term is a run of letters and digits, lowercased. The articles write accented letters as
+ * numeric character references (&#243;) while users type them as UTF-8 (ó), so references are
+ * decoded to UTF-8 before tokenizing and both end up as the same term. Every non-ASCII
+ * character is treated as a letter; uppercase Latin-1 letters (Á, É, Ñ...) are lowercased.
+ *
+ */
+
+#include <cctype>
+#include <cstdint>
+
+#include "Tokenizer.h"
+
+using namespace std;
+
+/**
+ *@brief Appends a code point to a string as UTF-8, lowercased if it is an uppercase ASCII or
+ *       Latin-1 letter
+ **/
+static void appendCodePoint(uint32_t codePoint, string &output)
+{
+    if ((codePoint >= 'A' && codePoint <= 'Z') ||
+        (codePoint >= 0xc0 && codePoint <= 0xde && codePoint != 0xd7))
+        codePoint += 0x20;
+
+    if (codePoint < 0x80)
+        output += (char)codePoint;
+    else if (codePoint < 0x800)
+    {
+        output += (char)(0xc0 | (codePoint >> 6));
+        output += (char)(0x80 | (codePoint & 0x3f));
+    }
+    else if (codePoint < 0x10000)
+    {
+        output += (char)(0xe0 | (codePoint >> 12));
+        output += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+        output += (char)(0x80 | (codePoint & 0x3f));
+    }
+    else
+    {
+        output += (char)(0xf0 | (codePoint >> 18));
+        output += (char)(0x80 | ((codePoint >> 12) & 0x3f));
+        output += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+        output += (char)(0x80 | (codePoint & 0x3f));
+    }
+}
+
+/**
+ *@brief Checks whether a code point can be part of a term: ASCII letters and digits, and any
+ *       non-ASCII character except Latin-1 symbols (¿ ¡ « » ...) and general punctuation (— “ ”)
+ **/
+static bool isTermCharacter(uint32_t codePoint)
+{
+    if (codePoint < 0x80)
+        return (codePoint >= 'a' && codePoint <= 'z') || (codePoint >= 'A' && codePoint <= 'Z') ||
+               (codePoint >= '0' && codePoint <= '9');
+
+    if (codePoint <= 0xbf || codePoint == 0xd7 || codePoint == 0xf7)
+        return false;
+
+    return codePoint < 0x2000 || codePoint > 0x206f;
+}
+
+/**
+ *@brief Decodes a character reference (&#NNN;, &#xHHH; or a named one like &amp;) at the
+ *       start of a text
+ *
+ *@param text           text that starts with '&'
+ *@param codePoint      decoded code point, 0 for named references
+ *
+ *@return size_t        length of the reference, 0 if there is none
+ **/
+static size_t decodeReference(string_view text, uint32_t &codePoint)
+{
+    codePoint = 0;
+    size_t i = 1;
+
+    if (i < text.size() && text[i] != '#')
+    {
+        // Named references only show up for markup characters (&amp; &lt; ...): separators
+        while (i < text.size() && i < 10 && isalpha((unsigned char)text[i]))
+            i++;
+
+        return (i > 1 && i < text.size() && text[i] == ';') ? i + 1 : 0;
+    }
+
+    i++;
+    int base = 10;
+    if (i < text.size() && (text[i] == 'x' || text[i] == 'X'))
+    {
+        base = 16;
+        i++;
+    }
+
+    size_t digitStart = i;
+    for (; i < text.size() && i < digitStart + 7; i++)
+    {
+        char c = text[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (base == 16 && c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            break;
+
+        codePoint = codePoint * base + digit;
+    }
+
+    if (i == digitStart || i >= text.size() || text[i] != ';' || codePoint >= 0x110000)
+        return 0;
+
+    return i + 1;
+}
+
+/**
+ *@brief Decodes the UTF-8 sequence at the start of a text
+ *
+ *@param text           non-empty text
+ *@param codePoint      decoded code point
+ *
+ *@return size_t        length of the sequence (1 for invalid bytes, decoded as themselves)
+ **/
+static size_t decodeUTF8(string_view text, uint32_t &codePoint)
+{
+    unsigned char c = text[0];
+    size_t length = (c < 0x80) ? 1 : ((c & 0xe0) == 0xc0) ? 2 : ((c & 0xf0) == 0xe0) ? 3 :
+                    ((c & 0xf8) == 0xf0) ? 4 : 0;
+
+    if (length == 0 || length > text.size())
+    {
+        codePoint = c;
+        return 1;
+    }
+
+    codePoint = (length == 1) ? c : c & (0x7f >> length);
+    for (size_t i = 1; i < length; i++)
+    {
+        if ((text[i] & 0xc0) != 0x80)
+        {
+            codePoint = c;
+            return 1;
+        }
+        codePoint = (codePoint << 6) | (text[i] & 0x3f);
+    }
+
+    return length;
+}
+
+/**
+ *@brief Splits a text into lowercase terms
+ *
+ *@param text           article text or searched words
+ *@param tokens         terms, in order of appearance, are appended here
+ **/
+void Tokenizer::tokenize(string_view text, vector<string> &tokens)
+{
+    string token;
+
+    for (size_t i = 0; i < text.size();)
+    {
+        uint32_t codePoint;
+        size_t length = 0;
+
+        if (text[i] == '&')
+            length = decodeReference(text.substr(i), codePoint);
+        if (length == 0)
+            length = decodeUTF8(text.substr(i), codePoint);
+
+        if (isTermCharacter(codePoint))
+            appendCodePoint(codePoint, token);
+        else if (!token.empty())
+        {
+            tokens.push_back(token);
+            token.clear();
+        }
+
+        i += length;
+    }
+
+    if (!token.empty())
+        tokens.push_back(token);
+}
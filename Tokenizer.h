@@ -0,0 +1,24 @@
+/**
+ * @file Tokenizer.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Splits article text and searched words into index terms
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Tokenizer
+{
+public:
+    static void tokenize(std::string_view text, std::vector<std::string> &tokens);
+};
+
+#endif
@@ -0,0 +1,244 @@
+/**
+ * @file WorkStealingPool.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Work-stealing thread pool used to fan out per-shard work
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Every worker owns a deque. Submitted tasks are distributed round-robin between the deques,
+ * a worker takes tasks from the back of its own deque and, when it runs dry, steals from the
+ * front of the other workers' deques. The thread that calls run() also steals tasks while it
+ * waits, so nested fan-outs can never deadlock the pool.
+ *
+ * An exception thrown by a task of run() is handed to the caller of run() once the whole batch
+ * finished. Tasks queued with submit() have no caller to hand it to: it is reported and the
+ * worker goes on with the next task.
+ *
+ */
+
+#include "WorkStealingPool.h"
+
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+/**
+ *@brief class constructor
+ *
+ *@param threadCount    number of worker threads (at least one is always created)
+ **/
+WorkStealingPool::WorkStealingPool(int threadCount) : pendingTasks(0), nextQueue(0), stopping(false)
+{
+    if (threadCount < 1)
+        threadCount = 1;
+
+    for (int i = 0; i < threadCount; i++)
+        queues.push_back(make_unique<WorkQueue>());
+
+    for (int i = 0; i < threadCount; i++)
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    sleepCondition.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+/**
+ *@brief Queues a task without waiting for it. The task should handle its own exceptions: one
+ *       that escapes is only reported.
+ *
+ *@param task           task to run on any worker
+ **/
+void WorkStealingPool::submit(function<void()> task)
+{
+    int queueIndex = nextQueue++ % queues.size();
+
+    // Counted before it is pushed so that a thief can never decrement below zero
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        pendingTasks++;
+    }
+
+    {
+        lock_guard<mutex> lock(queues[queueIndex]->mutex);
+        queues[queueIndex]->tasks.push_back(move(task));
+    }
+    sleepCondition.notify_one();
+}
+
+/**
+ *@brief Runs a batch of tasks and returns once all of them finished. The calling thread
+ *       executes queued tasks while it waits. If tasks threw, the first exception is rethrown
+ *       here after the others finished.
+ *
+ *@param tasks          tasks to run
+ **/
+void WorkStealingPool::run(vector<function<void()>> &tasks)
+{
+    struct Batch
+    {
+        mutex doneMutex;
+        condition_variable doneCondition;
+        size_t remaining;
+        exception_ptr exception;
+    };
+
+    auto batch = make_shared<Batch>();
+    batch->remaining = tasks.size();
+
+    for (auto &task : tasks)
+    {
+        submit([batch, &task]() {
+            exception_ptr exception;
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                exception = current_exception();
+            }
+
+            lock_guard<mutex> lock(batch->doneMutex);
+            if (exception && !batch->exception)
+                batch->exception = exception;
+            if (--batch->remaining == 0)
+                batch->doneCondition.notify_all();
+        });
+    }
+
+    function<void()> task;
+    while (true)
+    {
+        {
+            lock_guard<mutex> lock(batch->doneMutex);
+            if (batch->remaining == 0)
+                break;
+        }
+
+        if (stealTask(-1, task))
+        {
+            runTask(task);
+            continue;
+        }
+
+        unique_lock<mutex> lock(batch->doneMutex);
+        batch->doneCondition.wait_for(lock, chrono::milliseconds(1),
+                                      [&]() { return batch->remaining == 0; });
+    }
+
+    if (batch->exception)
+        rethrow_exception(batch->exception);
+}
+
+int WorkStealingPool::getThreadCount()
+{
+    return (int)workers.size();
+}
+
+/**
+ *@brief Number of tasks that were submitted but not yet picked up by a thread
+ **/
+size_t WorkStealingPool::getQueueDepth()
+{
+    return pendingTasks.load();
+}
+
+/**
+ *@brief Takes the newest task of a worker's own deque
+ **/
+bool WorkStealingPool::popTask(int queueIndex, function<void()> &task)
+{
+    WorkQueue &queue = *queues[queueIndex];
+    lock_guard<mutex> lock(queue.mutex);
+
+    if (queue.tasks.empty())
+        return false;
+
+    task = move(queue.tasks.back());
+    queue.tasks.pop_back();
+    pendingTasks--;
+
+    return true;
+}
+
+/**
+ *@brief Takes the oldest task of any deque other than queueIndex (-1 to look at all of them)
+ **/
+bool WorkStealingPool::stealTask(int queueIndex, function<void()> &task)
+{
+    size_t queueCount = queues.size();
+    size_t start = (queueIndex < 0) ? 0 : queueIndex + 1;
+
+    for (size_t i = 0; i < queueCount; i++)
+    {
+        size_t victim = (start + i) % queueCount;
+        if ((int)victim == queueIndex)
+            continue;
+
+        WorkQueue &queue = *queues[victim];
+        lock_guard<mutex> lock(queue.mutex);
+
+        if (queue.tasks.empty())
+            continue;
+
+        task = move(queue.tasks.front());
+        queue.tasks.pop_front();
+        pendingTasks--;
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ *@brief Runs a task that was taken from a deque and releases it. An exception it throws is
+ *       reported so that it does not end the thread that ran it.
+ **/
+void WorkStealingPool::runTask(function<void()> &task)
+{
+    try
+    {
+        task();
+    }
+    catch (const exception &e)
+    {
+        cerr << "A pool task failed: " << e.what() << endl;
+    }
+    catch (...)
+    {
+        cerr << "A pool task failed" << endl;
+    }
+    task = nullptr;
+}
+
+void WorkStealingPool::workerLoop(int queueIndex)
+{
+    function<void()> task;
+
+    while (true)
+    {
+        if (popTask(queueIndex, task) || stealTask(queueIndex, task))
+        {
+            runTask(task);
+            continue;
+        }
+
+        unique_lock<mutex> lock(sleepMutex);
+        sleepCondition.wait(lock, [this]() { return stopping || pendingTasks > 0; });
+
+        if (stopping && pendingTasks == 0)
+            return;
+    }
+}
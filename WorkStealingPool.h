@@ -0,0 +1,57 @@
+/**
+ * @file WorkStealingPool.h
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief Work-stealing thread pool used to fan out per-shard work
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ */
+
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool
+{
+public:
+    WorkStealingPool(int threadCount);
+    ~WorkStealingPool();
+
+    void submit(std::function<void()> task);
+    void run(std::vector<std::function<void()>> &tasks);
+
+    int getThreadCount();
+    size_t getQueueDepth();
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool popTask(int queueIndex, std::function<void()> &task);
+    bool stealTask(int queueIndex, std::function<void()> &task);
+    void runTask(std::function<void()> &task);
+    void workerLoop(int queueIndex);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<size_t> pendingTasks;
+    std::atomic<unsigned int> nextQueue;
+    bool stopping;
+};
+
+#endif
@@ -20,7 +20,7 @@
  *  of an html so that we could reward the presence of the searched word in the headers of the html.
  *  This involved a more complex parser that was initially written, but we opted out parsing every-
  *  thing into a single string instead of separating headers from body. This parser can still be 
- *  found however in the class EDAoogleHttpRequestHandler in case future designs wanted to incorpo-
+ *  found however in the class HTMLParser in case future designs wanted to incorpo-
  *  rate this functionality. The method's name is filterHTMLContent.
  *
  * 
@@ -47,15 +47,32 @@
  * 
  */
 
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include <microhttpd.h>
 
+#include "Analyzer.h"
 #include "CommandLineParser.h"
 #include "HttpServer.h"
 #include "EDAoogleHttpRequestHandler.h"
+#include "CoordinatorHttpRequestHandler.h"
 
 using namespace std;
 
+static volatile sig_atomic_t rebuildRequested = 0;
+
+/**
+ *@brief Signal handler: asks for a background rebuild of the index (kill -HUP <pid>)
+ **/
+static void requestRebuild(int)
+{
+    rebuildRequested = 1;
+}
+
 int main(int argc, const char *argv[])
 {
     CommandLineParser parser(argc, argv);
@@ -63,13 +80,48 @@ int main(int argc, const char *argv[])
     // Configuration
     int port = 8000;
     string homePath = PATH_CORRECTION "www";
+    string indexPath = PATH_CORRECTION;
+    bool requireIndex = false;
+    int shardCount = DEFAULT_SHARD_COUNT;
+    string role = "standalone";
+    int sliceIndex = 0;
+    int sliceCount = 1;
+    string shardAddresses;
+    int shardTimeout = DEFAULT_SHARD_TIMEOUT_MS;
+    int slowQueryThreshold = -1;
+    int searchWorkerCount = 0;
+    size_t memoryBudget = 0;
+    AdmissionLimits admissionLimits;
+    string slowQueryLogPath = PATH_CORRECTION "slow_queries.log";
 
     // Parse command line
     if (parser.hasOption("--help"))
     {
         cout << "edahttpd 0.1" << endl
              << endl;
-        cout << "Usage: edahttpd [-p PORT] [-h HOME_PATH]" << endl;
+        cout << "Usage: edahttpd [-p PORT] [-h HOME_PATH] [-s SHARDS] [-i INDEX_PATH]" << endl
+             << "               [--require-index]" << endl
+             << "               [--role standalone|shard|coordinator]" << endl
+             << "               [--slice INDEX/COUNT] (shard role)" << endl
+             << "               [--shards HOST:PORT,...] [--shard-timeout MS] (coordinator role)"
+             << endl
+             << "               [--slow-query-ms MS] [--slow-query-log PATH]" << endl
+             << "               [--search-workers THREADS] [--max-queued-searches SEARCHES]"
+             << endl
+             << "               [--search-deadline-ms MS] [--retry-after SECONDS]" << endl
+             << "               [--analyzer spanish|simple] [--memory-budget MB]" << endl
+             << endl
+             << "The index is rebuilt in the background on SIGHUP or on POST /admin/rebuild"
+             << endl
+             << "from this machine." << endl
+             << "A newer artifact from edaindex in INDEX_PATH is loaded instead of rebuilding;"
+             << endl
+             << "with --require-index the server does not start without a valid one." << endl
+             << "With --memory-budget the indexes of the least recently searched shards are"
+             << endl
+             << "dropped from memory when the index does not fit, and reloaded when it fits"
+             << endl
+             << "again; see POST /admin/memory." << endl;
 
         return 0;
     }
@@ -80,20 +132,149 @@ int main(int argc, const char *argv[])
     if (parser.hasOption("-h"))
         homePath = parser.getOption("-h");
 
-    // Start server
-    HttpServer server(port);
+    if (parser.hasOption("-s"))
+        shardCount = stoi(parser.getOption("-s"));
+
+    if (parser.hasOption("-i"))
+        indexPath = parser.getOption("-i");
+
+    if (parser.hasOption("--require-index"))
+        requireIndex = true;
+
+    if (parser.hasOption("--role"))
+        role = parser.getOption("--role");
+
+    if (parser.hasOption("--slice"))
+    {
+        string slice = parser.getOption("--slice");
+        size_t separator = slice.find('/');
+        if (separator != string::npos)
+        {
+            sliceIndex = stoi(slice.substr(0, separator));
+            sliceCount = stoi(slice.substr(separator + 1));
+        }
+    }
+
+    if (parser.hasOption("--shards"))
+        shardAddresses = parser.getOption("--shards");
 
-    EDAoogleHttpRequestHandler edaOogleHttpRequestHandler(homePath);
-    server.setHttpRequestHandler(&edaOogleHttpRequestHandler);
+    if (parser.hasOption("--shard-timeout"))
+        shardTimeout = stoi(parser.getOption("--shard-timeout"));
+
+    if (parser.hasOption("--slow-query-ms"))
+        slowQueryThreshold = stoi(parser.getOption("--slow-query-ms"));
+
+    if (parser.hasOption("--slow-query-log"))
+        slowQueryLogPath = parser.getOption("--slow-query-log");
+
+    if (parser.hasOption("--search-workers"))
+        searchWorkerCount = stoi(parser.getOption("--search-workers"));
+
+    if (parser.hasOption("--max-queued-searches"))
+        admissionLimits.maxQueuedSearches = stoi(parser.getOption("--max-queued-searches"));
+
+    if (parser.hasOption("--search-deadline-ms"))
+        admissionLimits.searchDeadline = stoi(parser.getOption("--search-deadline-ms"));
+
+    if (parser.hasOption("--retry-after"))
+        admissionLimits.retryAfter = stoi(parser.getOption("--retry-after"));
+
+    if (parser.hasOption("--memory-budget"))
+        memoryBudget = stoull(parser.getOption("--memory-budget")) << 20;
+
+    if (parser.hasOption("--analyzer") && !Analyzer::configure(parser.getOption("--analyzer")))
+    {
+        cerr << "Unknown analyzer: " << parser.getOption("--analyzer") << endl;
+        return 1;
+    }
+
+    if (role != "standalone" && role != "shard" && role != "coordinator")
+    {
+        cerr << "Unknown role: " << role << endl;
+        return 1;
+    }
+
+    if (role == "coordinator" && shardAddresses.empty())
+    {
+        cerr << "The coordinator role needs --shards" << endl;
+        return 1;
+    }
+
+    vector<string> shardAddressList;
+    if (role == "coordinator" &&
+        !CoordinatorHttpRequestHandler::parseShardAddresses(shardAddresses, shardAddressList))
+    {
+        cerr << "Invalid shard addresses: " << shardAddresses << " (expected host:port,...)"
+             << endl;
+        return 1;
+    }
+
+    if (sliceCount < 1 || sliceIndex < 0 || sliceIndex >= sliceCount)
+    {
+        cerr << "Invalid slice" << endl;
+        return 1;
+    }
+
+    // Serving nodes can be told to never parse html themselves
+    if (requireIndex && role != "coordinator")
+    {
+        IndexBuilder indexBuilder(homePath, indexPath, shardCount, sliceIndex, sliceCount);
+        uint64_t generation;
+        if (!indexBuilder.verifyManifest(generation))
+        {
+            cerr << "No valid index artifact in " << indexPath << " (see edaindex)" << endl;
+            return 1;
+        }
+    }
+
+    unique_ptr<EDAoogleHttpRequestHandler> edaOogleHttpRequestHandler;
+    if (role == "coordinator")
+        edaOogleHttpRequestHandler = make_unique<CoordinatorHttpRequestHandler>(
+            homePath, shardAddressList, shardTimeout);
+    else
+        edaOogleHttpRequestHandler = make_unique<EDAoogleHttpRequestHandler>(
+            homePath, shardCount, sliceIndex, sliceCount, indexPath, memoryBudget);
+
+    unique_ptr<SlowQueryLog> slowQueryLog;
+    if (slowQueryThreshold >= 0)
+    {
+        slowQueryLog = make_unique<SlowQueryLog>(slowQueryLogPath, slowQueryThreshold);
+        edaOogleHttpRequestHandler->setSlowQueryLog(slowQueryLog.get());
+    }
+
+    // Started last so that it is stopped (and its search workers are drained) before the
+    // handler and the slow query log are destroyed
+    HttpServer server(port, searchWorkerCount, admissionLimits);
+    server.setHttpRequestHandler(edaOogleHttpRequestHandler.get());
 
     if (server.isRunning())
     {
         cout << "Running server..." << endl;
 
+        // Signal handlers can only set a flag, so the rebuild is started from this thread
+        atomic<bool> stopping(false);
+        thread signalWatcher([&]() {
+            while (!stopping)
+            {
+                if (rebuildRequested)
+                {
+                    rebuildRequested = 0;
+                    edaOogleHttpRequestHandler->requestRebuild();
+                }
+                this_thread::sleep_for(chrono::milliseconds(100));
+            }
+        });
+#ifdef SIGHUP
+        signal(SIGHUP, requestRebuild);
+#endif
+
         // Wait for keyboard entry
         char value;
         cin >> value;
 
         cout << "Stopping server..." << endl;
+
+        stopping = true;
+        signalWatcher.join();
     }
 }
@@ -0,0 +1,224 @@
+/**
+ * @file main_bench.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief EDAoogle - microbenchmarks
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Measures the parsing, indexing, search and rendering paths of the search engine. Every
+ * benchmark prints one JSON object per line so that runs can be stored and compared:
+ *      {"benchmark":"parseHTMLContent","iterations":50,"mean_ns":...,"min_ns":...,...}
+ *
+ * Usage: edaoogle_bench [-h HOME_PATH] [-s SHARDS] [-n ITERATIONS] [-f HTML_FILE] [-o OUTPUT]
+ *
+ * NOTE: the index is written to the same place edahttpd uses, so the index build benchmark
+ * leaves behind a new generation of the shards, which the server will serve next time.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "EDAoogleHttpRequestHandler.h"
+#include "HTMLParser.h"
+
+using namespace std;
+
+/**
+ * @brief Gives the benchmarks access to the search and rendering steps of the handler
+ */
+class BenchmarkHttpRequestHandler : public EDAoogleHttpRequestHandler
+{
+public:
+    BenchmarkHttpRequestHandler(string homePath, int shardCount) :
+    EDAoogleHttpRequestHandler(homePath, shardCount)
+    {
+    }
+
+    using EDAoogleHttpRequestHandler::renderSearchPage;
+    using EDAoogleHttpRequestHandler::search;
+    using EDAoogleHttpRequestHandler::splitStringByAddSymbol;
+};
+
+// Results are accumulated here so that the compiler cannot drop the benchmarked calls
+static volatile size_t benchmarkSink = 0;
+
+/**
+ *@brief Runs a benchmark and prints its statistics as a JSON line
+ *
+ *@param output         stream the JSON line is written to
+ *@param name           benchmark name
+ *@param iterations     number of timed runs (one untimed warm-up run is always done)
+ *@param bytes          bytes processed per run, 0 if throughput does not apply
+ *@param benchmark      code to measure, returns a value that depends on its work
+ **/
+void runBenchmark(ostream &output, const string &name, int iterations, size_t bytes,
+                  function<size_t()> benchmark)
+{
+    benchmarkSink += benchmark();
+
+    vector<double> samples;
+    for (int i = 0; i < iterations; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        benchmarkSink += benchmark();
+        auto end = chrono::steady_clock::now();
+
+        samples.push_back((double)chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+    }
+
+    sort(samples.begin(), samples.end());
+
+    double total = 0;
+    for (double sample : samples)
+        total += sample;
+
+    double mean = total / samples.size();
+    auto percentile = [&](double p) { return samples[(size_t)(p * (samples.size() - 1))]; };
+
+    stringstream line;
+    line << fixed;
+    line.precision(0);
+    line << "{\"benchmark\":\"" << name << "\""
+         << ",\"iterations\":" << iterations
+         << ",\"mean_ns\":" << mean
+         << ",\"min_ns\":" << samples.front()
+         << ",\"p50_ns\":" << percentile(0.50)
+         << ",\"p90_ns\":" << percentile(0.90)
+         << ",\"max_ns\":" << samples.back();
+    if (bytes > 0)
+    {
+        line.precision(2);
+        line << ",\"mb_per_s\":" << (bytes / (mean / 1e9)) / (1024.0 * 1024.0);
+    }
+    line << "}";
+
+    output << line.str() << endl;
+}
+
+int main(int argc, const char *argv[])
+{
+    CommandLineParser parser(argc, argv);
+
+    string homePath = PATH_CORRECTION "www";
+    int shardCount = DEFAULT_SHARD_COUNT;
+    int iterations = 20;
+    string htmlFile;
+    string outputPath;
+
+    if (parser.hasOption("--help"))
+    {
+        cout << "Usage: edaoogle_bench [-h HOME_PATH] [-s SHARDS] [-n ITERATIONS] [-f HTML_FILE]"
+             << " [-o OUTPUT]" << endl;
+        return 0;
+    }
+
+    if (parser.hasOption("-h"))
+        homePath = parser.getOption("-h");
+    if (parser.hasOption("-s"))
+        shardCount = stoi(parser.getOption("-s"));
+    if (parser.hasOption("-n"))
+        iterations = max(1, stoi(parser.getOption("-n")));
+    if (parser.hasOption("-f"))
+        htmlFile = parser.getOption("-f");
+    if (parser.hasOption("-o"))
+        outputPath = parser.getOption("-o");
+
+    if (htmlFile.empty())
+        htmlFile = homePath + "/wiki/Agua.html";
+
+    ofstream outputFile;
+    if (!outputPath.empty())
+        outputFile.open(outputPath, ios::app);
+    ostream &output = outputFile.is_open() ? outputFile : cout;
+
+    /* HTML CONDITIONING */
+
+    string htmlContent = HTMLParser::readHTMLFile(htmlFile);
+    if (htmlContent.empty())
+    {
+        cerr << "Could not read " << htmlFile << endl;
+        return 1;
+    }
+
+    runBenchmark(output, "readHTMLFile", iterations, htmlContent.size(), [&]() {
+        return HTMLParser::readHTMLFile(htmlFile).size();
+    });
+
+    runBenchmark(output, "parseHTMLContent", iterations, htmlContent.size(), [&]() {
+        return HTMLParser::parseHTMLContent(htmlContent).size();
+    });
+
+    runBenchmark(output, "filterHTMLContent", iterations, htmlContent.size(), [&]() {
+        return HTMLParser::filterHTMLContent(htmlContent).first.size();
+    });
+
+    /* INDEXING */
+
+    BenchmarkHttpRequestHandler handler(homePath, shardCount);
+
+    runBenchmark(output, "indexBuild/" + to_string(shardCount) + "_shards", 1, 0, [&]() {
+        return (size_t)handler.rebuildIndex();
+    });
+
+    /* SEARCHING */
+
+    struct BenchmarkQuery
+    {
+        string name;
+        string words;
+        SearchOptions options;
+    };
+
+    SearchOptions matchAll;
+    matchAll.matchAll = true;
+    SearchOptions longArticles;
+    longArticles.filters.push_back("len:long");
+    vector<BenchmarkQuery> queries = {
+        {"single_term", "agua", SearchOptions()},
+        {"multi_term", "agua+fuego+tierra", SearchOptions()},
+        {"multi_term_all", "agua+fuego+tierra", matchAll},
+        {"multi_term_long", "agua+fuego+tierra", longArticles},
+        {"phrase", "sistema solar", SearchOptions()},
+    };
+
+    // Every run gets a fresh arena, like a request does
+    SearchResults lastResults;
+    shared_ptr<const DocumentStore> lastDocuments;
+    size_t lastMatchCount = 0;
+
+    for (auto &query : queries)
+    {
+        runBenchmark(output, "search/" + query.name, iterations, 0, [&]() {
+            RequestArena arena;
+            SearchTerms words = handler.splitStringByAddSymbol(query.words, arena.getResource());
+            SearchResults results(arena.getResource());
+            int unavailableShards = 0;
+            handler.search(words, query.options, results, lastDocuments, lastMatchCount,
+                           unavailableShards);
+            lastResults.assign(results.begin(), results.end());
+            return results.size();
+        });
+    }
+
+    /* RENDERING */
+
+    runBenchmark(output, "renderSearchPage/" + to_string(lastResults.size()) + "_results",
+                 iterations, 0, [&]() {
+        RequestArena arena;
+        ArenaString page(arena.getResource());
+        handler.renderSearchPage(queries.back().words, lastResults, *lastDocuments, lastMatchCount,
+                                 0.1f, 0, page);
+        return page.size();
+    });
+
+    return 0;
+}
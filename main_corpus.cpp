@@ -0,0 +1,103 @@
+/**
+ * @file main_corpus.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief EDAoogle - synthetic corpus generator
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Generates a Wikipedia-like corpus with as many articles as needed, modeled on the term
+ * distribution, article sizes and link structure of the wiki in HOME_PATH (see
+ * CorpusGenerator), so that indexing and searching can be measured at production scale.
+ *
+ * Examples:
+ *      edacorpus -h ../www -n 100000 -o ../corpus_100k    100k articles in ../corpus_100k/wiki
+ *      edaindex -h ../corpus_100k -s 8 -o ../corpus_100k   index them
+ *      edahttpd -h ../corpus_100k -s 8                      serve them
+ *
+ * Articles only carry the markup around their text; --pad-markup makes them as big as the
+ * articles they are modeled on, which is about 180 GB for 1M articles.
+ *
+ * The same sample, seed and number of articles always give the same corpus.
+ *
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "CommandLineParser.h"
+#include "CorpusGenerator.h"
+#include "EDAoogleHttpRequestHandler.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+
+int main(int argc, const char *argv[])
+{
+    CommandLineParser parser(argc, argv);
+
+    // Configuration
+    string homePath = PATH_CORRECTION "www";
+    string outputPath = PATH_CORRECTION "corpus";
+    long long documentCount = DEFAULT_CORPUS_SIZE;
+    uint64_t seed = DEFAULT_CORPUS_SEED;
+    bool padMarkup = false;
+    int threadCount = thread::hardware_concurrency();
+
+    if (parser.hasOption("--help"))
+    {
+        cout << "Usage: edacorpus [-h HOME_PATH] [-n ARTICLES] [-o OUTPUT_PATH] [--seed SEED]"
+             << endl
+             << "                 [--pad-markup] [-j THREADS]" << endl;
+        return 0;
+    }
+
+    if (parser.hasOption("-h"))
+        homePath = parser.getOption("-h");
+    if (parser.hasOption("-n"))
+        documentCount = stoll(parser.getOption("-n"));
+    if (parser.hasOption("-o"))
+        outputPath = parser.getOption("-o");
+    if (parser.hasOption("--seed"))
+        seed = stoull(parser.getOption("--seed"));
+    if (parser.hasOption("--pad-markup"))
+        padMarkup = true;
+    if (parser.hasOption("-j"))
+        threadCount = stoi(parser.getOption("-j"));
+
+    if (documentCount < 1 || documentCount > INT32_MAX)
+    {
+        cerr << "Invalid number of articles" << endl;
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    WorkStealingPool pool(max(1, threadCount));
+    CorpusGenerator corpusGenerator(seed, padMarkup);
+    if (!corpusGenerator.loadSample(homePath, pool))
+    {
+        cerr << "No articles found in " << homePath << "/wiki" << endl;
+        return 1;
+    }
+
+    cout << "Generating " << documentCount << " articles into " << outputPath << "/wiki..."
+         << endl;
+
+    int articleCount = corpusGenerator.generate(outputPath, (uint32_t)documentCount, pool);
+    if (articleCount != documentCount)
+    {
+        cerr << "Only " << max(0, articleCount) << " of " << documentCount
+             << " articles were written" << endl;
+        return 1;
+    }
+
+    chrono::duration<double> duration = chrono::steady_clock::now() - start;
+    cout << "Generated " << articleCount << " articles in " << duration.count() << " seconds"
+         << endl;
+
+    return 0;
+}
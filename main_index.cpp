@@ -0,0 +1,143 @@
+/**
+ * @file main_index.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief EDAoogle - offline indexer
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Builds the index artifact of a corpus (shard files plus a checksummed manifest, see
+ * IndexBuilder) so that serving nodes only have to load it. The PageRank of the link graph of
+ * the corpus is computed first and stored as the static rank of every article. Every shard is validated after it
+ * is written; the manifest is only written if all of them pass.
+ *
+ * Examples:
+ *      edaindex -h ../www -s 4 -o ../                  artifact for edahttpd -s 4
+ *      edaindex -h ../www -s 4 --slice 1/2 -o out/     artifact for edahttpd --role shard
+ *                                                      -s 4 --slice 1/2 -i out/
+ *
+ * A server picks up a newer artifact at startup, on SIGHUP or on POST /admin/rebuild.
+ *
+ */
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "EDAoogleHttpRequestHandler.h"
+#include "IndexBuilder.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+
+int main(int argc, const char *argv[])
+{
+    CommandLineParser parser(argc, argv);
+
+    // Configuration
+    string homePath = PATH_CORRECTION "www";
+    string outputPath = PATH_CORRECTION;
+    int shardCount = DEFAULT_SHARD_COUNT;
+    int sliceIndex = 0;
+    int sliceCount = 1;
+    int threadCount = thread::hardware_concurrency();
+
+    if (parser.hasOption("--help"))
+    {
+        cout << "Usage: edaindex [-h HOME_PATH] [-s SHARDS] [--slice INDEX/COUNT] [-o OUTPUT_PATH]"
+             << endl
+             << "                [-j THREADS]" << endl;
+        return 0;
+    }
+
+    if (parser.hasOption("-h"))
+        homePath = parser.getOption("-h");
+    if (parser.hasOption("-s"))
+        shardCount = stoi(parser.getOption("-s"));
+    if (parser.hasOption("-o"))
+        outputPath = parser.getOption("-o");
+    if (parser.hasOption("-j"))
+        threadCount = stoi(parser.getOption("-j"));
+    if (parser.hasOption("--slice"))
+    {
+        string slice = parser.getOption("--slice");
+        size_t separator = slice.find('/');
+        if (separator != string::npos)
+        {
+            sliceIndex = stoi(slice.substr(0, separator));
+            sliceCount = stoi(slice.substr(separator + 1));
+        }
+    }
+
+    if (shardCount < 1 || sliceCount < 1 || sliceIndex < 0 || sliceIndex >= sliceCount)
+    {
+        cerr << "Invalid shard count or slice" << endl;
+        return 1;
+    }
+
+    error_code error;
+    filesystem::create_directories(filesystem::u8path(outputPath), error);
+
+    IndexBuilder indexBuilder(homePath, outputPath, shardCount, sliceIndex, sliceCount);
+
+    // A new generation never overwrites files that a server may be reading
+    uint64_t generation = indexBuilder.getShardFiles().empty() ?
+                              0 : indexBuilder.getLatestGeneration() + 1;
+
+    cout << "Building generation " << generation << " of " << homePath << " into " << outputPath
+         << "..." << endl;
+
+    auto start = chrono::steady_clock::now();
+
+    WorkStealingPool buildPool(max(1, threadCount));
+    if (!indexBuilder.computeStaticRanks(buildPool))
+    {
+        cerr << "Static ranks were not computed" << endl;
+        return 1;
+    }
+    if (!indexBuilder.findDuplicates(buildPool))
+    {
+        cerr << "Near-duplicates were not collapsed" << endl;
+        return 1;
+    }
+
+    vector<int> articleCounts(shardCount, -1);
+    vector<char> isValid(shardCount, false);
+    vector<function<void()>> buildTasks;
+    for (int i = 0; i < shardCount; i++)
+    {
+        buildTasks.push_back([&, i]() {
+            IndexShard shard(indexBuilder.getShardPath(i, generation));
+            articleCounts[i] = indexBuilder.buildShard(shard, i);
+            isValid[i] = articleCounts[i] >= 0 &&
+                         indexBuilder.validateShard(i, generation, articleCounts[i]);
+        });
+    }
+
+    buildPool.run(buildTasks);
+
+    int articleCount = 0;
+    for (int i = 0; i < shardCount; i++)
+    {
+        if (!isValid[i])
+        {
+            cerr << "Shard " << i << " failed validation, no manifest was written" << endl;
+            return 1;
+        }
+        articleCount += articleCounts[i];
+    }
+
+    if (!indexBuilder.writeManifest(generation))
+        return 1;
+
+    chrono::duration<double> duration = chrono::steady_clock::now() - start;
+    cout << "Indexed " << articleCount << " articles in " << duration.count() << " seconds" << endl
+         << "Manifest: " << indexBuilder.getManifestPath() << endl;
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file main_load.cpp
+ * @authors Nicolás Beade - Franco Dorfman - Vito Pensa Piccolo - Federico Gentile
+ * @brief EDAoogle - HTTP load generator and query log replay
+ * @version 0.2
+ *
+ * @copyright Copyright (c) 2022-2023
+ *
+ * Examples:
+ *      edaload -c 32 -t 30                     closed loop, Zipfian searches from the index
+ *      edaload -c 64 -r 500 -t 60 --static 0.3 open loop at 500 req/s, 30% static pages
+ *      edaload -l queries.txt -c 16 -n 10000   replays a query log
+ *
+ */
+
+#include <filesystem>
+#include <iostream>
+
+#include "CommandLineParser.h"
+#include "EDAoogleHttpRequestHandler.h"
+#include "LoadGenerator.h"
+
+using namespace std;
+
+int main(int argc, const char *argv[])
+{
+    CommandLineParser parser(argc, argv);
+
+    // Configuration
+    string host = "127.0.0.1";
+    int port = 8000;
+    string homePath = PATH_CORRECTION "www";
+    string indexPath = PATH_CORRECTION;
+    string queryLogPath;
+    int concurrency = 8;
+    double rate = 0;
+    double duration = 0;
+    uint64_t requestLimit = 0;
+    double staticRatio = 0.2;
+    size_t vocabularySize = 5000;
+    double zipfExponent = 1.0;
+    int maxTermsPerQuery = 3;
+
+    if (parser.hasOption("--help"))
+    {
+        cout << "Usage: edaload [-a HOST] [-p PORT] [-c CONCURRENCY] [-r RATE] [-t SECONDS]" << endl
+             << "               [-n REQUESTS] [-l QUERY_LOG] [--static RATIO] [-h HOME_PATH]" << endl
+             << "               [-i INDEX_PATH] [--vocabulary WORDS] [--zipf EXPONENT]" << endl
+             << "               [--terms MAX_TERMS]" << endl;
+        return 0;
+    }
+
+    if (parser.hasOption("-a"))
+        host = parser.getOption("-a");
+    if (parser.hasOption("-p"))
+        port = stoi(parser.getOption("-p"));
+    if (parser.hasOption("-c"))
+        concurrency = stoi(parser.getOption("-c"));
+    if (parser.hasOption("-r"))
+        rate = stod(parser.getOption("-r"));
+    if (parser.hasOption("-t"))
+        duration = stod(parser.getOption("-t"));
+    if (parser.hasOption("-n"))
+        requestLimit = stoull(parser.getOption("-n"));
+    if (parser.hasOption("-l"))
+        queryLogPath = parser.getOption("-l");
+    if (parser.hasOption("--static"))
+        staticRatio = stod(parser.getOption("--static"));
+    if (parser.hasOption("-h"))
+        homePath = parser.getOption("-h");
+    if (parser.hasOption("-i"))
+        indexPath = parser.getOption("-i");
+    if (parser.hasOption("--vocabulary"))
+        vocabularySize = stoul(parser.getOption("--vocabulary"));
+    if (parser.hasOption("--zipf"))
+        zipfExponent = stod(parser.getOption("--zipf"));
+    if (parser.hasOption("--terms"))
+        maxTermsPerQuery = stoi(parser.getOption("--terms"));
+
+    LoadGenerator loadGenerator(host, port);
+
+    if (!queryLogPath.empty())
+    {
+        if (!loadGenerator.loadQueryLog(queryLogPath))
+            return 1;
+    }
+    else
+    {
+        // Every index shard in the index folder contributes to the vocabulary
+        vector<string> databasePaths;
+        error_code error;
+        for (const auto &file : filesystem::directory_iterator(indexPath, error))
+        {
+            string fileName = file.path().filename().u8string();
+            if (fileName.rfind(DB_NAME_PREFIX "_", 0) == 0 && file.path().extension() == ".db")
+                databasePaths.push_back(file.path().u8string());
+        }
+
+        if (!loadGenerator.loadVocabulary(databasePaths, vocabularySize, zipfExponent))
+            cerr << "No index vocabulary found in " << indexPath << ", only static pages "
+                 << "will be requested" << endl;
+    }
+
+    if (!loadGenerator.loadStaticPages(homePath + "/wiki") && staticRatio > 0)
+        cerr << "No static pages found in " << homePath << "/wiki" << endl;
+
+    if (!loadGenerator.canRun())
+    {
+        cerr << "Nothing to request" << endl;
+        return 1;
+    }
+
+    cout << "Sending requests to " << host << ":" << port << "..." << endl;
+
+    loadGenerator.run(concurrency, rate, duration, requestLimit, staticRatio, maxTermsPerQuery);
+    loadGenerator.printReport(cout);
+
+    return 0;
+}
@@ -10,66 +10,1135 @@
  * and developed. And regarding SQL fucntions, each of these has it's own error handler 
  * which works by themselves as tests. We decided it was not necessary to test these.
  * 
+ * Every test prints PASS or FAIL and the program fails if any test does.
+ * 
  */
 
 
-#include <microhttpd.h>
-
-#include <iostream>
-#include <string>
-#include <fstream>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <filesystem>
-#include <unordered_map>
-#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
 #include <sstream>
-#include <codecvt>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CoordinatorHttpRequestHandler.h"
+#include "HTMLTemplate.h"
+#include "IndexShard.h"
+#include "InvertedIndex.h"
+#include "LinkGraph.h"
+#include "QueryPlanner.h"
+#include "RequestArena.h"
+#include "RoaringBitmap.h"
+#include "SearchCoalescer.h"
+#include "SimHash.h"
+#include "SlowQueryLog.h"
+#include "SpanishStemmer.h"
+#include "TermDictionary.h"
+#include "WorkStealingPool.h"
 
 using namespace std;
 
+#define SCORE_TOLERANCE 1e-5
+
+// Documents of the synthetic index of the intersection tests, and the period of every term:
+// a term is in the documents that are a multiple of its period
+#define STRATEGY_DOCUMENT_COUNT 4000
+static const vector<pair<string, uint32_t>> strategyTerms = {
+    {"comun", 2}, {"raro", 97}, {"escaso", 50}, {"escaso2", 53}, {"unico", 1000}};
 
 void print(string s);
 int fail();
 int pass();
-int termFreqCallbackTest(void *data, int argc, char **argv, char **columnNames);
+bool isSameScore(float score1, float score2);
+void buildStrategyIndex(InvertedIndex &index);
+vector<uint32_t> getTermDocuments(const string &term);
+string createTestWiki(const vector<pair<string, string>> &articles);
+void writeTestWiki(const string &homePath, const vector<pair<string, string>> &articles);
+HttpArguments decodeQueryString(const string &queryString);
+map<string, size_t> getMemoryStatus(EDAoogleHttpRequestHandler &handler);
+string getShardResponse(EDAoogleHttpRequestHandler &handler, const HttpArguments &arguments);
+string escapeHTMLByByte(const string &text);
+
+/**
+ *@brief Checks that the text scan of a shard adds up the term frequency of every word per
+ *       document, and that match=all keeps only the documents with every word
+ **/
+int testTermFrequencyScan()
+{
+    print("Term frequency scan: ");
+
+    string databasePath = (filesystem::temp_directory_path() / "edaoogle_test_shard.db").string();
+    IndexShard shard(databasePath);
+    if (!shard.beginBuild() ||
+        !shard.addArticle("agua agua volcan", "wiki/Volcan.html", 3, 0.5f) ||
+        !shard.addArticle("agua del rio", "wiki/Rio.html", 3, 0.25f) ||
+        !shard.addArticle("montaña", "wiki/Montana.html", 1, 0.125f) || !shard.endBuild() ||
+        !shard.loadIndex())
+        return fail();
+
+    // Documents are numbered by decreasing static rank: Volcan, Rio, Montana
+    RequestArena arena;
+    SearchTerms words(arena.getResource());
+    words.emplace_back("agua");
+    words.emplace_back("volcan");
+
+    SearchOptions options;
+    SearchResults results(arena.getResource());
+    size_t matchCount;
+    shard.searchText(words, options, 10, results, matchCount);
+    bool isAnyCorrect = matchCount == 2 && results.size() == 2 && results[0].first == 0 &&
+                        isSameScore(results[0].second, 2.0f / 3 + 1.0f / 3) &&
+                        results[1].first == 1 && isSameScore(results[1].second, 1.0f / 3);
+
+    options.matchAll = true;
+    results.clear();
+    shard.searchText(words, options, 10, results, matchCount);
+    bool isAllCorrect = matchCount == 1 && results.size() == 1 && results[0].first == 0 &&
+                        isSameScore(results[0].second, 1.0f);
+
+    error_code error;
+    filesystem::remove(databasePath, error);
+
+    return (isAnyCorrect && isAllCorrect) ? pass() : fail();
+}
+
+/**
+ *@brief Checks that a shard whose index was shed leaves its searches to the text scan, and that
+ *       the reloaded index finds what the index found before
+ **/
+int testShedIndex()
+{
+    print("Shed index: ");
+
+    string databasePath = (filesystem::temp_directory_path() / "edaoogle_test_shard.db").string();
+    IndexShard shard(databasePath);
+    if (!shard.beginBuild() ||
+        !shard.addArticle("agua agua volcan", "wiki/Volcan.html", 3, 0.5f) ||
+        !shard.addArticle("agua del rio", "wiki/Rio.html", 3, 0.25f) ||
+        !shard.addArticle("montaña", "wiki/Montana.html", 1, 0.125f) || !shard.endBuild() ||
+        !shard.loadIndex())
+        return fail();
+
+    RequestArena arena;
+    SearchTerms words(arena.getResource());
+    words.emplace_back("agua");
+    words.emplace_back("volcan");
+    vector<string> terms;
+    IndexShard::getQueryTerms(words, terms);
+
+    SearchOptions options;
+    SearchResults indexResults(arena.getResource());
+    size_t matchCount;
+    bool isCorrect = shard.searchIndex(terms, options, 10, indexResults, matchCount) &&
+                     matchCount == 2 && indexResults.size() == 2;
+
+    // The memory the index took is kept, so the shard knows whether it fits again
+    size_t indexMemory = shard.getIndexMemory();
+    SearchResults results(arena.getResource());
+    isCorrect = isCorrect && shard.shedIndex() == indexMemory && indexMemory > 0 &&
+                !shard.hasIndex() && shard.getIndexMemory() == indexMemory &&
+                !shard.searchIndex(terms, options, 10, results, matchCount) && results.empty();
+
+    isCorrect = isCorrect && shard.reloadIndex() && shard.hasIndex() &&
+                shard.getIndexMemory() == indexMemory &&
+                shard.searchIndex(terms, options, 10, results, matchCount) &&
+                matchCount == 2 && results == indexResults;
+
+    // A shard can also be loaded without its index
+    isCorrect = isCorrect && shard.loadIndex(false) && !shard.hasIndex() &&
+                shard.getDocuments().getDocumentCount() == 3;
+
+    error_code error;
+    filesystem::remove(databasePath, error);
+
+    return isCorrect ? pass() : fail();
+}
+
+/**
+ *@brief Checks that a multi-word search sent by a coordinator reaches a shard server as
+ *       separate words, decoding the request like libmicrohttpd does
+ **/
+int testShardProtocol()
+{
+    print("Shard protocol: ");
+
+    string homePath = createTestWiki({{"Volcan", "agua agua volcan"},
+                                      {"Rio", "agua del rio"},
+                                      {"Montana", "montaña"}});
+    bool isCorrect = true;
+    {
+        EDAoogleHttpRequestHandler shardServer(homePath, 1, 0, 1, homePath);
+
+        RequestArena arena;
+        SearchTerms words(arena.getResource());
+        words.emplace_back("agua");
+        words.emplace_back("volcan");
+
+        // Searched as a phrase, "agua volcan" would only match Volcan
+        SearchOptions options;
+        for (size_t expectedMatchCount : {2, 1})
+        {
+            string query = CoordinatorHttpRequestHandler::getShardQuery(words, options);
+            size_t queryStart = query.find('?');
+
+            vector<char> response;
+            shardServer.handleRequest(query.substr(0, queryStart),
+                                      decodeQueryString(query.substr(queryStart + 1)), response);
+
+            // The match count, then one line per result
+            string responseString(response.begin(), response.end());
+            isCorrect = isCorrect &&
+                        strtoul(responseString.c_str(), nullptr, 10) == expectedMatchCount &&
+                        (size_t)count(responseString.begin(), responseString.end(), '\n') ==
+                            expectedMatchCount + 1;
+
+            options.matchAll = true;
+        }
+    }
+
+    error_code error;
+    filesystem::remove_all(homePath, error);
+
+    return isCorrect ? pass() : fail();
+}
+
+/**
+ *@brief Checks that a handler within a memory budget sheds the indexes that do not fit, also
+ *       when a rebuild makes them grow, and that searches on the shed shards find the same
+ *       articles
+ **/
+int testMemoryBudget()
+{
+    print("Memory budget: ");
+
+    // Words that are not inside one another, so a scan of the text matches like the index. The
+    // larger articles also get words of their own, which make their index grow.
+    const vector<string> vocabulary = {"agua", "volcan", "bosque", "ciudad", "puente", "camino",
+                                       "piedra", "nube", "fuego", "tierra", "cielo", "lago",
+                                       "isla", "playa", "selva", "llanura"};
+    mt19937 random(42);
+    vector<pair<string, string>> articles;
+    vector<pair<string, string>> largeArticles;
+    for (int i = 0; i < 40; i++)
+    {
+        string text;
+        for (int word = 0; word < 50 + i * 5; word++)
+            text += vocabulary[random() % (vocabulary.size() - i % 2)] + " ";
+        articles.emplace_back("Articulo" + to_string(i), text);
+
+        for (int word = 0; word < 300; word++)
+        {
+            text += 'x';
+            for (int letter = 0; letter < 8; letter++)
+                text += (char)('a' + random() % 26);
+            text += ' ';
+        }
+        largeArticles.emplace_back("Articulo" + to_string(i), text);
+    }
+
+    string homePath = createTestWiki(largeArticles);
+    for (const char *indexFolder : {"index_unlimited", "index_no_room", "index_budget"})
+        filesystem::create_directories(filesystem::path(homePath) / indexFolder);
+
+    const vector<HttpArguments> searches = {
+        {{"q", "agua"}}, {{"q", "llanura"}}, {{"q", "bosque+llanura"}, {"match", "all"}}};
+    vector<string> expectedResponses;
+    map<string, size_t> status;
+    {
+        EDAoogleHttpRequestHandler shardServer(homePath, 4, 0, 1, homePath + "/index_unlimited");
+        status = getMemoryStatus(shardServer);
+        for (const auto &search : searches)
+            expectedResponses.push_back(getShardResponse(shardServer, search));
+    }
+    // The budget counts everything but SQLite
+    size_t largeIndexMemory = status["total_bytes"] - status["sqlite_bytes"];
+
+    bool isCorrect = true;
+    {
+        // No room for any index
+        EDAoogleHttpRequestHandler shardServer(homePath, 4, 0, 1, homePath + "/index_no_room",
+                                               MIN_SQLITE_HEAP_LIMIT);
+        isCorrect = getMemoryStatus(shardServer)["shards_with_index"] == 0;
+        // The report is an admin action, not a page
+        vector<char> response;
+        isCorrect = isCorrect &&
+                    !shardServer.handleRequest("/admin/memory", HttpArguments(), response);
+        for (size_t i = 0; i < searches.size(); i++)
+        {
+            isCorrect = isCorrect &&
+                        getShardResponse(shardServer, searches[i]) == expectedResponses[i];
+        }
+    }
+    {
+        // Room for the index of the small articles, but only for half of the large ones
+        writeTestWiki(homePath, articles);
+        size_t indexLimit = largeIndexMemory / 2;
+        EDAoogleHttpRequestHandler shardServer(homePath, 4, 0, 1, homePath + "/index_budget",
+                                               MIN_SQLITE_HEAP_LIMIT + indexLimit);
+        isCorrect = isCorrect && getMemoryStatus(shardServer)["shards_with_index"] == 4;
+
+        writeTestWiki(homePath, largeArticles);
+        isCorrect = isCorrect && shardServer.rebuildIndex();
+        status = getMemoryStatus(shardServer);
+        isCorrect = isCorrect && status["shards_with_index"] > 0 &&
+                    status["shards_with_index"] < 4 &&
+                    status["total_bytes"] - status["sqlite_bytes"] <= indexLimit;
+        for (size_t i = 0; i < searches.size(); i++)
+        {
+            isCorrect = isCorrect &&
+                        getShardResponse(shardServer, searches[i]) == expectedResponses[i];
+        }
+    }
+
+    error_code error;
+    filesystem::remove_all(homePath, error);
+
+    return isCorrect ? pass() : fail();
+}
+
+/**
+ *@brief Checks that the WAND top-k of random queries is the top-k of an exhaustive scoring of
+ *       every document
+ **/
+int testWandTopK()
+{
+    print("WAND top-k: ");
 
-void testTermFreqCallback()
+    // Term t is drawn with a probability that falls with t, like words in a text
+    mt19937 random(42);
+    geometric_distribution<uint32_t> termDistribution(0.05);
+    uniform_int_distribution<uint32_t> lengthDistribution(20, 80);
+
+    InvertedIndex index;
+    vector<unordered_map<string, float>> documentScores(3000);
+    for (uint32_t document = 0; document < documentScores.size(); document++)
+    {
+        vector<string> tokens(lengthDistribution(random));
+        for (auto &token : tokens)
+            token = "t" + to_string(termDistribution(random));
+
+        index.addDocument(document, tokens);
+        for (const auto &token : tokens)
+            documentScores[document][token] += 1.0f / tokens.size();
+    }
+    index.freeze();
+
+    uniform_int_distribution<uint32_t> queryTermDistribution(0, 60);
+    for (int query = 0; query < 100; query++)
+    {
+        vector<string> terms;
+        while (terms.size() < (size_t)(1 + query % 4))
+        {
+            string term = "t" + to_string(queryTermDistribution(random));
+            if (find(terms.begin(), terms.end(), term) == terms.end())
+                terms.push_back(term);
+        }
+        size_t k = 1 + query % 20;
+
+        // WAND reports the documents of the most common term as the match count
+        vector<pair<uint32_t, float>> expectedResults;
+        unordered_map<string, size_t> documentFrequencies;
+        for (uint32_t document = 0; document < documentScores.size(); document++)
+        {
+            float score = 0;
+            bool isMatch = false;
+            for (const auto &term : terms)
+            {
+                auto termScore = documentScores[document].find(term);
+                if (termScore != documentScores[document].end())
+                {
+                    score += termScore->second;
+                    isMatch = true;
+                    documentFrequencies[term]++;
+                }
+            }
+            if (isMatch)
+                expectedResults.emplace_back(document, score);
+        }
+
+        size_t expectedMatchCount = 0;
+        for (const auto &documentFrequency : documentFrequencies)
+            expectedMatchCount = max(expectedMatchCount, documentFrequency.second);
+        sort(expectedResults.begin(), expectedResults.end(),
+             [](const pair<uint32_t, float> &a, const pair<uint32_t, float> &b) {
+                 return a.second > b.second;
+             });
+
+        vector<pair<uint32_t, float>> results;
+        size_t matchCount;
+        index.searchTopK(terms, nullptr, k, results, matchCount);
+        if (matchCount != expectedMatchCount ||
+            results.size() != min(k, expectedResults.size()))
+            return fail();
+
+        // Ties can be broken either way, so the scores are compared rank by rank and every
+        // result must have the score of its document
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            auto expectedResult = find_if(expectedResults.begin(), expectedResults.end(),
+                                          [&](const pair<uint32_t, float> &result) {
+                                              return result.first == results[i].first;
+                                          });
+            if (!isSameScore(results[i].second, expectedResults[i].second) ||
+                expectedResult == expectedResults.end() ||
+                !isSameScore(results[i].second, expectedResult->second))
+                return fail();
+        }
+    }
+
+    return pass();
+}
+
+/**
+ *@brief Checks that every intersection strategy of a match=all search finds the documents
+ *       std::set_intersection finds
+ **/
+int testIntersectionStrategies()
 {
-    // Create test data
-    vector<pair<string, float>> termFrequencies;
-    termFrequencies.emplace_back("path1", 0.5f);
-    termFrequencies.emplace_back("path2", 0.25f);
-    termFrequencies.emplace_back("path3", 0.75f);
+    print("Intersection strategies: ");
 
-    // Create test arguments
-    const int argc = 2;
-    char *argv[argc] = { "path2", "0.1" };
-    char *columnNames[argc] = { "Path", "Frequency" };
+    InvertedIndex index;
+    buildStrategyIndex(index);
 
-    // Call the termFreqCallback
-    int result = termFreqCallbackTest(&termFrequencies, argc, argv, columnNames);
+    // The postings of the rarest term are the candidates the second term is intersected with
+    struct StrategyCase
+    {
+        string rareTerm;
+        string term;
+        bool hasBitmap;
+        IntersectionStrategy strategy;
+    };
+    const vector<StrategyCase> strategyCases = {{"escaso2", "escaso", false, INTERSECTION_MERGE},
+                                                {"unico", "escaso", false, INTERSECTION_GALLOPING},
+                                                {"raro", "comun", true, INTERSECTION_BITMAP}};
 
-    // Print the updated term frequencies
-    for (const auto &pair : termFrequencies)
+    for (const auto &strategyCase : strategyCases)
     {
-        cout << "Path: " << pair.first << ", Frequency: " << pair.second << endl;
+        vector<uint32_t> rareDocuments = getTermDocuments(strategyCase.rareTerm);
+        vector<uint32_t> termDocuments = getTermDocuments(strategyCase.term);
+        if (QueryPlanner::chooseStrategy(rareDocuments.size(), termDocuments.size(),
+                                         strategyCase.hasBitmap) != strategyCase.strategy)
+            return fail();
+
+        vector<uint32_t> expectedDocuments;
+        set_intersection(rareDocuments.begin(), rareDocuments.end(), termDocuments.begin(),
+                         termDocuments.end(), back_inserter(expectedDocuments));
+
+        vector<pair<uint32_t, float>> results;
+        size_t matchCount;
+        index.searchAllTopK({strategyCase.term, strategyCase.rareTerm}, nullptr,
+                            STRATEGY_DOCUMENT_COUNT, results, matchCount);
+
+        vector<uint32_t> documents;
+        for (const auto &result : results)
+            documents.push_back(result.first);
+        sort(documents.begin(), documents.end());
+        if (matchCount != expectedDocuments.size() || documents != expectedDocuments)
+            return fail();
     }
 
-    // Print the result
-    if (result == 0)
+    return pass();
+}
+
+/**
+ *@brief Checks that the minimal perfect hash dictionary numbers every term once and rejects
+ *       the terms it was not built with
+ **/
+int testTermDictionary()
+{
+    print("Term dictionary: ");
+
+    vector<string> terms;
+    for (int i = 0; i < 5000; i++)
+        terms.push_back("termino" + to_string(i));
+
+    TermDictionary dictionary;
+    dictionary.build(terms);
+    if (dictionary.getTermCount() != terms.size())
+        return fail();
+
+    vector<bool> isTermIdUsed(terms.size(), false);
+    for (const auto &term : terms)
     {
-        pass();
+        uint32_t termId;
+        if (!dictionary.find(term, termId) || termId >= terms.size() || isTermIdUsed[termId])
+            return fail();
+        isTermIdUsed[termId] = true;
     }
-    else
+
+    for (int i = 0; i < 5000; i++)
     {
-        fail();
+        uint32_t termId;
+        if (dictionary.find("ausente" + to_string(i), termId) ||
+            dictionary.find("termino" + to_string(terms.size() + i), termId))
+            return fail();
     }
+
+    return pass();
+}
+
+/**
+ *@brief Checks the roaring bitmaps, with array and bitmap containers, against sorted vectors,
+ *       and a filtered match=all search against std::set_intersection
+ **/
+int testRoaringBitmap()
+{
+    print("Roaring bitmap: ");
+
+    // Multiples of 3 fill bitmap containers; the values past 1000000 are sparse
+    vector<uint32_t> values1;
+    vector<uint32_t> values2;
+    for (uint32_t value = 0; value < 200000; value += 3)
+        values1.push_back(value);
+    for (uint32_t value = 0; value < 200000; value += 7)
+        values2.push_back(value);
+    for (uint32_t value = 1000000; value < 2000000; value += 999)
+    {
+        values1.push_back(value);
+        if (value % 2 == 0)
+            values2.push_back(value);
+    }
+
+    RoaringBitmap bitmap1;
+    RoaringBitmap bitmap2;
+    for (uint32_t value : values1)
+        bitmap1.add(value);
+    for (uint32_t value : values2)
+        bitmap2.add(value);
+
+    vector<uint32_t> bitmapValues;
+    bitmap1.getValues(bitmapValues);
+    if (bitmapValues != values1 || bitmap1.getCardinality() != values1.size() ||
+        !bitmap1.contains(3) || bitmap1.contains(4) || bitmap1.getNext(4) != 6)
+        return fail();
+
+    vector<uint32_t> expectedValues;
+    set_intersection(values1.begin(), values1.end(), values2.begin(), values2.end(),
+                     back_inserter(expectedValues));
+    RoaringBitmap::intersect(bitmap1, bitmap2).getValues(bitmapValues);
+    if (bitmapValues != expectedValues)
+        return fail();
+
+    // A large filter is applied to the candidates, a small one replaces them
+    InvertedIndex index;
+    buildStrategyIndex(index);
+    vector<uint32_t> termDocuments1 = getTermDocuments("escaso");
+    vector<uint32_t> termDocuments2 = getTermDocuments("comun");
+    vector<uint32_t> termDocuments;
+    set_intersection(termDocuments1.begin(), termDocuments1.end(), termDocuments2.begin(),
+                     termDocuments2.end(), back_inserter(termDocuments));
+
+    RoaringBitmap smallFilter;
+    smallFilter.add(100);
+    smallFilter.add(101);
+    smallFilter.add(3000);
+    for (const RoaringBitmap *filter : {&bitmap1, &smallFilter})
+    {
+        vector<uint32_t> filterValues;
+        filter->getValues(filterValues);
+        expectedValues.clear();
+        set_intersection(termDocuments.begin(), termDocuments.end(), filterValues.begin(),
+                         filterValues.end(), back_inserter(expectedValues));
+
+        vector<pair<uint32_t, float>> results;
+        size_t matchCount;
+        index.searchAllTopK({"escaso", "comun"}, filter, STRATEGY_DOCUMENT_COUNT, results,
+                            matchCount);
+
+        vector<uint32_t> documents;
+        for (const auto &result : results)
+            documents.push_back(result.first);
+        sort(documents.begin(), documents.end());
+        if (matchCount != expectedValues.size() || documents != expectedValues)
+            return fail();
+    }
+
+    // A filter can hand over documents without terms, also after the last one with terms,
+    // which must still be inside the term bitmaps
+    InvertedIndex emptyEndIndex;
+    for (uint32_t document = 0; document < 200; document++)
+    {
+        emptyEndIndex.addDocument(document, (document < 128) ? vector<string>{"agua", "rio"}
+                                                             : vector<string>());
+    }
+    emptyEndIndex.freeze();
+
+    RoaringBitmap emptyEndFilter;
+    emptyEndFilter.add(5);
+    emptyEndFilter.add(190);
+    vector<pair<uint32_t, float>> results;
+    size_t matchCount;
+    emptyEndIndex.searchAllTopK({"agua", "rio"}, &emptyEndFilter, 10, results, matchCount);
+    if (emptyEndIndex.getDocumentCount() != 200 || matchCount != 1 || results.size() != 1 ||
+        results[0].first != 5)
+        return fail();
+
+    return pass();
+}
+
+/**
+ *@brief Checks the Spanish stemmer against the output of the Snowball reference
+ *       implementation
+ **/
+int testSpanishStemmer()
+{
+    print("Spanish stemmer: ");
+
+    const vector<pair<string, string>> stems = {
+        {"chicas", "chic"},           {"canciones", "cancion"},
+        {"canción", "cancion"},       {"abarcaba", "abarc"},
+        {"abandonada", "abandon"},    {"aceptación", "acept"},
+        {"abundancia", "abund"},      {"actualmente", "actual"},
+        {"haciéndola", "hac"},        {"amistades", "amistad"},
+        {"rápidamente", "rapid"},     {"administración", "administr"},
+        {"aguas", "agu"},             {"solar", "sol"},
+        {"corriendo", "corr"},        {"comeremos", "com"},
+        {"averigüe", "averigü"},      {"huyeron", "huyeron"},
+        {"españoles", "español"},     {"arqueología", "arqueolog"},
+        {"revolución", "revolu"},     {"presidencia", "president"},
+        {"activamente", "activ"},     {"construcción", "construccion"},
+        {"de", "de"}};
+
+    for (const auto &stem : stems)
+    {
+        string word = stem.first;
+        SpanishStemmer::stem(word);
+        if (word != stem.second)
+        {
+            print(stem.first + " -> " + word + ", expected " + stem.second + " ");
+            return fail();
+        }
+    }
+
+    return pass();
+}
+
+/**
+ *@brief Checks that the banded search of near-duplicates finds the clusters a comparison of
+ *       every pair of fingerprints finds
+ **/
+int testSimHashBanding()
+{
+    print("SimHash banding: ");
+
+    // Random fingerprints and copies of some of them with 1 to 6 bits flipped
+    mt19937_64 random(42);
+    vector<uint64_t> fingerprints;
+    for (int i = 0; i < 1000; i++)
+        fingerprints.push_back(random());
+    for (int i = 0; i < 600; i++)
+    {
+        uint64_t fingerprint = fingerprints[random() % 1000];
+        for (int flip = 0; flip <= i % 6; flip++)
+            fingerprint ^= 1ULL << (random() % 64);
+        fingerprints.push_back(fingerprint);
+    }
+
+    vector<char> isComparable(fingerprints.size(), true);
+    for (size_t page = 0; page < fingerprints.size(); page += 10)
+        isComparable[page] = false;
+
+    vector<uint32_t> clusters;
+    size_t duplicateCount = SimHash::findNearDuplicates(fingerprints, isComparable, clusters);
+
+    // Every cluster is named after its first page
+    vector<uint32_t> expectedClusters(fingerprints.size());
+    for (uint32_t page = 0; page < fingerprints.size(); page++)
+        expectedClusters[page] = page;
+    for (uint32_t page1 = 0; page1 < fingerprints.size(); page1++)
+    {
+        for (uint32_t page2 = page1 + 1; page2 < fingerprints.size(); page2++)
+        {
+            if (!isComparable[page1] || !isComparable[page2] ||
+                SimHash::getDistance(fingerprints[page1], fingerprints[page2]) >
+                    SIMHASH_MAX_DISTANCE)
+                continue;
+
+            uint32_t cluster1 = expectedClusters[page1];
+            uint32_t cluster2 = expectedClusters[page2];
+            for (auto &cluster : expectedClusters)
+            {
+                if (cluster == max(cluster1, cluster2))
+                    cluster = min(cluster1, cluster2);
+            }
+        }
+    }
+
+    size_t expectedDuplicateCount = 0;
+    for (uint32_t page = 0; page < fingerprints.size(); page++)
+    {
+        if (expectedClusters[page] != page)
+            expectedDuplicateCount++;
+    }
+
+    return (clusters == expectedClusters && duplicateCount == expectedDuplicateCount &&
+            duplicateCount > 0)
+               ? pass()
+               : fail();
+}
+
+/**
+ *@brief Checks that the PageRank of a graph with dangling pages adds up to 1
+ **/
+int testPageRank()
+{
+    print("PageRank: ");
+
+    // Pages that are a multiple of 10 have no links
+    mt19937 random(42);
+    uint32_t pageCount = 500;
+    vector<pair<uint32_t, uint32_t>> links;
+    for (uint32_t page = 0; page < pageCount; page++)
+    {
+        for (int link = 0; page % 10 && link < 5; link++)
+            links.emplace_back(page, random() % pageCount);
+    }
+
+    LinkGraph graph(pageCount, links);
+    WorkStealingPool pool(2);
+    vector<float> ranks;
+    graph.computePageRank(pool, ranks);
+
+    double rankSum = 0;
+    for (float rank : ranks)
+    {
+        if (rank <= 0)
+            return fail();
+        rankSum += rank;
+    }
+
+    return (ranks.size() == pageCount && fabs(rankSum - 1) < SCORE_TOLERANCE * 10) ? pass()
+                                                                                  : fail();
+}
+
+/**
+ *@brief Checks that the pool runs submitted tasks and batches, that the thread that waits for a
+ *       batch steals its tasks, that exceptions do not end the workers and that a pool being
+ *       destroyed finishes the queued tasks
+ **/
+int testWorkStealingPool()
+{
+    print("Work-stealing pool: ");
+
+    // Waits a few seconds at most, so that a broken pool fails instead of hanging
+    auto waitUntil = [](const function<bool()> &condition) {
+        for (int i = 0; i < 5000 && !condition(); i++)
+            this_thread::sleep_for(chrono::milliseconds(1));
+        return condition();
+    };
+
+    bool isCorrect = true;
+    {
+        WorkStealingPool pool(2);
+
+        atomic<int> submittedCount(0);
+        for (int i = 0; i < 100; i++)
+            pool.submit([&]() { submittedCount++; });
+        isCorrect = waitUntil([&]() { return submittedCount == 100; });
+
+        vector<int> values(100, 0);
+        vector<function<void()>> tasks;
+        for (int i = 0; i < 100; i++)
+            tasks.push_back([&values, i]() { values[i] = i * i; });
+        pool.run(tasks);
+        for (int i = 0; i < 100; i++)
+            isCorrect = isCorrect && values[i] == i * i;
+
+        // Three tasks that wait for each other only start if this thread takes one
+        atomic<int> startedCount(0);
+        atomic<bool> isStolen(false);
+        thread::id callerId = this_thread::get_id();
+        tasks.clear();
+        for (int i = 0; i < 3; i++)
+        {
+            tasks.push_back([&]() {
+                startedCount++;
+                isStolen = isStolen || this_thread::get_id() == callerId;
+                waitUntil([&]() { return startedCount == 3; });
+            });
+        }
+        pool.run(tasks);
+        isCorrect = isCorrect && startedCount == 3 && isStolen;
+
+        // The first exception reaches the caller once the rest of the batch finished
+        atomic<int> finishedCount(0);
+        tasks.clear();
+        for (int i = 0; i < 10; i++)
+        {
+            tasks.push_back([&, i]() {
+                if (i == 5)
+                    throw runtime_error("task 5");
+                finishedCount++;
+            });
+        }
+        string exceptionMessage;
+        try
+        {
+            pool.run(tasks);
+        }
+        catch (const runtime_error &e)
+        {
+            exceptionMessage = e.what();
+        }
+        isCorrect = isCorrect && exceptionMessage == "task 5" && finishedCount == 9;
+
+        pool.submit([]() { throw runtime_error("submitted task"); });
+        submittedCount = 0;
+        for (int i = 0; i < 10; i++)
+            pool.submit([&]() { submittedCount++; });
+        isCorrect = isCorrect && waitUntil([&]() { return submittedCount == 10; });
+    }
+
+    atomic<int> queuedCount(0);
+    {
+        WorkStealingPool pool(2);
+        for (int i = 0; i < 20; i++)
+        {
+            pool.submit([&]() {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                queuedCount++;
+            });
+        }
+    }
+    isCorrect = isCorrect && queuedCount == 20;
+
+    return isCorrect ? pass() : fail();
+}
+
+/**
+ *@brief Checks that escapeHTML, which looks at 16 bytes at a time with SSE2, escapes like a
+ *       byte by byte scan wherever the characters fall, and that a query cannot break out of
+ *       the value of the search box
+ **/
+int testEscapeHTML()
+{
+    print("HTML escaping: ");
+
+    RequestArena arena;
+    auto escape = [&](string_view text) {
+        ArenaString output(arena.getResource());
+        HTMLTemplate::escapeHTML(text, output);
+        return string(output);
+    };
+
+    bool isCorrect = true;
+
+    // Every character to escape at every position around the first two chunks, in texts
+    // shorter and longer than a chunk
+    for (char c : string("&<>\"'"))
+    {
+        for (size_t size = 1; size <= 40; size++)
+        {
+            for (size_t position = 0; position < size; position++)
+            {
+                string text(size, 'a');
+                text[position] = c;
+                isCorrect = isCorrect && escape(text) == escapeHTMLByByte(text);
+            }
+        }
+    }
+
+    // Runs of characters to escape that straddle the chunk boundaries
+    string specialText = "&<>\"'";
+    for (size_t start = 10; start <= 17; start++)
+    {
+        string text = string(start, 'b') + specialText + specialText + string(20, 'b');
+        isCorrect = isCorrect && escape(text) == escapeHTMLByByte(text);
+    }
+
+    // Multibyte UTF-8 is copied as it is, also when a character is split between chunks
+    string utf8Text = "montaña & río <Perú> \"añejo\" 'ñandú' € 🌋";
+    for (size_t start = 0; start <= 16; start++)
+    {
+        string text = string(start, 'c') + utf8Text;
+        isCorrect = isCorrect && escape(text) == escapeHTMLByByte(text);
+    }
+    isCorrect = isCorrect && escape("añejo") == "añejo" && escape("") == "";
+
+    HTMLTemplate searchBox("<input type=\"text\" name=\"q\" value=\"{{query}}\">", {"query"});
+    ArenaString page(arena.getResource());
+    searchBox.render(page, {"\"><script>alert('ñ&ü')</script><b x=\""});
+    isCorrect = isCorrect &&
+                page == "<input type=\"text\" name=\"q\" value=\"&quot;&gt;&lt;script&gt;"
+                        "alert(&#39;ñ&amp;ü&#39;)&lt;/script&gt;&lt;b x=&quot;\">";
+
+    return isCorrect ? pass() : fail();
+}
+
+/**
+ *@brief Checks that identical searches running at the same time are run once and share their
+ *       result or exception, and that searches with other match or filter options never
+ *       share a key
+ **/
+int testSearchCoalescer()
+{
+    print("Search coalescer: ");
+
+    SearchCoalescer coalescer;
+    const int threadCount = 8;
+
+    // The search waits for every thread to call run(), so that they all find it running
+    atomic<int> arrivedCount(0);
+    atomic<int> searchCount(0);
+    auto waitForThreads = [&]() {
+        for (int i = 0; i < 5000 && arrivedCount < threadCount; i++)
+            this_thread::sleep_for(chrono::milliseconds(1));
+        this_thread::sleep_for(chrono::milliseconds(100));
+    };
+
+    vector<shared_ptr<const CoalescedSearch>> results(threadCount);
+    atomic<int> sharedCount(0);
+    vector<thread> threads;
+    for (int i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back([&, i]() {
+            arrivedCount++;
+            bool isShared;
+            results[i] = coalescer.run("any:terms+agua", [&](CoalescedSearch &result) {
+                searchCount++;
+                waitForThreads();
+                result.results.emplace_back(7, 0.5F);
+                result.matchCount = 1;
+            }, isShared);
+            sharedCount += isShared;
+        });
+    }
+    for (auto &searchThread : threads)
+        searchThread.join();
+
+    bool isCorrect = searchCount == 1 && sharedCount == threadCount - 1;
+    for (const auto &result : results)
+    {
+        isCorrect = isCorrect && result == results[0] && result->matchCount == 1 &&
+                    result->results.size() == 1 && result->results[0].first == 7;
+    }
+
+    // A failed search fails every request that waited on it, and is not kept
+    arrivedCount = 0;
+    searchCount = 0;
+    vector<string> exceptionMessages(threadCount);
+    threads.clear();
+    for (int i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back([&, i]() {
+            arrivedCount++;
+            bool isShared;
+            try
+            {
+                coalescer.run("any:terms+agua", [&](CoalescedSearch &) {
+                    searchCount++;
+                    waitForThreads();
+                    throw runtime_error("search failed");
+                }, isShared);
+            }
+            catch (const runtime_error &e)
+            {
+                exceptionMessages[i] = e.what();
+            }
+        });
+    }
+    for (auto &searchThread : threads)
+        searchThread.join();
+
+    isCorrect = isCorrect && searchCount == 1;
+    for (const auto &exceptionMessage : exceptionMessages)
+        isCorrect = isCorrect && exceptionMessage == "search failed";
+
+    bool isShared = true;
+    coalescer.run("any:terms+agua", [&](CoalescedSearch &) { searchCount++; }, isShared);
+    isCorrect = isCorrect && searchCount == 2 && !isShared;
+
+    // Keys of every combination of words, match and filters
+    RequestArena arena;
+    vector<SearchTerms> searchWords;
+    for (vector<string> words : vector<vector<string>>{{"agua"}, {"agua", "rio"}, {"agua rio"}})
+        searchWords.emplace_back(words.begin(), words.end(), arena.getResource());
+    // Filters come sorted by the name of their argument, as the handler reads them
+    vector<vector<pair<string, string>>> filterArguments = {
+        {},
+        {{"len", "long"}},
+        {{"len", "short"}},
+        {{"cat", "Rios"}},
+        {{"initial", "a"}},
+        {{"cat", "Rios"}, {"len", "long"}},
+        {{"cat", "Rios"}, {"len", "short"}},
+        {{"initial", "a"}, {"len", "long"}},
+    };
+
+    set<string> keys;
+    size_t keyCount = 0;
+    for (const auto &words : searchWords)
+    {
+        for (bool matchAll : {false, true})
+        {
+            for (const auto &arguments : filterArguments)
+            {
+                SearchOptions options;
+                options.matchAll = matchAll;
+                string filterKey;
+                for (const auto &argument : arguments)
+                {
+                    if (IndexShard::getFilterKey(argument.first, argument.second, filterKey))
+                        options.filters.push_back(filterKey);
+                }
+                keys.insert(SearchCoalescer::getKey(words, options));
+                keyCount++;
+            }
+        }
+    }
+    isCorrect = isCorrect && keys.size() == keyCount;
+
+    // Words that index to the same terms share a key
+    SearchTerms upperWords({"AGUA", "Rio"}, arena.getResource());
+    isCorrect = isCorrect &&
+                SearchCoalescer::getKey(upperWords, SearchOptions()) ==
+                    SearchCoalescer::getKey(searchWords[1], SearchOptions());
+
+    return isCorrect ? pass() : fail();
+}
+
+/**
+ *@brief Checks that the slow query log writes every trace it takes once and in order, also
+ *       after its ring buffer wrapped around several times, that it drops traces instead of
+ *       waiting when the ring is full, and that the query is escaped for JSON
+ **/
+int testSlowQueryLog()
+{
+    print("Slow query log: ");
+
+    string logPath = (filesystem::temp_directory_path() / "edaoogle_test_slow.log").string();
+    error_code error;
+    filesystem::remove(logPath, error);
+
+    auto readLog = [&]() {
+        ifstream file(logPath);
+        return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    };
+
+    RequestArena arena;
+    vector<string> loggedQueries;
+    size_t queryCount = 0;
+    size_t droppedCount = 0;
+    bool isCorrect = true;
+    {
+        SlowQueryLog slowQueryLog(logPath, 5);
+        isCorrect = !slowQueryLog.isSlow(4999999) && slowQueryLog.isSlow(5000000);
+
+        auto logQuery = [&]() {
+            string query = "q" + to_string(queryCount++);
+            SearchTerms terms(arena.getResource());
+            terms.emplace_back(query);
+            QueryTrace trace;
+            trace.setTerms(terms);
+            if (slowQueryLog.log(trace))
+                loggedQueries.push_back(query);
+            else
+                droppedCount++;
+        };
+
+        // Waits a few seconds at most for the lines of the logged traces
+        auto waitForLines = [&]() {
+            for (int i = 0; i < 1000; i++)
+            {
+                string log = readLog();
+                if ((size_t)count(log.begin(), log.end(), '\n') == loggedQueries.size())
+                    return true;
+                this_thread::sleep_for(chrono::milliseconds(5));
+            }
+            return false;
+        };
+
+        // Half the ring at a time always fits, and goes around it three times
+        for (int batch = 0; batch < 6; batch++)
+        {
+            for (size_t i = 0; i < SLOW_QUERY_LOG_CAPACITY / 2; i++)
+                logQuery();
+            isCorrect = isCorrect && waitForLines();
+        }
+        isCorrect = isCorrect && droppedCount == 0;
+
+        // More than the ring takes while the writer sleeps
+        for (int round = 0; round < 20 && droppedCount == 0; round++)
+        {
+            for (size_t i = 0; i < SLOW_QUERY_LOG_CAPACITY + 100; i++)
+                logQuery();
+            isCorrect = isCorrect && waitForLines();
+        }
+        isCorrect = isCorrect && droppedCount > 0 &&
+                    slowQueryLog.getDroppedEntries() == droppedCount;
+    }
+
+    stringstream logStream(readLog());
+    string line;
+    size_t lineIndex = 0;
+    while (getline(logStream, line))
+    {
+        string query = "\"query\":\"" +
+                       (lineIndex < loggedQueries.size() ? loggedQueries[lineIndex] : "") + "\"";
+        isCorrect = isCorrect && line.find(query) != string::npos;
+        lineIndex++;
+    }
+    isCorrect = isCorrect && lineIndex == loggedQueries.size() &&
+                loggedQueries.size() + droppedCount == queryCount;
+
+    // Quotes, backslashes and control characters cannot end the string or the line
+    filesystem::remove(logPath, error);
+    {
+        SlowQueryLog slowQueryLog(logPath, 0);
+        SearchTerms terms(arena.getResource());
+        for (const char *term : {"comillas\"", "barra\\", "linea\nnueva\t\x01", "ñandú"})
+            terms.emplace_back(term);
+        QueryTrace trace;
+        trace.setTerms(terms);
+        isCorrect = isCorrect && slowQueryLog.log(trace);
+    }
+
+    string log = readLog();
+    isCorrect = isCorrect && count(log.begin(), log.end(), '\n') == 1 &&
+                log.find("\"query\":\"comillas\\\"+barra\\\\+linea\\u000anueva\\u0009\\u0001"
+                         "+ñandú\"") != string::npos &&
+                log.find("{\"term\":\"linea\\u000anueva\\u0009\\u0001\"") != string::npos;
+    filesystem::remove(logPath, error);
+
+    return isCorrect ? pass() : fail();
 }
 
 int main()
 {
-    testTermFreqCallback();
-    return 0;
+    int failures = 0;
+    failures += testTermFrequencyScan();
+    failures += testShedIndex();
+    failures += testShardProtocol();
+    failures += testMemoryBudget();
+    failures += testWandTopK();
+    failures += testIntersectionStrategies();
+    failures += testTermDictionary();
+    failures += testRoaringBitmap();
+    failures += testSpanishStemmer();
+    failures += testSimHashBanding();
+    failures += testPageRank();
+    failures += testWorkStealingPool();
+    failures += testEscapeHTML();
+    failures += testSearchCoalescer();
+    failures += testSlowQueryLog();
+
+    return failures ? 1 : 0;
 }
 
 void print(string s)
@@ -89,25 +1158,180 @@ int pass()
     return 0;
 }
 
-int termFreqCallbackTest(void *data, int argc, char **argv, char **columnNames)
+bool isSameScore(float score1, float score2)
+{
+    return fabs(score1 - score2) < SCORE_TOLERANCE;
+}
+
+/**
+ *@brief Builds an index of STRATEGY_DOCUMENT_COUNT documents with the strategyTerms. Every
+ *       document also has a filler term, so the frequent terms have a bitmap and the rare do
+ *       not.
+ **/
+void buildStrategyIndex(InvertedIndex &index)
+{
+    for (uint32_t document = 0; document < STRATEGY_DOCUMENT_COUNT; document++)
+    {
+        vector<string> tokens = {"relleno"};
+        for (const auto &term : strategyTerms)
+        {
+            if (document % term.second == 0)
+                tokens.push_back(term.first);
+        }
+        index.addDocument(document, tokens);
+    }
+    index.freeze();
+}
+
+/**
+ *@brief Gets the documents of the strategy index that have a term, sorted
+ **/
+vector<uint32_t> getTermDocuments(const string &term)
+{
+    vector<uint32_t> documents;
+    for (const auto &strategyTerm : strategyTerms)
+    {
+        for (uint32_t document = 0;
+             strategyTerm.first == term && document < STRATEGY_DOCUMENT_COUNT;
+             document += strategyTerm.second)
+            documents.push_back(document);
+    }
+
+    return documents;
+}
+
+/**
+ *@brief Writes a wiki of plain articles to a new temporary folder
+ *
+ *@param articles       name and text of every article
+ *
+ *@return string        the folder, which holds the wiki folder
+ **/
+string createTestWiki(const vector<pair<string, string>> &articles)
 {
-    vector<pair<string, float>> &termFrequencies = *static_cast<vector<pair<string, float>> *>(data);
+    filesystem::path homePath = filesystem::temp_directory_path() / "edaoogle_test_home";
+    error_code error;
+    filesystem::remove_all(homePath, error);
+    filesystem::create_directories(homePath / "wiki");
+    writeTestWiki(homePath.string(), articles);
 
-    auto it = find_if(termFrequencies.begin(), termFrequencies.end(),
-    [&](const pair<string, float>& pair) {
-        return pair.first == argv[0];
-    });
+    return homePath.string();
+}
 
-    if (it == termFrequencies.end())
+/**
+ *@brief Writes plain articles to the wiki folder of a test wiki, replacing those with the same
+ *       name
+ *
+ *@param homePath       the folder that holds the wiki folder
+ *@param articles       name and text of every article
+ **/
+void writeTestWiki(const string &homePath, const vector<pair<string, string>> &articles)
+{
+    for (const auto &article : articles)
     {
-        string path = argv[0] ? argv[0] : "NULL";
-        float termFrequency = stof(argv[1] ? argv[1] : "0");
-        termFrequencies.emplace_back(path, termFrequency);
+        ofstream file(filesystem::path(homePath) / "wiki" / (article.first + ".html"));
+        file << "<html><body><p>" << article.second << "</p></body></html>";
     }
-    else 
+}
+
+/**
+ *@brief Reads the arguments of a query string like libmicrohttpd: '+' is a space and %XX a
+ *       byte
+ **/
+HttpArguments decodeQueryString(const string &queryString)
+{
+    auto decode = [](const string &text) {
+        string decodedText;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '+')
+                decodedText += ' ';
+            else if (text[i] == '%' && i + 2 < text.size())
+            {
+                decodedText += (char)stoi(text.substr(i + 1, 2), nullptr, 16);
+                i += 2;
+            }
+            else
+                decodedText += text[i];
+        }
+        return decodedText;
+    };
+
+    HttpArguments arguments;
+    stringstream queryStream(queryString);
+    string argument;
+    while (getline(queryStream, argument, '&'))
     {
-        (*it).second += stof(argv[1]);
+        size_t separator = argument.find('=');
+        arguments[decode(argument.substr(0, separator))] =
+            (separator == string::npos) ? "" : decode(argument.substr(separator + 1));
     }
 
-    return 0;
-}
\ No newline at end of file
+    return arguments;
+}
+
+/**
+ *@brief Reads the memory report of a handler into a map of "name value" lines
+ **/
+map<string, size_t> getMemoryStatus(EDAoogleHttpRequestHandler &handler)
+{
+    vector<char> response;
+    handler.handleAdminRequest("/admin/memory", response);
+
+    map<string, size_t> status;
+    stringstream statusStream(string(response.begin(), response.end()));
+    string name;
+    size_t value;
+    while (statusStream >> name >> value)
+    {
+        status[name] = value;
+        statusStream.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+
+    return status;
+}
+
+/**
+ *@brief Gets what a shard server answers to a /shard/search with some arguments, with the
+ *       scores left out so that only the match count and the articles are compared
+ **/
+string getShardResponse(EDAoogleHttpRequestHandler &handler, const HttpArguments &arguments)
+{
+    vector<char> response;
+    handler.handleRequest("/shard/search", arguments, response);
+
+    string shardResponse;
+    stringstream responseStream(string(response.begin(), response.end()));
+    string line;
+    getline(responseStream, shardResponse);
+    vector<string> urls;
+    while (getline(responseStream, line))
+        urls.push_back(line.substr(line.find('\t') + 1));
+    sort(urls.begin(), urls.end());
+    for (const auto &url : urls)
+        shardResponse += "\n" + url;
+
+    return shardResponse;
+}
+
+/**
+ *@brief Escapes a text for HTML one byte at a time, as escapeHTML does without SSE2
+ **/
+string escapeHTMLByByte(const string &text)
+{
+    string escapedText;
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '&': escapedText += "&amp;"; break;
+        case '<': escapedText += "&lt;"; break;
+        case '>': escapedText += "&gt;"; break;
+        case '"': escapedText += "&quot;"; break;
+        case '\'': escapedText += "&#39;"; break;
+        default: escapedText += c;
+        }
+    }
+
+    return escapedText;
+}